@@ -69,6 +69,9 @@ struct gprs_context_data {
 	void *cb_data;                                  /* Callback data */
 	unsigned int vendor;
 	gboolean use_atd99;
+	gboolean ipv6;			/* IPV6CP requested */
+	gboolean ipv4_up;
+	gboolean ipv6_done;		/* IPV6CP up or refused */
 };
 
 static void ppp_debug(const char *str, void *data)
@@ -94,12 +97,51 @@ static void ppp_connect(const char *interface, const char *local,
 	ofono_info("IP: %s", local);
 	ofono_info("DNS: %s, %s", dns1, dns2);
 
-	gcd->state = STATE_ACTIVE;
 	ofono_gprs_context_set_interface(gc, interface);
 	ofono_gprs_context_set_ipv4_address(gc, local, TRUE);
 	ofono_gprs_context_set_ipv4_netmask(gc, STATIC_IP_NETMASK);
 	ofono_gprs_context_set_ipv4_dns_servers(gc, dns);
 
+	gcd->ipv4_up = TRUE;
+
+	/* For dual stack contexts wait until IPV6CP settles as well */
+	if (gcd->ipv6 && !gcd->ipv6_done)
+		return;
+
+	gcd->state = STATE_ACTIVE;
+	CALLBACK_WITH_SUCCESS(gcd->cb, gcd->cb_data);
+}
+
+static void ppp_ipv6_connect(const char *local, const char *peer,
+							gpointer user_data)
+{
+	struct ofono_gprs_context *gc = user_data;
+	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+
+	DBG("local %s peer %s", local, peer);
+
+	if (gcd->state != STATE_ENABLING || gcd->ipv6_done)
+		return;
+
+	gcd->ipv6_done = TRUE;
+
+	/*
+	 * Only the Interface Identifiers are negotiated over PPP, global
+	 * addresses are left to router advertisements on the interface
+	 */
+	if (local) {
+		ofono_info("IPv6: %s", local);
+
+		ofono_gprs_context_set_ipv6_address(gc, local);
+		ofono_gprs_context_set_ipv6_prefix_length(gc, 64);
+		ofono_gprs_context_set_ipv6_gateway(gc, peer);
+	} else
+		ofono_info("IPv6 refused by the network, using IPv4 only");
+
+	if (!gcd->ipv4_up)
+		return;
+
+	gcd->state = STATE_ACTIVE;
 	CALLBACK_WITH_SUCCESS(gcd->cb, gcd->cb_data);
 }
 
@@ -163,8 +205,17 @@ static gboolean setup_ppp(struct ofono_gprs_context *gc)
 		g_at_ppp_set_credentials(gcd->ppp, gcd->username,
 								gcd->password);
 
+	gcd->ipv4_up = FALSE;
+	gcd->ipv6_done = FALSE;
+
+	if (gcd->ipv6 && !g_at_ppp_enable_ipv6(gcd->ppp, NULL, NULL)) {
+		ofono_info("Unable to enable IPV6CP, using IPv4 only");
+		gcd->ipv6_done = TRUE;
+	}
+
 	/* set connect and disconnect callbacks */
 	g_at_ppp_set_connect_function(gcd->ppp, ppp_connect, gc);
+	g_at_ppp_set_ipv6_connect_function(gcd->ppp, ppp_ipv6_connect, gc);
 	g_at_ppp_set_disconnect_function(gcd->ppp, ppp_disconnect, gc);
 
 	/* open the ppp connection */
@@ -236,11 +287,25 @@ static void at_gprs_activate_primary(struct ofono_gprs_context *gc,
 {
 	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
 	char buf[OFONO_GPRS_MAX_APN_LENGTH + 128];
+	const char *pdp_type;
 	int len;
 
-	/* IPv6 support not implemented */
-	if (ctx->proto != OFONO_GPRS_PROTO_IP)
+	/*
+	 * The tun interface is only created once IPCP is up, so IPv6 is
+	 * supported on dual stack contexts but not on its own
+	 */
+	switch (ctx->proto) {
+	case OFONO_GPRS_PROTO_IP:
+		pdp_type = "IP";
+		gcd->ipv6 = FALSE;
+		break;
+	case OFONO_GPRS_PROTO_IPV4V6:
+		pdp_type = "IPV4V6";
+		gcd->ipv6 = TRUE;
+		break;
+	default:
 		goto error;
+	}
 
 	DBG("cid %u", ctx->cid);
 
@@ -288,7 +353,8 @@ static void at_gprs_activate_primary(struct ofono_gprs_context *gc,
 						NULL, NULL, NULL);
 	}
 
-	len = snprintf(buf, sizeof(buf), "AT+CGDCONT=%u,\"IP\"", ctx->cid);
+	len = snprintf(buf, sizeof(buf), "AT+CGDCONT=%u,\"%s\"",
+			ctx->cid, pdp_type);
 
 	switch (gcd->vendor) {
 	case OFONO_VENDOR_UBLOX:
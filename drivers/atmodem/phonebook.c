@@ -565,6 +565,7 @@ static int at_phonebook_probe(struct ofono_phonebook *pb, unsigned int vendor,
 		return -ENOMEM;
 
 	pbd->chat = g_at_chat_clone(chat);
+	g_at_chat_set_priority(pbd->chat, G_AT_CHAT_PRIORITY_LOW);
 	pbd->vendor = vendor;
 
 	ofono_phonebook_set_data(pb, pbd);
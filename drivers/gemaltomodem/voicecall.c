@@ -529,6 +529,7 @@ static int gemalto_voicecall_probe(struct ofono_voicecall *vc,
 
 	vd = g_new0(struct voicecall_data, 1);
 	vd->chat = g_at_chat_clone(chat);
+	g_at_chat_set_priority(vd->chat, G_AT_CHAT_PRIORITY_HIGH);
 	ofono_voicecall_set_data(vc, vd);
 	g_at_chat_send(vd->chat, "AT+CSSN=1,1", NULL, NULL, NULL, NULL);
 	g_at_chat_send(vd->chat, "AT^SLCC=1", NULL,
@@ -1268,6 +1268,7 @@ static int hfp_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 	vd = g_new0(struct voicecall_data, 1);
 
 	vd->chat = g_at_chat_clone(info->chat);
+	g_at_chat_set_priority(vd->chat, G_AT_CHAT_PRIORITY_HIGH);
 	vd->ag_features = info->ag_features;
 	vd->ag_mpty_features = info->ag_mpty_features;
 
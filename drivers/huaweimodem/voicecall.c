@@ -475,6 +475,7 @@ static int huawei_voicecall_probe(struct ofono_voicecall *vc,
 		return -ENOMEM;
 
 	vd->chat = g_at_chat_clone(chat);
+	g_at_chat_set_priority(vd->chat, G_AT_CHAT_PRIORITY_HIGH);
 
 	ofono_voicecall_set_data(vc, vd);
 
@@ -53,10 +53,23 @@ struct mbim_message {
 		uint32_t command_type;
 	};
 	uint32_t info_buf_len;
+	struct mbim_segment_pool *pool;
 
 	bool sealed : 1;
 };
 
+/*
+ * Receive buffers of one device, all of the same size.  Buffers that are
+ * given back are kept on a free list threaded through their first bytes.
+ */
+struct mbim_segment_pool {
+	int ref_count;
+	size_t segment_size;
+	unsigned int max_cached;
+	unsigned int n_cached;
+	void *cached;
+};
+
 static const char *_signature_end(const char *signature)
 {
 	const char *ptr = signature;
@@ -624,6 +637,84 @@ struct mbim_message *_mbim_message_new_command_done(const uint8_t *uuid,
 	return message;
 }
 
+struct mbim_segment_pool *_mbim_segment_pool_new(size_t segment_size,
+						unsigned int max_cached)
+{
+	struct mbim_segment_pool *pool = l_new(struct mbim_segment_pool, 1);
+
+	if (segment_size < sizeof(void *))
+		segment_size = sizeof(void *);
+
+	pool->segment_size = segment_size;
+	pool->max_cached = max_cached;
+
+	return _mbim_segment_pool_ref(pool);
+}
+
+struct mbim_segment_pool *_mbim_segment_pool_ref(
+					struct mbim_segment_pool *pool)
+{
+	if (!pool)
+		return NULL;
+
+	__sync_fetch_and_add(&pool->ref_count, 1);
+
+	return pool;
+}
+
+void _mbim_segment_pool_unref(struct mbim_segment_pool *pool)
+{
+	if (!pool)
+		return;
+
+	if (__sync_sub_and_fetch(&pool->ref_count, 1))
+		return;
+
+	while (pool->cached) {
+		void *segment = pool->cached;
+
+		pool->cached = *(void **) segment;
+		l_free(segment);
+	}
+
+	l_free(pool);
+}
+
+void *_mbim_segment_pool_get(struct mbim_segment_pool *pool)
+{
+	void *segment = pool->cached;
+
+	if (!segment)
+		return l_malloc(pool->segment_size);
+
+	pool->cached = *(void **) segment;
+	pool->n_cached -= 1;
+
+	return segment;
+}
+
+void _mbim_segment_pool_put(struct mbim_segment_pool *pool, void *segment)
+{
+	if (!segment)
+		return;
+
+	if (pool->n_cached >= pool->max_cached) {
+		l_free(segment);
+		return;
+	}
+
+	*(void **) segment = pool->cached;
+	pool->cached = segment;
+	pool->n_cached += 1;
+}
+
+void _mbim_message_set_segment_pool(struct mbim_message *message,
+					struct mbim_segment_pool *pool)
+{
+	_mbim_segment_pool_unref(message->pool);
+	message->pool = _mbim_segment_pool_ref(pool);
+}
+
 void _mbim_message_set_tid(struct mbim_message *message, uint32_t tid)
 {
 	struct mbim_message_header *hdr =
@@ -696,9 +787,15 @@ void mbim_message_unref(struct mbim_message *msg)
 	if (__sync_sub_and_fetch(&msg->ref_count, 1))
 		return;
 
-	for (i = 0; i < msg->n_frags; i++)
-		l_free(msg->frags[i].iov_base);
+	for (i = 0; i < msg->n_frags; i++) {
+		if (msg->pool)
+			_mbim_segment_pool_put(msg->pool,
+						msg->frags[i].iov_base);
+		else
+			l_free(msg->frags[i].iov_base);
+	}
 
+	_mbim_segment_pool_unref(msg->pool);
 	l_free(msg->frags);
 	l_free(msg);
 }
@@ -46,6 +46,16 @@ struct mbim_fragment_header {
 	__le32 cur_frag;
 } __attribute__ ((packed));
 
+struct mbim_segment_pool;
+
+struct mbim_segment_pool *_mbim_segment_pool_new(size_t segment_size,
+						unsigned int max_cached);
+struct mbim_segment_pool *_mbim_segment_pool_ref(
+					struct mbim_segment_pool *pool);
+void _mbim_segment_pool_unref(struct mbim_segment_pool *pool);
+void *_mbim_segment_pool_get(struct mbim_segment_pool *pool);
+void _mbim_segment_pool_put(struct mbim_segment_pool *pool, void *segment);
+
 struct mbim_message *_mbim_message_build(const void *header,
 						struct iovec *frags,
 						uint32_t n_frags);
@@ -53,6 +63,8 @@ struct mbim_message *_mbim_message_new_command_done(const uint8_t *uuid,
 					uint32_t cid, uint32_t status);
 uint32_t _mbim_information_buffer_offset(uint32_t type);
 void _mbim_message_set_tid(struct mbim_message *message, uint32_t tid);
+void _mbim_message_set_segment_pool(struct mbim_message *message,
+					struct mbim_segment_pool *pool);
 void *_mbim_message_to_bytearray(struct mbim_message *message, size_t *out_len);
 void *_mbim_message_get_header(struct mbim_message *message, size_t *out_len);
 struct iovec *_mbim_message_get_body(struct mbim_message *message,
@@ -38,6 +38,7 @@
 #include "mbim-private.h"
 
 #define MAX_CONTROL_TRANSFER 4096
+#define MAX_CACHED_SEGMENTS 8
 #define HEADER_SIZE (sizeof(struct mbim_message_header) + \
 					sizeof(struct mbim_fragment_header))
 
@@ -127,47 +128,71 @@ struct message_assembly_node {
 	struct iovec *iov;
 	size_t n_iov;
 	size_t cur_iov;
+	struct mbim_segment_pool *pool;
 } __attribute((packed))__;
 
 struct message_assembly {
-	struct l_queue *transactions;
+	struct l_hashmap *transactions;	/* Partial messages by tid */
+	struct mbim_segment_pool *pool;
 };
 
-static bool message_assembly_node_match_tid(const void *a, const void *b)
-{
-	const struct message_assembly_node *node = a;
-	uint32_t tid = L_PTR_TO_UINT(b);
-
-	return L_LE32_TO_CPU(node->msg_hdr.tid) == tid;
-}
-
 static void message_assembly_node_free(void *data)
 {
 	struct message_assembly_node *node = data;
 	size_t i;
 
 	for (i = 0; i < node->n_iov; i++)
-		l_free(node->iov[i].iov_base);
+		_mbim_segment_pool_put(node->pool, node->iov[i].iov_base);
 
 	l_free(node->iov);
 	l_free(node);
 }
 
-static struct message_assembly *message_assembly_new()
+static struct message_assembly *message_assembly_new(
+					struct mbim_segment_pool *pool)
 {
 	struct message_assembly *assembly = l_new(struct message_assembly, 1);
 
-	assembly->transactions = l_queue_new();
+	assembly->transactions = l_hashmap_new();
+	assembly->pool = _mbim_segment_pool_ref(pool);
 
 	return assembly;
 }
 
 static void message_assembly_free(struct message_assembly *assembly)
 {
-	l_queue_destroy(assembly->transactions, message_assembly_node_free);
+	l_hashmap_destroy(assembly->transactions, message_assembly_node_free);
+	_mbim_segment_pool_unref(assembly->pool);
 	l_free(assembly);
 }
 
+static struct mbim_message *message_assembly_build(
+					struct message_assembly *assembly,
+					const void *header,
+					struct iovec *iov, uint32_t n_iov)
+{
+	struct mbim_message *message;
+	uint32_t i;
+
+	message = _mbim_message_build(header, iov, n_iov);
+	if (!message) {
+		for (i = 0; i < n_iov; i++)
+			_mbim_segment_pool_put(assembly->pool,
+						iov[i].iov_base);
+
+		l_free(iov);
+		return NULL;
+	}
+
+	_mbim_message_set_segment_pool(message, assembly->pool);
+
+	return message;
+}
+
+/*
+ * Takes ownership of frag, which must come from the assembly's segment
+ * pool.  It is given back to the pool if the fragment is dropped.
+ */
 static struct mbim_message *message_assembly_add(
 					struct message_assembly *assembly,
 					const void *header,
@@ -184,15 +209,13 @@ static struct mbim_message *message_assembly_add(
 	struct mbim_message *message;
 
 	if (type != MBIM_COMMAND_DONE && type != MBIM_INDICATE_STATUS_MSG)
-		return NULL;
+		goto drop;
 
-	node = l_queue_find(assembly->transactions,
-				message_assembly_node_match_tid,
-				L_UINT_TO_PTR(tid));
+	node = l_hashmap_lookup(assembly->transactions, L_UINT_TO_PTR(tid));
 
 	if (!node) {
 		if (cur_frag != 0)
-			return NULL;
+			goto drop;
 
 		if (n_frags == 1) {
 			struct iovec *iov = l_new(struct iovec, 1);
@@ -200,7 +223,7 @@ static struct mbim_message *message_assembly_add(
 			iov[0].iov_base = frag;
 			iov[0].iov_len = frag_len;
 
-			return _mbim_message_build(header, iov, 1);
+			return message_assembly_build(assembly, header, iov, 1);
 		}
 
 		node = l_new(struct message_assembly_node, 1);
@@ -211,17 +234,19 @@ static struct mbim_message *message_assembly_add(
 		node->cur_iov = cur_frag;
 		node->iov[node->cur_iov].iov_base = frag;
 		node->iov[node->cur_iov].iov_len = frag_len;
+		node->pool = assembly->pool;
 
-		l_queue_push_head(assembly->transactions, node);
+		l_hashmap_insert(assembly->transactions, L_UINT_TO_PTR(tid),
+									node);
 
 		return NULL;
 	}
 
 	if (node->n_iov != n_frags)
-		return NULL;
+		goto drop;
 
 	if (node->cur_iov + 1 != cur_frag)
-		return NULL;
+		goto drop;
 
 	node->cur_iov = cur_frag;
 	node->iov[node->cur_iov].iov_base = frag;
@@ -230,15 +255,16 @@ static struct mbim_message *message_assembly_add(
 	if (node->cur_iov + 1 < node->n_iov)
 		return NULL;
 
-	l_queue_remove(assembly->transactions, node);
-	message = _mbim_message_build(&node->msg_hdr, node->iov, node->n_iov);
-
-	if (!message)
-		message_assembly_node_free(node);
-	else
-		l_free(node);
+	l_hashmap_remove(assembly->transactions, L_UINT_TO_PTR(tid));
+	message = message_assembly_build(assembly, &node->msg_hdr,
+						node->iov, node->n_iov);
+	l_free(node);
 
 	return message;
+
+drop:
+	_mbim_segment_pool_put(assembly->pool, frag);
+	return NULL;
 }
 
 struct mbim_device {
@@ -261,6 +287,7 @@ struct mbim_device {
 	size_t header_offset;
 	size_t segment_bytes_remaining;
 	void *segment;
+	struct mbim_segment_pool *segment_pool;
 	struct l_queue *pending_commands;
 	struct l_queue *sent_commands;
 	struct l_queue *notifications;
@@ -338,6 +365,87 @@ static bool pending_command_free_by_gid(void *data, void *user_data)
 	return true;
 }
 
+/*
+ * Tracks a set of commands submitted together with mbim_device_send_batch.
+ * Every member holds a reference through its destroy callback, the replies
+ * are handed out in submission order once the last one arrives
+ */
+struct command_batch {
+	uint32_t *tids;
+	struct mbim_message **replies;
+	unsigned int n_commands;
+	unsigned int n_replied;
+	unsigned int n_released;
+	mbim_device_batch_func_t callback;
+	mbim_device_destroy_func_t destroy;
+	void *user_data;
+};
+
+static void command_batch_cancel(struct command_batch *batch)
+{
+	if (batch->destroy)
+		batch->destroy(batch->user_data);
+
+	batch->callback = NULL;
+	batch->user_data = NULL;
+	batch->destroy = NULL;
+}
+
+static void command_batch_reply(struct mbim_message *message, void *user_data)
+{
+	struct command_batch *batch = user_data;
+	struct mbim_message_header *hdr =
+			_mbim_message_get_header(message, NULL);
+	uint32_t tid = L_LE32_TO_CPU(hdr->tid);
+	unsigned int i;
+
+	for (i = 0; i < batch->n_commands; i++) {
+		if (batch->tids[i] == tid)
+			break;
+	}
+
+	if (i == batch->n_commands || batch->replies[i])
+		return;
+
+	batch->replies[i] = mbim_message_ref(message);
+	batch->n_replied += 1;
+
+	if (batch->n_replied < batch->n_commands)
+		return;
+
+	if (batch->callback)
+		batch->callback(batch->replies, batch->n_commands,
+					batch->user_data);
+}
+
+static void command_batch_release(void *user_data)
+{
+	struct command_batch *batch = user_data;
+	unsigned int i;
+
+	batch->n_released += 1;
+
+	/*
+	 * Replies are dispatched right before the command is released, so
+	 * falling behind means a member was canceled.  The batch as a whole
+	 * can then never complete
+	 */
+	if (batch->n_released > batch->n_replied)
+		command_batch_cancel(batch);
+
+	if (batch->n_released < batch->n_commands)
+		return;
+
+	command_batch_cancel(batch);
+
+	for (i = 0; i < batch->n_commands; i++)
+		mbim_message_unref(batch->replies[i]);
+
+	l_free(batch->replies);
+	l_free(batch->tids);
+	l_free(batch);
+}
+
 struct notification {
 	uint32_t id;
 	uint32_t gid;
@@ -486,7 +594,8 @@ static bool command_write_handler(struct l_io *io, void *user_data)
 
 		written = L_TFR(write(fd, buf, pos));
 
-		l_info("n_iov: %zu, %zu", n_iov + 1, (size_t) written);
+		l_util_debug(device->debug_handler, device->debug_data,
+				"n_iov: %zu, %zd", n_iov + 1, written);
 
 		if (written < 0)
 			return false;
@@ -643,10 +752,11 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 		n_iov += 1;
 	}
 
-	l_info("hdr->len: %u", L_LE32_TO_CPU(hdr->len));
-	l_info("header_size: %u", header_size);
-	l_info("header_offset: %zu", device->header_offset);
-	l_info("segment_bytes_remaining: %zu", device->segment_bytes_remaining);
+	l_util_debug(device->debug_handler, device->debug_data,
+			"hdr->len: %u, header_size: %u, header_offset: %zu, "
+			"segment_bytes_remaining: %zu",
+			L_LE32_TO_CPU(hdr->len), header_size,
+			device->header_offset, device->segment_bytes_remaining);
 
 	iov[n_iov].iov_base = device->segment + L_LE32_TO_CPU(hdr->len) -
 				device->header_offset -
@@ -692,7 +802,7 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 	message = message_assembly_add(device->assembly, device->header,
 					device->segment,
 					L_LE32_TO_CPU(hdr->len) - header_size);
-	device->segment = l_malloc(device->max_segment_size - HEADER_SIZE);
+	device->segment = _mbim_segment_pool_get(device->segment_pool);
 
 	if (!message)
 		return true;
@@ -730,6 +840,7 @@ static bool open_read_handler(struct l_io *io, void *user_data)
 {
 	struct mbim_device *device = user_data;
 	uint8_t buf[MAX_CONTROL_TRANSFER];
+	uint8_t *data;
 	ssize_t len;
 	uint32_t type;
 	int fd;
@@ -757,8 +868,17 @@ static bool open_read_handler(struct l_io *io, void *user_data)
 					sizeof(struct mbim_message_header);
 	}
 
-	len = L_TFR(read(fd, buf,
-					device->segment_bytes_remaining));
+	/*
+	 * The OPEN_DONE Status field can arrive over several reads, keep it
+	 * in the header buffer right after the message header until it is
+	 * complete.  Anything else is read and dropped.
+	 */
+	if (type == MBIM_OPEN_DONE)
+		data = device->header + device->header_offset;
+	else
+		data = buf;
+
+	len = L_TFR(read(fd, data, device->segment_bytes_remaining));
 	if (len < 0) {
 		if (errno == EAGAIN)
 			return true;
@@ -766,19 +886,25 @@ static bool open_read_handler(struct l_io *io, void *user_data)
 		return false;
 	}
 
-	l_util_hexdump(true, buf, len,
+	l_util_hexdump(true, data, len,
 				device->debug_handler, device->debug_data);
 	device->segment_bytes_remaining -= len;
 
+	if (type == MBIM_OPEN_DONE)
+		device->header_offset += len;
+
+	if (device->segment_bytes_remaining)
+		return true;
+
 	/* Ready to read next packet */
-	if (!device->segment_bytes_remaining)
-		device->header_offset = 0;
+	device->header_offset = 0;
 
 	if (type != MBIM_OPEN_DONE)
 		return true;
 
 	/* Grab OPEN_DONE Status field */
-	if (l_get_le32(buf) != 0) {
+	if (l_get_le32(device->header +
+				sizeof(struct mbim_message_header)) != 0) {
 		close(fd);
 		return false;
 	}
@@ -906,7 +1032,14 @@ struct mbim_device *mbim_device_new(int fd, uint32_t max_segment_size)
 	device->next_tid = 1;
 	device->next_notification = 1;
 
-	device->segment = l_malloc(max_segment_size - HEADER_SIZE);
+	/*
+	 * Segments are handed over to the messages built from them and
+	 * come back here once those are unreferenced
+	 */
+	device->segment_pool = _mbim_segment_pool_new(
+					max_segment_size - HEADER_SIZE,
+					MAX_CACHED_SEGMENTS);
+	device->segment = _mbim_segment_pool_get(device->segment_pool);
 
 	device->io = l_io_new(fd);
 	l_io_set_disconnect_handler(device->io, disconnect_handler,
@@ -918,7 +1051,7 @@ struct mbim_device *mbim_device_new(int fd, uint32_t max_segment_size)
 	device->pending_commands = l_queue_new();
 	device->sent_commands = l_queue_new();
 	device->notifications = l_queue_new();
-	device->assembly = message_assembly_new();
+	device->assembly = message_assembly_new(device->segment_pool);
 
 	return mbim_device_ref(device);
 }
@@ -948,7 +1081,7 @@ void mbim_device_unref(struct mbim_device *device)
 		device->io = NULL;
 	}
 
-	l_free(device->segment);
+	_mbim_segment_pool_put(device->segment_pool, device->segment);
 
 	if (device->debug_destroy)
 		device->debug_destroy(device->debug_data);
@@ -960,6 +1093,7 @@ void mbim_device_unref(struct mbim_device *device)
 	l_queue_destroy(device->sent_commands, pending_command_free);
 	l_queue_destroy(device->notifications, notification_free);
 	message_assembly_free(device->assembly);
+	_mbim_segment_pool_unref(device->segment_pool);
 	l_free(device);
 }
 
@@ -1083,6 +1217,46 @@ done:
 	return pending->tid;
 }
 
+/*
+ * Queues messages that do not depend on each other's replies in one go, so
+ * that up to max_outstanding of them can be in flight at the same time.
+ * function is called once with all replies, in the order of messages.  If
+ * any of the commands is canceled, function is not called at all
+ */
+bool mbim_device_send_batch(struct mbim_device *device, uint32_t gid,
+				struct mbim_message **messages,
+				unsigned int n_messages,
+				mbim_device_batch_func_t function,
+				void *user_data,
+				mbim_device_destroy_func_t destroy)
+{
+	struct command_batch *batch;
+	unsigned int i;
+
+	if (!device || !messages || !n_messages)
+		return false;
+
+	for (i = 0; i < n_messages; i++) {
+		if (!messages[i])
+			return false;
+	}
+
+	batch = l_new(struct command_batch, 1);
+	batch->tids = l_new(uint32_t, n_messages);
+	batch->replies = l_new(struct mbim_message *, n_messages);
+	batch->n_commands = n_messages;
+	batch->callback = function;
+	batch->destroy = destroy;
+	batch->user_data = user_data;
+
+	for (i = 0; i < n_messages; i++)
+		batch->tids[i] = mbim_device_send(device, gid, messages[i],
+						command_batch_reply, batch,
+						command_batch_release);
+
+	return true;
+}
+
 bool mbim_device_cancel(struct mbim_device *device, uint32_t tid)
 {
 	struct pending_command *pending;
@@ -93,6 +93,9 @@ typedef void (*mbim_device_destroy_func_t) (void *user_data);
 typedef void (*mbim_device_ready_func_t) (void *user_data);
 typedef void (*mbim_device_reply_func_t) (struct mbim_message *message,
 							void *user_data);
+typedef void (*mbim_device_batch_func_t) (struct mbim_message **replies,
+						unsigned int n_replies,
+						void *user_data);
 
 extern const uint8_t mbim_uuid_basic_connect[];
 extern const uint8_t mbim_uuid_sms[];
@@ -137,6 +140,12 @@ uint32_t mbim_device_send(struct mbim_device *device, uint32_t gid,
 				mbim_device_reply_func_t function,
 				void *user_data,
 				mbim_device_destroy_func_t destroy);
+bool mbim_device_send_batch(struct mbim_device *device, uint32_t gid,
+				struct mbim_message **messages,
+				unsigned int n_messages,
+				mbim_device_batch_func_t function,
+				void *user_data,
+				mbim_device_destroy_func_t destroy);
 bool mbim_device_cancel(struct mbim_device *device, uint32_t tid);
 bool mbim_device_cancel_group(struct mbim_device *device, uint32_t gid);
 
@@ -43,6 +43,11 @@
 #include "qmi.h"
 #include "ctl.h"
 
+/* Initial receive buffer size, grown as needed for larger frames */
+#define QMUX_RX_BUF_SIZE 2048
+/* Maximum number of reads from the device per wakeup */
+#define QMUX_MAX_READS 8
+
 typedef void (*qmi_message_func_t)(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data);
 
@@ -90,7 +95,7 @@ struct qmi_device_ops {
 struct qmi_device {
 	struct l_io *io;
 	struct l_queue *req_queue;
-	struct l_queue *service_queue;
+	struct l_hashmap *service_requests;	/* Sent requests by tid */
 	struct l_queue *discovery_queue;
 	unsigned int next_group_id;	/* Matches requests with services */
 	uint16_t next_service_tid;
@@ -116,6 +121,9 @@ struct qmi_device_qmux {
 	unsigned int release_users;
 	uint8_t next_control_tid;
 	struct l_queue *control_queue;
+	uint8_t *rx_buf;		/* Received, not yet dispatched */
+	size_t rx_size;
+	size_t rx_len;
 };
 
 struct qmi_service {
@@ -126,6 +134,8 @@ struct qmi_service {
 	uint8_t client_id;
 	uint16_t next_notify_id;
 	struct l_queue *notify_list;
+	struct l_hashmap *notify_map;	/* Queue of notify by message id */
+	struct l_queue *notify_queue;	/* Queue being dispatched */
 };
 
 struct qmi_param {
@@ -139,6 +149,8 @@ struct qmi_result {
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	bool indexed;
+	uint16_t tlv_offset[256];	/* Offset + 1 of first TLV by type */
 };
 
 struct qmi_notify {
@@ -147,6 +159,7 @@ struct qmi_notify {
 	qmi_result_func_t callback;
 	void *user_data;
 	qmi_destroy_func_t destroy;
+	bool destroyed;
 };
 
 struct qmi_mux_hdr {
@@ -317,12 +330,17 @@ static void __notify_free(void *data)
 	l_free(notify);
 }
 
+static void __notify_queue_free(void *data)
+{
+	l_queue_destroy(data, NULL);
+}
+
 static bool __notify_compare(const void *data, const void *user_data)
 {
 	const struct qmi_notify *notify = data;
 	uint16_t id = L_PTR_TO_UINT(user_data);
 
-	return notify->id == id;
+	return notify->id == id && !notify->destroyed;
 }
 
 struct service_find_by_type_data {
@@ -752,26 +770,131 @@ static uint16_t __service_request_submit(struct qmi_device *device,
 	return req->tid;
 }
 
-static void service_notify_if_message_matches(void *data, void *user_data)
+static void qmi_result_init(struct qmi_result *result, uint16_t message,
+				const void *data, uint16_t length)
+{
+	result->message = message;
+	result->result = 0;
+	result->error = 0;
+	result->data = data;
+	result->length = length;
+	result->indexed = false;
+}
+
+/*
+ * Drivers typically pull many TLVs out of a single result, so index all
+ * of them on first access instead of scanning for each one.  Indexing
+ * stops at the first TLV running past the end of the message.
+ */
+static void qmi_result_index_tlvs(struct qmi_result *result)
+{
+	uint16_t offset = 0;
+
+	memset(result->tlv_offset, 0, sizeof(result->tlv_offset));
+	result->indexed = true;
+
+	while (result->length - offset >= QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv = result->data + offset;
+		uint16_t tlv_length = L_LE16_TO_CPU(tlv->length);
+
+		if (tlv_length > result->length - offset - QMI_TLV_HDR_SIZE) {
+			DBG("Malformed tlv 0x%02x len 0x%04x",
+						tlv->type, tlv_length);
+			break;
+		}
+
+		if (!result->tlv_offset[tlv->type])
+			result->tlv_offset[tlv->type] = offset + 1;
+
+		offset += QMI_TLV_HDR_SIZE + tlv_length;
+	}
+}
+
+static const void *qmi_result_tlv_get(struct qmi_result *result,
+					uint8_t type, uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+
+	if (!result->indexed)
+		qmi_result_index_tlvs(result);
+
+	if (!result->tlv_offset[type])
+		return NULL;
+
+	tlv = result->data + result->tlv_offset[type] - 1;
+
+	if (length)
+		*length = L_LE16_TO_CPU(tlv->length);
+
+	return tlv->value;
+}
+
+static void service_notify_callback(void *data, void *user_data)
 {
 	struct qmi_notify *notify = data;
 	struct qmi_result *result = user_data;
 
-	if (notify->message == result->message)
-		notify->callback(result, notify->user_data);
+	if (notify->destroyed)
+		return;
+
+	notify->callback(result, notify->user_data);
 }
 
-static void service_notify(const void *key, void *value, void *user_data)
+static bool service_notify_sweep(void *data, void *user_data)
 {
-	struct qmi_service *service = value;
-	struct qmi_result *result = user_data;
+	struct qmi_notify *notify = data;
+	struct qmi_service *service = user_data;
+
+	if (!notify->destroyed)
+		return false;
+
+	l_queue_remove(service->notify_list, notify);
+	__notify_free(notify);
+
+	return true;
+}
+
+static void service_notify(struct qmi_service *service,
+				struct qmi_result *result)
+{
+	struct l_queue *notify_queue;
+	struct l_queue *dispatching = service->notify_queue;
+
+	notify_queue = l_hashmap_lookup(service->notify_map,
+					L_UINT_TO_PTR(result->message));
+	if (!notify_queue)
+		return;
+
+	/* Callbacks may unregister, entries are only freed afterwards */
+	service->notify_queue = notify_queue;
+	l_queue_foreach(notify_queue, service_notify_callback, result);
+	service->notify_queue = dispatching;
+
+	if (notify_queue == dispatching)
+		return;
+
+	l_queue_foreach_remove(notify_queue, service_notify_sweep, service);
+}
+
+struct service_broadcast_data {
+	uint16_t service_type;
+	struct qmi_result *result;
+};
+
+static void service_notify_broadcast(const void *key, void *value,
+					void *user_data)
+{
+	struct service_broadcast_data *data = user_data;
+	unsigned int hash_id = L_PTR_TO_UINT(key);
 
 	/* ignore those that are in process of creation */
-	if (L_PTR_TO_UINT(key) & 0x80000000)
+	if (hash_id & 0x80000000)
 		return;
 
-	l_queue_foreach(service->notify_list, service_notify_if_message_matches,
-				result);
+	if ((hash_id & 0xffff) != data->service_type)
+		return;
+
+	service_notify(value, data->result);
 }
 
 static unsigned int service_list_create_hash(uint16_t service_type,
@@ -791,15 +914,16 @@ static void handle_indication(struct qmi_device *device,
 	if (service_type == QMI_SERVICE_CONTROL)
 		return;
 
-	result.result = 0;
-	result.error = 0;
-	result.message = message;
-	result.data = data;
-	result.length = length;
+	qmi_result_init(&result, message, data, length);
 
 	if (client_id == 0xff) {
-		l_hashmap_foreach(device->service_list, service_notify,
-					&result);
+		struct service_broadcast_data broadcast = {
+			.service_type = service_type,
+			.result = &result,
+		};
+
+		l_hashmap_foreach(device->service_list,
+					service_notify_broadcast, &broadcast);
 		return;
 	}
 
@@ -810,7 +934,7 @@ static void handle_indication(struct qmi_device *device,
 	if (!service)
 		return;
 
-	service_notify(NULL, service, &result);
+	service_notify(service, &result);
 }
 
 static void __rx_message(struct qmi_device *device,
@@ -835,8 +959,7 @@ static void __rx_message(struct qmi_device *device,
 		return;
 	}
 
-	req = l_queue_remove_if(device->service_queue, __request_compare,
-						L_UINT_TO_PTR(tid));
+	req = l_hashmap_remove(device->service_requests, L_UINT_TO_PTR(tid));
 	if (!req)
 		return;
 
@@ -905,7 +1028,7 @@ static int qmi_device_init(struct qmi_device *device, int fd,
 	l_io_set_close_on_destroy(device->io, true);
 
 	device->req_queue = l_queue_new();
-	device->service_queue = l_queue_new();
+	device->service_requests = l_hashmap_new();
 	device->discovery_queue = l_queue_new();
 	device->service_infos = l_queue_new();
 	device->service_list = l_hashmap_new();
@@ -930,7 +1053,7 @@ void qmi_device_free(struct qmi_device *device)
 
 	__debug_device(device, "device %p free", device);
 
-	l_queue_destroy(device->service_queue, __request_free);
+	l_hashmap_destroy(device->service_requests, __request_free);
 	l_queue_destroy(device->req_queue, __request_free);
 	l_queue_destroy(device->discovery_queue, __discovery_free);
 
@@ -982,6 +1105,9 @@ static const void *tlv_get(const void *data, uint16_t size,
 		const struct qmi_tlv_hdr *tlv = ptr;
 		uint16_t tlv_length = L_LE16_TO_CPU(tlv->length);
 
+		if (tlv_length > len - QMI_TLV_HDR_SIZE)
+			break;
+
 		if (tlv->type == type) {
 			if (length)
 				*length = tlv_length;
@@ -1301,7 +1427,8 @@ static int qmi_device_qmux_write(struct qmi_device *device,
 	if (hdr->service == QMI_SERVICE_CONTROL)
 		l_queue_push_tail(qmux->control_queue, req);
 	else
-		l_queue_push_tail(device->service_queue, req);
+		l_hashmap_insert(device->service_requests,
+					L_UINT_TO_PTR(req->tid), req);
 
 	return 0;
 }
@@ -1343,47 +1470,46 @@ static void __rx_ctl_message(struct qmi_device_qmux *qmux,
 	__request_free(req);
 }
 
-static bool received_qmux_data(struct l_io *io, void *user_data)
+/*
+ * Dispatches all complete frames held in the receive buffer and moves a
+ * trailing partial frame to the start.  The buffer grows to fit the
+ * largest frame seen so far.
+ */
+static void qmux_dispatch_frames(struct qmi_device_qmux *qmux)
 {
-	struct qmi_device_qmux *qmux = user_data;
-	struct qmi_mux_hdr *hdr;
-	unsigned char buf[2048];
-	ssize_t bytes_read;
-	uint16_t offset;
-
-	bytes_read = read(l_io_get_fd(qmux->super.io), buf, sizeof(buf));
-	if (bytes_read < 0)
-		return true;
-
-	l_util_hexdump(true, buf, bytes_read,
-			qmux->super.debug_func, qmux->super.debug_data);
+	size_t offset = 0;
+	size_t needed = 0;
 
-	offset = 0;
-
-	while (offset < bytes_read) {
-		uint16_t len;
+	while (qmux->rx_len - offset >= QMI_MUX_HDR_SIZE) {
+		const struct qmi_mux_hdr *hdr = (void *) qmux->rx_buf + offset;
 		const void *msg;
+		size_t len;
 
-		/* Check if QMI mux header fits into packet */
-		if (bytes_read - offset < QMI_MUX_HDR_SIZE)
-			break;
-
-		hdr = (void *) (buf + offset);
+		len = L_LE16_TO_CPU(hdr->length) + 1;
 
-		/* Check for fixed frame and flags value */
-		if (hdr->frame != 0x01 || hdr->flags != 0x80)
+		/*
+		 * Check for fixed frame and flags value, and drop anything
+		 * buffered if they don't match as there is no telling
+		 * where the next frame starts
+		 */
+		if (hdr->frame != 0x01 || hdr->flags != 0x80 ||
+				len < QMI_MUX_HDR_SIZE) {
+			DBG("Dropping %zu bytes of garbage",
+					qmux->rx_len - offset);
+			offset = qmux->rx_len;
 			break;
+		}
 
-		len = L_LE16_TO_CPU(hdr->length) + 1;
-
-		/* Check that packet size matches frame size */
-		if (bytes_read - offset < len)
+		/* Wait for the rest of the frame */
+		if (qmux->rx_len - offset < len) {
+			needed = len;
 			break;
+		}
 
-		__qmux_debug_msg(' ', buf + offset, len,
+		__qmux_debug_msg(' ', hdr, len,
 				qmux->super.debug_func, qmux->super.debug_data);
 
-		msg = buf + offset + QMI_MUX_HDR_SIZE;
+		msg = (void *) hdr + QMI_MUX_HDR_SIZE;
 
 		if (hdr->service == QMI_SERVICE_CONTROL)
 			__rx_ctl_message(qmux, hdr->service, hdr->client, msg);
@@ -1394,6 +1520,39 @@ static bool received_qmux_data(struct l_io *io, void *user_data)
 		offset += len;
 	}
 
+	if (offset) {
+		qmux->rx_len -= offset;
+		memmove(qmux->rx_buf, qmux->rx_buf + offset, qmux->rx_len);
+	}
+
+	if (needed > qmux->rx_size) {
+		qmux->rx_buf = l_realloc(qmux->rx_buf, needed);
+		qmux->rx_size = needed;
+	}
+}
+
+static bool received_qmux_data(struct l_io *io, void *user_data)
+{
+	struct qmi_device_qmux *qmux = user_data;
+	int fd = l_io_get_fd(qmux->super.io);
+	ssize_t bytes_read;
+	int i;
+
+	/* Drain what is pending, but don't starve everybody else */
+	for (i = 0; i < QMUX_MAX_READS; i++) {
+		bytes_read = read(fd, qmux->rx_buf + qmux->rx_len,
+					qmux->rx_size - qmux->rx_len);
+		if (bytes_read <= 0)
+			break;
+
+		l_util_hexdump(true, qmux->rx_buf + qmux->rx_len, bytes_read,
+				qmux->super.debug_func, qmux->super.debug_data);
+
+		qmux->rx_len += bytes_read;
+
+		qmux_dispatch_frames(qmux);
+	}
+
 	return true;
 }
 
@@ -1436,6 +1595,7 @@ static struct qmi_service *service_create(struct qmi_device *device,
 	service->device = device;
 	service->client_id = client_id;
 	service->notify_list = l_queue_new();
+	service->notify_map = l_hashmap_new();
 
 	if (device->next_group_id == 0) /* 0 is reserved for control */
 		device->next_group_id = 1;
@@ -1909,6 +2069,7 @@ static void qmi_device_qmux_destroy(struct qmi_device *device)
 	if (qmux->shutdown_idle)
 		l_idle_remove(qmux->shutdown_idle);
 
+	l_free(qmux->rx_buf);
 	l_free(qmux->version_str);
 	l_free(qmux);
 }
@@ -1922,30 +2083,46 @@ static const struct qmi_device_ops qmux_ops = {
 	.destroy = qmi_device_qmux_destroy,
 };
 
-struct qmi_device *qmi_device_new_qmux(const char *device)
+/*
+ * Takes over an already open QMUX channel, the fd is closed when the
+ * device is freed.  On failure it is left alone.
+ */
+struct qmi_device *qmi_device_new_qmux_fd(int fd)
 {
 	struct qmi_device_qmux *qmux;
-	int fd;
-
-	fd = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
-	if (fd < 0)
-		return NULL;
 
 	qmux = l_new(struct qmi_device_qmux, 1);
 
 	if (qmi_device_init(&qmux->super, fd, &qmux_ops) < 0) {
-		close(fd);
 		l_free(qmux);
 		return NULL;
 	}
 
 	qmux->next_control_tid = 1;
 	qmux->control_queue = l_queue_new();
+	qmux->rx_size = QMUX_RX_BUF_SIZE;
+	qmux->rx_buf = l_malloc(qmux->rx_size);
 	l_io_set_read_handler(qmux->super.io, received_qmux_data, qmux, NULL);
 
 	return &qmux->super;
 }
 
+struct qmi_device *qmi_device_new_qmux(const char *device)
+{
+	struct qmi_device *qmux;
+	int fd;
+
+	fd = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	qmux = qmi_device_new_qmux_fd(fd);
+	if (!qmux)
+		close(fd);
+
+	return qmux;
+}
+
 struct qmi_device_qrtr {
 	struct qmi_device super;
 	qmi_shutdown_func_t shutdown_func;
@@ -1986,7 +2163,8 @@ static int qmi_device_qrtr_write(struct qmi_device *device,
 			req->info.service_type, device->debug_func,
 			device->debug_data);
 
-	l_queue_push_tail(device->service_queue, req);
+	l_hashmap_insert(device->service_requests,
+				L_UINT_TO_PTR(req->tid), req);
 
 	return 0;
 }
@@ -2413,7 +2591,7 @@ const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return qmi_result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -2424,7 +2602,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = qmi_result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -2440,7 +2618,7 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = qmi_result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2459,7 +2637,7 @@ bool qmi_result_get_int16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = qmi_result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2480,7 +2658,7 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = qmi_result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2502,7 +2680,7 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = qmi_result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2524,7 +2702,7 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = qmi_result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2731,11 +2909,9 @@ static void service_send_callback(uint16_t message, uint16_t length,
 	uint16_t len;
 	struct qmi_result result;
 
-	result.message = message;
-	result.data = buffer;
-	result.length = length;
+	qmi_result_init(&result, message, buffer, length);
 
-	result_code = tlv_get(buffer, length, 0x02, &len);
+	result_code = qmi_result_tlv_get(&result, 0x02, &len);
 	if (!result_code)
 		goto done;
 
@@ -2810,8 +2986,7 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	req = l_queue_remove_if(device->req_queue, __request_compare,
 					L_UINT_TO_PTR(tid));
 	if (!req) {
-		req = l_queue_remove_if(device->service_queue,
-						__request_compare,
+		req = l_hashmap_remove(device->service_requests,
 						L_UINT_TO_PTR(tid));
 		if (!req)
 			return false;
@@ -2838,10 +3013,19 @@ static bool remove_req_if_match(void *data, void *user_data)
 	return true;
 }
 
-static void remove_client(struct l_queue *queue, unsigned int group_id)
+static bool remove_sent_req_if_match(const void *key, void *value,
+					void *user_data)
 {
-	l_queue_foreach_remove(queue, remove_req_if_match,
+	return remove_req_if_match(value, user_data);
+}
+
+static void remove_client(struct qmi_device *device, unsigned int group_id)
+{
+	l_queue_foreach_remove(device->req_queue, remove_req_if_match,
 				L_UINT_TO_PTR(group_id));
+	l_hashmap_foreach_remove(device->service_requests,
+					remove_sent_req_if_match,
+					L_UINT_TO_PTR(group_id));
 }
 
 bool qmi_service_cancel_all(struct qmi_service *service)
@@ -2858,8 +3042,7 @@ bool qmi_service_cancel_all(struct qmi_service *service)
 	if (!device)
 		return false;
 
-	remove_client(device->req_queue, service->group_id);
-	remove_client(device->service_queue, service->group_id);
+	remove_client(device, service->group_id);
 
 	return true;
 }
@@ -2869,6 +3052,7 @@ uint16_t qmi_service_register(struct qmi_service *service,
 				void *user_data, qmi_destroy_func_t destroy)
 {
 	struct qmi_notify *notify;
+	struct l_queue *notify_queue;
 
 	if (!service || !func)
 		return 0;
@@ -2886,6 +3070,16 @@ uint16_t qmi_service_register(struct qmi_service *service,
 
 	l_queue_push_tail(service->notify_list, notify);
 
+	notify_queue = l_hashmap_lookup(service->notify_map,
+					L_UINT_TO_PTR(message));
+	if (!notify_queue) {
+		notify_queue = l_queue_new();
+		l_hashmap_insert(service->notify_map, L_UINT_TO_PTR(message),
+					notify_queue);
+	}
+
+	l_queue_push_tail(notify_queue, notify);
+
 	return notify->id;
 }
 
@@ -2893,16 +3087,33 @@ bool qmi_service_unregister(struct qmi_service *service, uint16_t id)
 {
 	unsigned int nid = id;
 	struct qmi_notify *notify;
+	struct l_queue *notify_queue;
 
 	if (!service || !id)
 		return false;
 
-	notify = l_queue_remove_if(service->notify_list, __notify_compare,
+	notify = l_queue_find(service->notify_list, __notify_compare,
 					L_UINT_TO_PTR(nid));
-
 	if (!notify)
 		return false;
 
+	notify_queue = l_hashmap_lookup(service->notify_map,
+					L_UINT_TO_PTR(notify->message));
+
+	/*
+	 * The queue being dispatched by service_notify() is still walked
+	 * after this returns, so only mark the entry there and let
+	 * service_notify() free it.
+	 */
+	if (notify_queue && notify_queue == service->notify_queue) {
+		notify->destroyed = true;
+		return true;
+	}
+
+	/* Empty queues are kept rather than removed from the map */
+	l_queue_remove(service->notify_list, notify);
+	l_queue_remove(notify_queue, notify);
+
 	__notify_free(notify);
 
 	return true;
@@ -2913,6 +3124,9 @@ bool qmi_service_unregister_all(struct qmi_service *service)
 	if (!service)
 		return false;
 
+	l_hashmap_destroy(service->notify_map, __notify_queue_free);
+	service->notify_map = NULL;
+
 	l_queue_destroy(service->notify_list, __notify_free);
 	service->notify_list = NULL;
 
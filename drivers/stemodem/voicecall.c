@@ -560,6 +560,7 @@ static int ste_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 		return -ENOMEM;
 
 	vd->chat = g_at_chat_clone(chat);
+	g_at_chat_set_priority(vd->chat, G_AT_CHAT_PRIORITY_HIGH);
 
 	ofono_voicecall_set_data(vc, vd);
 
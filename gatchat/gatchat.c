@@ -41,6 +41,10 @@
 #define COMMAND_FLAG_EXPECT_PDU			0x1
 #define COMMAND_FLAG_EXPECT_SHORT_PROMPT	0x2
 
+#define LINE_BUF_SIZE		256
+#define RESPONSE_BUF_SIZE	1024
+#define RESPONSE_MAX_LINES	16
+
 struct at_chat;
 static void chat_wakeup_writer(struct at_chat *chat);
 
@@ -52,6 +56,7 @@ struct at_command {
 	guint flags;
 	guint id;
 	guint gid;
+	GAtChatPriority priority;
 	GAtResultFunc callback;
 	GAtNotifyFunc listing;
 	gpointer user_data;
@@ -71,8 +76,10 @@ typedef gboolean (*node_remove_func)(struct at_notify_node *node,
 					gpointer user_data);
 
 struct at_notify {
+	const char *prefix;
 	GSList *nodes;
 	gboolean pdu;
+	gboolean indexed;
 };
 
 struct at_chat {
@@ -84,6 +91,7 @@ struct at_chat {
 	GQueue *command_queue;			/* Command queue */
 	guint cmd_bytes_written;		/* bytes written from cmd */
 	GHashTable *notify_list;		/* List of notification reg */
+	GSList *notify_other;			/* Non-indexed notifications */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	guint read_so_far;			/* Number of bytes processed */
@@ -91,7 +99,9 @@ struct at_chat {
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
 	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
-	GSList *response_lines;			/* char * lines of the response */
+	GString *response_buf;			/* Lines of the response */
+	GArray *response_lines;			/* Line offsets in response_buf */
+	GString *line_buf;			/* Line being processed */
 	char *wakeup;				/* command sent to wakeup modem */
 	gint timeout_source;
 	gdouble inactivity_time;		/* Period of inactivity */
@@ -109,6 +119,7 @@ struct _GAtChat {
 	gint ref_count;
 	struct at_chat *parent;
 	guint group;
+	GAtChatPriority priority;
 	GAtChat *slave;
 };
 
@@ -170,6 +181,15 @@ static gint at_command_compare_by_id(gconstpointer a, gconstpointer b)
 	return 0;
 }
 
+static void at_chat_remove_notify(struct at_chat *chat, GHashTableIter *iter,
+					struct at_notify *notify)
+{
+	if (!notify->indexed)
+		chat->notify_other = g_slist_remove(chat->notify_other, notify);
+
+	g_hash_table_iter_remove(iter);
+}
+
 static gboolean at_chat_unregister_all(struct at_chat *chat,
 					gboolean mark_only,
 					node_remove_func func,
@@ -223,7 +243,7 @@ static gboolean at_chat_unregister_all(struct at_chat *chat,
 		}
 
 		if (notify->nodes == NULL)
-			g_hash_table_iter_remove(&iter);
+			at_chat_remove_notify(chat, &iter, notify);
 	}
 
 	return TRUE;
@@ -328,12 +348,25 @@ static void chat_cleanup(struct at_chat *chat)
 	}
 
 	/* Cleanup any response lines we have pending */
+	if (chat->response_buf) {
+		g_string_free(chat->response_buf, TRUE);
+		chat->response_buf = NULL;
+	}
+
 	if (chat->response_lines) {
-		g_slist_free_full(chat->response_lines, g_free);
+		g_array_free(chat->response_lines, TRUE);
 		chat->response_lines = NULL;
 	}
 
+	if (chat->line_buf) {
+		g_string_free(chat->line_buf, TRUE);
+		chat->line_buf = NULL;
+	}
+
 	/* Cleanup registered notifications */
+	g_slist_free(chat->notify_other);
+	chat->notify_other = NULL;
+
 	if (chat->notify_list) {
 		g_hash_table_destroy(chat->notify_list);
 		chat->notify_list = NULL;
@@ -388,28 +421,97 @@ static void at_notify_call_callback(gpointer data, gpointer user_data)
 	node->callback(result, node->user_data);
 }
 
+/*
+ * Most unsolicited results are registered with a prefix of the form
+ * "+CREG:".  Such prefixes match a line exactly when they are equal to the
+ * line up to and including its first ':', so they are looked up directly
+ * in notify_list.  Only the remaining prefixes need to be scanned.
+ */
+static gboolean notify_prefix_is_indexed(const char *prefix)
+{
+	const char *colon = strchr(prefix, ':');
+
+	return colon != NULL && colon[1] == '\0';
+}
+
+static struct at_notify *at_chat_find_indexed_notify(struct at_chat *chat,
+							char *line)
+{
+	struct at_notify *notify;
+	char *colon;
+	char c;
+
+	colon = strchr(line, ':');
+	if (colon == NULL)
+		return NULL;
+
+	c = colon[1];
+	colon[1] = '\0';
+	notify = g_hash_table_lookup(chat->notify_list, line);
+	colon[1] = c;
+
+	return notify;
+}
+
+static struct at_notify *at_chat_next_other_notify(const char *line,
+							GSList **other)
+{
+	GSList *l;
+
+	for (l = *other; l; l = l->next) {
+		struct at_notify *notify = l->data;
+
+		if (g_str_has_prefix(line, notify->prefix)) {
+			*other = l->next;
+			return notify;
+		}
+	}
+
+	*other = NULL;
+
+	return NULL;
+}
+
+static void at_chat_alloc_response(struct at_chat *p)
+{
+	if (p->response_buf)
+		return;
+
+	p->response_buf = g_string_sized_new(RESPONSE_BUF_SIZE);
+	p->response_lines = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+							RESPONSE_MAX_LINES);
+}
+
+/* Result made of a single line, for listings and notifications */
+static void at_result_init_line(GAtResult *result, char *line,
+							char *final_or_pdu)
+{
+	static const guint offset = 0;
+
+	result->buf = line;
+	result->offsets = &offset;
+	result->n_lines = 1;
+	result->final_or_pdu = final_or_pdu;
+}
+
 static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 {
-	GHashTableIter iter;
 	struct at_notify *notify;
-	gpointer key, value;
+	GSList *other = chat->notify_other;
 	gboolean ret = FALSE;
 	GAtResult result;
 
-	g_hash_table_iter_init(&iter, chat->notify_list);
-	result.lines = 0;
-	result.final_or_pdu = 0;
+	at_result_init_line(&result, line, NULL);
 
 	chat->in_notify = TRUE;
 
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		notify = value;
-
-		if (!g_str_has_prefix(line, key))
-			continue;
+	notify = at_chat_find_indexed_notify(chat, line);
+	if (notify == NULL)
+		notify = at_chat_next_other_notify(line, &other);
 
+	for (; notify; notify = at_chat_next_other_notify(line, &other)) {
 		if (notify->pdu) {
-			chat->pdu_notify = line;
+			chat->pdu_notify = g_strdup(line);
 
 			if (chat->syntax->set_hint)
 				chat->syntax->set_hint(chat->syntax,
@@ -417,9 +519,6 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 			return TRUE;
 		}
 
-		if (result.lines == NULL)
-			result.lines = g_slist_prepend(NULL, line);
-
 		g_slist_foreach(notify->nodes, at_notify_call_callback,
 					&result);
 		ret = TRUE;
@@ -427,12 +526,8 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 
 	chat->in_notify = FALSE;
 
-	if (ret) {
-		g_slist_free(result.lines);
-		g_free(line);
-
+	if (ret)
 		at_chat_unregister_all(chat, FALSE, node_is_destroyed, NULL);
-	}
 
 	return ret;
 }
@@ -440,7 +535,8 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 {
 	struct at_command *cmd = g_queue_pop_head(p->command_queue);
-	GSList *response_lines;
+	GString *response_buf;
+	GArray *response_lines;
 
 	/* Cannot happen, but lets be paranoid */
 	if (cmd == NULL)
@@ -451,21 +547,40 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 	if (g_queue_peek_head(p->command_queue))
 		chat_wakeup_writer(p);
 
+	/*
+	 * The callback might cause new responses to be read, so detach the
+	 * storage of this response for the duration of the callback.
+	 */
+	at_chat_alloc_response(p);
+
+	response_buf = p->response_buf;
+	p->response_buf = NULL;
+
 	response_lines = p->response_lines;
 	p->response_lines = NULL;
 
 	if (cmd->callback) {
 		GAtResult result;
 
-		response_lines = g_slist_reverse(response_lines);
-
+		result.buf = response_buf->str;
+		result.offsets = (const guint *) response_lines->data;
+		result.n_lines = response_lines->len;
 		result.final_or_pdu = final;
-		result.lines = response_lines;
 
 		cmd->callback(ok, &result, cmd->user_data);
 	}
 
-	g_slist_free_full(response_lines, g_free);
+	/* Empty the buffers and keep them for the next response */
+	if (p->response_buf == NULL) {
+		g_string_truncate(response_buf, 0);
+		g_array_set_size(response_lines, 0);
+
+		p->response_buf = response_buf;
+		p->response_lines = response_lines;
+	} else {
+		g_string_free(response_buf, TRUE);
+		g_array_free(response_lines, TRUE);
+	}
 
 	g_free(final);
 	at_command_destroy(cmd);
@@ -518,13 +633,15 @@ static gboolean at_chat_handle_command_response(struct at_chat *p,
 	int i;
 	int size = sizeof(terminator_table) / sizeof(struct terminator_info);
 	int hint;
+	guint offset;
 	GSList *l;
 
 	for (i = 0; i < size; i++) {
 		struct terminator_info *info = &terminator_table[i];
 		if (check_terminator(info, line) &&
 				(p->terminator_blacklist & 1 << i) == 0) {
-			at_chat_finish_command(p, info->success, line);
+			at_chat_finish_command(p, info->success,
+							g_strdup(line));
 			return TRUE;
 		}
 	}
@@ -532,7 +649,8 @@ static gboolean at_chat_handle_command_response(struct at_chat *p,
 	for (l = p->terminator_list; l; l = l->next) {
 		struct terminator_info *info = l->data;
 		if (check_terminator(info, line)) {
-			at_chat_finish_command(p, info->success, line);
+			at_chat_finish_command(p, info->success,
+							g_strdup(line));
 			return TRUE;
 		}
 	}
@@ -557,22 +675,30 @@ out:
 		p->syntax->set_hint(p->syntax, hint);
 
 	if (cmd->listing && (cmd->flags & COMMAND_FLAG_EXPECT_PDU)) {
-		p->pdu_notify = line;
+		p->pdu_notify = g_strdup(line);
 		return TRUE;
 	}
 
 	if (cmd->listing) {
 		GAtResult result;
 
-		result.lines = g_slist_prepend(NULL, line);
-		result.final_or_pdu = NULL;
+		at_result_init_line(&result, line, NULL);
 
 		cmd->listing(&result, cmd->user_data);
 
-		g_slist_free(result.lines);
-		g_free(line);
-	} else
-		p->response_lines = g_slist_prepend(p->response_lines, line);
+		return TRUE;
+	}
+
+	/*
+	 * Intermediate response lines live until the final response.  They
+	 * are appended to a buffer which is emptied, but not freed, once the
+	 * final response has been delivered.
+	 */
+	at_chat_alloc_response(p);
+
+	offset = p->response_buf->len;
+	g_string_append_len(p->response_buf, line, strlen(line) + 1);
+	g_array_append_val(p->response_lines, offset);
 
 	return TRUE;
 }
@@ -582,12 +708,9 @@ static void have_line(struct at_chat *p, char *str)
 	/* We're not going to copy terminal <CR><LF> */
 	struct at_command *cmd;
 
-	if (str == NULL)
-		return;
-
 	/* Check for echo, this should not happen, but lets be paranoid */
 	if (!strncmp(str, "AT", 2))
-		goto done;
+		return;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
@@ -607,33 +730,24 @@ static void have_line(struct at_chat *p, char *str)
 			return;
 	}
 
-	if (at_chat_match_notify(p, str) == TRUE)
-		return;
-
-done:
 	/* No matches & no commands active, ignore line */
-	g_free(str);
+	at_chat_match_notify(p, str);
 }
 
 static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
 {
-	GHashTableIter iter;
 	struct at_notify *notify;
-	char *prefix;
-	gpointer key, value;
+	GSList *other = p->notify_other;
 	gboolean called = FALSE;
 
 	p->in_notify = TRUE;
 
-	g_hash_table_iter_init(&iter, p->notify_list);
-
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		prefix = key;
-		notify = value;
-
-		if (!g_str_has_prefix(p->pdu_notify, prefix))
-			continue;
+	notify = at_chat_find_indexed_notify(p, p->pdu_notify);
+	if (notify == NULL)
+		notify = at_chat_next_other_notify(p->pdu_notify, &other);
 
+	for (; notify; notify = at_chat_next_other_notify(p->pdu_notify,
+								&other)) {
 		if (!notify->pdu)
 			continue;
 
@@ -653,11 +767,7 @@ static void have_pdu(struct at_chat *p, char *pdu)
 	GAtResult result;
 	gboolean listing_pdu = FALSE;
 
-	if (pdu == NULL)
-		goto error;
-
-	result.lines = g_slist_prepend(NULL, p->pdu_notify);
-	result.final_or_pdu = pdu;
+	at_result_init_line(&result, p->pdu_notify, pdu);
 
 	cmd = g_queue_peek_head(p->command_queue);
 
@@ -678,14 +788,8 @@ static void have_pdu(struct at_chat *p, char *pdu)
 	} else
 		have_notify_pdu(p, pdu, &result);
 
-	g_slist_free(result.lines);
-
-error:
 	g_free(p->pdu_notify);
 	p->pdu_notify = NULL;
-
-	if (pdu)
-		g_free(pdu);
 }
 
 static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
@@ -718,18 +822,14 @@ static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
 			buf = ring_buffer_read_ptr(rbuf, pos);
 	}
 
-	line = g_try_new(char, line_length + 1);
-	if (line == NULL) {
-		ring_buffer_drain(rbuf, p->read_so_far);
-		return NULL;
-	}
+	/* The line is only valid until the next one is extracted */
+	g_string_set_size(p->line_buf, line_length);
+	line = p->line_buf->str;
 
 	ring_buffer_drain(rbuf, strip_front);
 	ring_buffer_read(rbuf, line, line_length);
 	ring_buffer_drain(rbuf, p->read_so_far - strip_front - line_length);
 
-	line[line_length] = '\0';
-
 	return line;
 }
 
@@ -1037,7 +1137,31 @@ static gboolean at_chat_set_wakeup_command(struct at_chat *chat,
 	return TRUE;
 }
 
+/*
+ * Commands are queued behind all commands of the same or higher priority.
+ * The head of the queue is never overtaken since it might already be in
+ * progress.
+ */
+static void at_chat_queue_command(struct at_chat *chat, struct at_command *c)
+{
+	GQueue *queue = chat->command_queue;
+	GList *l;
+
+	for (l = queue->tail; l != queue->head; l = l->prev) {
+		struct at_command *cmd = l->data;
+
+		if (cmd->priority >= c->priority)
+			break;
+	}
+
+	if (l == NULL)
+		g_queue_push_tail(queue, c);
+	else
+		g_queue_insert_after(queue, l, c);
+}
+
 static guint at_chat_send_common(struct at_chat *chat, guint gid,
+					GAtChatPriority priority,
 					const char *cmd,
 					const char **prefix_list,
 					guint flags,
@@ -1057,8 +1181,9 @@ static guint at_chat_send_common(struct at_chat *chat, guint gid,
 		return 0;
 
 	c->id = chat->next_cmd_id++;
+	c->priority = priority;
 
-	g_queue_push_tail(chat->command_queue, c);
+	at_chat_queue_command(chat, c);
 
 	if (g_queue_get_length(chat->command_queue) == 1)
 		chat_wakeup_writer(chat);
@@ -1106,10 +1231,15 @@ static struct at_notify *at_notify_create(struct at_chat *chat,
 		return 0;
 	}
 
+	notify->prefix = key;
 	notify->pdu = pdu;
+	notify->indexed = notify_prefix_is_indexed(key);
 
 	g_hash_table_insert(chat->notify_list, key, notify);
 
+	if (!notify->indexed)
+		chat->notify_other = g_slist_append(chat->notify_other, notify);
+
 	return notify;
 }
 
@@ -1274,7 +1404,7 @@ static gboolean at_chat_unregister(struct at_chat *chat, gboolean mark_only,
 		notify->nodes = g_slist_remove(notify->nodes, node);
 
 		if (notify->nodes == NULL)
-			g_hash_table_iter_remove(&iter);
+			at_chat_remove_notify(chat, &iter, notify);
 
 		return TRUE;
 	}
@@ -1330,6 +1460,8 @@ static struct at_chat *create_chat(GIOChannel *channel, GIOFlags flags,
 	chat->notify_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 						g_free, at_notify_destroy);
 
+	chat->line_buf = g_string_sized_new(LINE_BUF_SIZE);
+
 	g_at_io_set_read_handler(chat->io, new_bytes, chat);
 
 	chat->syntax = g_at_syntax_ref(syntax);
@@ -1393,6 +1525,7 @@ GAtChat *g_at_chat_clone(GAtChat *clone)
 
 	chat->parent = at_chat_ref(clone->parent);
 	chat->group = chat->parent->next_gid++;
+	chat->priority = clone->priority;
 	chat->ref_count = 1;
 
 	if (clone->slave != NULL)
@@ -1425,6 +1558,14 @@ GAtChat *g_at_chat_get_slave(GAtChat *chat)
 	return chat->slave;
 }
 
+void g_at_chat_set_priority(GAtChat *chat, GAtChatPriority priority)
+{
+	if (chat == NULL)
+		return;
+
+	chat->priority = priority;
+}
+
 GIOChannel *g_at_chat_get_channel(GAtChat *chat)
 {
 	if (chat == NULL || chat->parent->io == NULL)
@@ -1540,7 +1681,7 @@ guint g_at_chat_send(GAtChat *chat, const char *cmd,
 			const char **prefix_list, GAtResultFunc func,
 			gpointer user_data, GDestroyNotify notify)
 {
-	return at_chat_send_common(chat->parent, chat->group,
+	return at_chat_send_common(chat->parent, chat->group, chat->priority,
 					cmd, prefix_list, 0, NULL,
 					func, user_data, notify);
 }
@@ -1553,7 +1694,7 @@ guint g_at_chat_send_listing(GAtChat *chat, const char *cmd,
 	if (listing == NULL)
 		return 0;
 
-	return at_chat_send_common(chat->parent, chat->group,
+	return at_chat_send_common(chat->parent, chat->group, chat->priority,
 					cmd, prefix_list, 0,
 					listing, func, user_data, notify);
 }
@@ -1566,7 +1707,7 @@ guint g_at_chat_send_pdu_listing(GAtChat *chat, const char *cmd,
 	if (listing == NULL)
 		return 0;
 
-	return at_chat_send_common(chat->parent, chat->group,
+	return at_chat_send_common(chat->parent, chat->group, chat->priority,
 					cmd, prefix_list,
 					COMMAND_FLAG_EXPECT_PDU,
 					listing, func, user_data, notify);
@@ -1578,7 +1719,7 @@ guint g_at_chat_send_and_expect_short_prompt(GAtChat *chat, const char *cmd,
 						gpointer user_data,
 						GDestroyNotify notify)
 {
-	return at_chat_send_common(chat->parent, chat->group,
+	return at_chat_send_common(chat->parent, chat->group, chat->priority,
 					cmd, prefix_list,
 					COMMAND_FLAG_EXPECT_SHORT_PROMPT,
 					NULL, func, user_data, notify);
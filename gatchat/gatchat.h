@@ -54,6 +54,14 @@ enum _GAtChatTerminator {
 
 typedef enum _GAtChatTerminator GAtChatTerminator;
 
+enum _GAtChatPriority {
+	G_AT_CHAT_PRIORITY_LOW = -1,	/* Bulk reads, e.g. phonebook */
+	G_AT_CHAT_PRIORITY_DEFAULT = 0,
+	G_AT_CHAT_PRIORITY_HIGH = 1,	/* Call control */
+};
+
+typedef enum _GAtChatPriority GAtChatPriority;
+
 GAtChat *g_at_chat_new(GIOChannel *channel, GAtSyntax *syntax);
 GAtChat *g_at_chat_new_blocking(GIOChannel *channel, GAtSyntax *syntax);
 
@@ -68,6 +76,14 @@ GAtChat *g_at_chat_clone(GAtChat *chat);
 GAtChat *g_at_chat_set_slave(GAtChat *chat, GAtChat *slave);
 GAtChat *g_at_chat_get_slave(GAtChat *chat);
 
+/*!
+ * Sets the priority of commands sent through this chat from now on.  Queued
+ * commands of a higher priority are written to the modem before those of a
+ * lower one, commands of equal priority are kept in order.  Clones inherit
+ * the priority of the chat they were created from.
+ */
+void g_at_chat_set_priority(GAtChat *chat, GAtChatPriority priority);
+
 void g_at_chat_suspend(GAtChat *chat);
 void g_at_chat_resume(GAtChat *chat);
 
@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 
@@ -49,10 +50,10 @@
 #define HDLC_INITFCS	0xffff	/* Initial FCS value */
 #define HDLC_GOODFCS	0xf0b8	/* Good final FCS value */
 
-#define HDLC_FCS(fcs, c) crc_ccitt_byte(fcs, c)
-
 #define GUARD_TIMEOUT	1000	/* Pause time before and after '+++' sequence */
 
+#define IS_SPECIAL(map, c) (map[(c) >> 5] & (1 << ((c) & 0x1f)))
+
 struct _GAtHDLC {
 	gint ref_count;
 	GAtIO *io;
@@ -61,8 +62,10 @@ struct _GAtHDLC {
 	guint decode_offset;
 	guint16 decode_fcs;
 	gboolean decode_escape;
+	gboolean decode_overflow;
 	guint32 xmit_accm[8];
 	guint32 recv_accm;
+	guint32 recv_special[8];	/* Bytes that end a run of plain data */
 	GAtReceiveFunc receive_func;
 	gpointer receive_data;
 	GAtDebugFunc debugf;
@@ -143,12 +146,23 @@ void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename)
 					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 }
 
+static void update_recv_special(GAtHDLC *hdlc)
+{
+	memset(hdlc->recv_special, 0, sizeof(hdlc->recv_special));
+
+	/* Control characters covered by the ACCM are silently dropped */
+	hdlc->recv_special[0] = hdlc->recv_accm;
+	hdlc->recv_special[HDLC_FLAG >> 5] |= 1 << (HDLC_FLAG & 0x1f);
+	hdlc->recv_special[HDLC_ESCAPE >> 5] |= 1 << (HDLC_ESCAPE & 0x1f);
+}
+
 void g_at_hdlc_set_recv_accm(GAtHDLC *hdlc, guint32 accm)
 {
 	if (hdlc == NULL)
 		return;
 
 	hdlc->recv_accm = accm;
+	update_recv_special(hdlc);
 }
 
 guint32 g_at_hdlc_get_recv_accm(GAtHDLC *hdlc)
@@ -242,36 +256,38 @@ static gboolean check_escape(GAtHDLC *hdlc, struct ring_buffer *rbuf)
 	return TRUE;
 }
 
-static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
+static inline void decode_append(GAtHDLC *hdlc, const unsigned char *data,
+							unsigned int len)
 {
-	GAtHDLC *hdlc = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
-	unsigned int pos = 0;
-
-	/*
-	 * We delete the the paused_timeout_cb or hdlc_suspend as soons as
-	 * we read a data.
-	 */
-	if (hdlc->suspend_source > 0) {
-		g_source_remove(hdlc->suspend_source);
-		hdlc->suspend_source = 0;
-		g_timer_start(hdlc->timer);
-	} else if (hdlc->timer) {
-		gboolean escaping = check_escape(hdlc, rbuf);
-
-		g_timer_start(hdlc->timer);
+	if (hdlc->decode_overflow)
+		return;
 
-		if (escaping)
-			return;
+	if (hdlc->decode_offset + len > BUFFER_SIZE) {
+		hdlc->decode_overflow = TRUE;
+		return;
 	}
 
-	hdlc_record(hdlc, TRUE, buf, wrap);
+	memcpy(hdlc->decode_buffer + hdlc->decode_offset, data, len);
+	hdlc->decode_offset += len;
+	hdlc->decode_fcs = crc_ccitt(hdlc->decode_fcs, data, len);
+}
 
-	hdlc->in_read_handler = TRUE;
+/*
+ * Decodes one contiguous chunk of the read buffer.  Runs of bytes which
+ * need no unescaping are copied and checksummed in one go, so only flags,
+ * escapes and ACCM mapped control characters take the slow path.
+ *
+ * Returns the number of bytes consumed, which is less than len if NO
+ * CARRIER was detected or the HDLC was destroyed by the receive callback.
+ */
+static unsigned int decode_chunk(GAtHDLC *hdlc, const unsigned char *buf,
+							unsigned int len)
+{
+	const unsigned char *p = buf;
+	const unsigned char *end = buf + len;
+	const unsigned char *run;
 
-	while (pos < len) {
+	while (p < end) {
 		/*
 		 * We try to detect NO CARRIER conditions here.  We
 		 * (ab) use the fact that a HDLC_FLAG must be followed
@@ -279,47 +295,90 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		 * ACFC is enabled.
 		 */
 		if (hdlc->no_carrier_detect &&
-				hdlc->decode_offset == 0 && *buf == '\r')
+				hdlc->decode_offset == 0 && *p == '\r')
 			break;
 
 		if (hdlc->decode_escape == TRUE) {
-			unsigned char val = *buf ^ HDLC_TRANS;
-
-			hdlc->decode_buffer[hdlc->decode_offset++] = val;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, val);
+			unsigned char val = *p++ ^ HDLC_TRANS;
 
+			decode_append(hdlc, &val, 1);
 			hdlc->decode_escape = FALSE;
-		} else if (*buf == HDLC_ESCAPE) {
+			continue;
+		}
+
+		for (run = p; run < end; run++)
+			if (IS_SPECIAL(hdlc->recv_special, *run))
+				break;
+
+		if (run > p) {
+			decode_append(hdlc, p, run - p);
+			p = run;
+			continue;
+		}
+
+		if (*p == HDLC_ESCAPE) {
 			hdlc->decode_escape = TRUE;
-		} else if (*buf == HDLC_FLAG) {
+		} else if (*p == HDLC_FLAG) {
 			if (hdlc->receive_func && hdlc->decode_offset > 2 &&
+					hdlc->decode_overflow == FALSE &&
 					hdlc->decode_fcs == HDLC_GOODFCS) {
 				hdlc->receive_func(hdlc->decode_buffer,
 							hdlc->decode_offset - 2,
 							hdlc->receive_data);
 
 				if (hdlc->destroyed)
-					goto out;
+					break;
 			}
 
 			hdlc->decode_fcs = HDLC_INITFCS;
 			hdlc->decode_offset = 0;
-		} else if (*buf >= 0x20 ||
-					(hdlc->recv_accm & (1 << *buf)) == 0) {
-			hdlc->decode_buffer[hdlc->decode_offset++] = *buf;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, *buf);
+			hdlc->decode_overflow = FALSE;
 		}
 
-		buf++;
-		pos++;
+		p++;
+	}
 
-		if (pos == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, pos);
-			hdlc_record(hdlc, TRUE, buf, len - wrap);
-		}
+	return p - buf;
+}
+
+static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
+{
+	GAtHDLC *hdlc = user_data;
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int pos;
+
+	/*
+	 * We delete the the paused_timeout_cb or hdlc_suspend as soons as
+	 * we read a data.
+	 */
+	if (hdlc->suspend_source > 0) {
+		g_source_remove(hdlc->suspend_source);
+		hdlc->suspend_source = 0;
+		g_timer_start(hdlc->timer);
+	} else if (hdlc->timer) {
+		gboolean escaping = check_escape(hdlc, rbuf);
+
+		g_timer_start(hdlc->timer);
+
+		if (escaping)
+			return;
+	}
+
+	hdlc_record(hdlc, TRUE, buf, wrap);
+
+	hdlc->in_read_handler = TRUE;
+
+	pos = decode_chunk(hdlc, buf, wrap);
+
+	if (pos == wrap && wrap < len && !hdlc->destroyed) {
+		buf = ring_buffer_read_ptr(rbuf, pos);
+		hdlc_record(hdlc, TRUE, buf, len - wrap);
+
+		pos += decode_chunk(hdlc, buf, len - wrap);
 	}
 
-out:
 	ring_buffer_drain(rbuf, pos);
 
 	hdlc->in_read_handler = FALSE;
@@ -348,6 +407,7 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	hdlc->xmit_accm[0] = ~0U;
 	hdlc->xmit_accm[3] = 0x60000000; /* 0x7d, 0x7e */
 	hdlc->recv_accm = ~0U;
+	update_recv_special(hdlc);
 
 	write_buffer = ring_buffer_new(BUFFER_SIZE);
 	if (!write_buffer)
@@ -470,32 +530,60 @@ void g_at_hdlc_set_receive(GAtHDLC *hdlc, GAtReceiveFunc func,
 static gboolean can_write_data(gpointer data)
 {
 	GAtHDLC *hdlc = data;
-	unsigned int len;
-	unsigned char *buf;
+	struct iovec iov[2 * (MAX_BUFFERS + 1)];
+	int iovcnt = 0;
 	gsize bytes_written;
+	gsize left;
 	struct ring_buffer* write_buffer;
+	GList *l;
+	int i;
 
-	/* Write data out from the head of the queue */
-	write_buffer = g_queue_peek_head(hdlc->write_queue);
+	/* Gather both halves of every queued buffer into one writev */
+	for (l = hdlc->write_queue->head; l; l = l->next) {
+		unsigned int len, wrap;
 
-	len = ring_buffer_len_no_wrap(write_buffer);
-	buf = ring_buffer_read_ptr(write_buffer, 0);
+		write_buffer = l->data;
+		len = ring_buffer_len(write_buffer);
+		wrap = ring_buffer_len_no_wrap(write_buffer);
 
-	bytes_written = g_at_io_write(hdlc->io, (gchar *) buf, len);
-	hdlc_record(hdlc, FALSE, buf, bytes_written);
-	ring_buffer_drain(write_buffer, bytes_written);
+		if (len == 0)
+			continue;
 
-	if (ring_buffer_len(write_buffer) > 0)
-		return TRUE;
+		iov[iovcnt].iov_base = ring_buffer_read_ptr(write_buffer, 0);
+		iov[iovcnt++].iov_len = wrap;
+
+		if (len == wrap)
+			continue;
+
+		iov[iovcnt].iov_base = ring_buffer_read_ptr(write_buffer, wrap);
+		iov[iovcnt++].iov_len = len - wrap;
+	}
+
+	if (iovcnt == 0)
+		return FALSE;
+
+	bytes_written = g_at_io_writev(hdlc->io, iov, iovcnt);
+
+	for (i = 0, left = bytes_written; i < iovcnt && left > 0; i++) {
+		gsize len = MIN(left, iov[i].iov_len);
+
+		hdlc_record(hdlc, FALSE, iov[i].iov_base, len);
+		left -= len;
+	}
 
-	/* All data in current buffer is written, free it
-	 * unless it's the last buffer in the queue.
+	/* Drain what was written, freeing all emptied buffers except the
+	 * last one in the queue.
 	 */
-	if ((ring_buffer_len(write_buffer) == 0) &&
-			(g_queue_get_length(hdlc->write_queue) > 1)) {
-		write_buffer = g_queue_pop_head(hdlc->write_queue);
-		ring_buffer_free(write_buffer);
+	while (TRUE) {
 		write_buffer = g_queue_peek_head(hdlc->write_queue);
+		bytes_written -= ring_buffer_drain(write_buffer, bytes_written);
+
+		if (ring_buffer_len(write_buffer) > 0 ||
+				g_queue_get_length(hdlc->write_queue) == 1)
+			break;
+
+		g_queue_pop_head(hdlc->write_queue);
+		ring_buffer_free(write_buffer);
 	}
 
 	if (ring_buffer_len(write_buffer) > 0)
@@ -528,7 +616,84 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc)
 	return hdlc->io;
 }
 
-#define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1 << (c & 0x1f))
+#define NEED_ESCAPE(xmit_accm, c) (xmit_accm[(c) >> 5] & (1 << ((c) & 0x1f)))
+
+/*
+ * Escapes as much of src as fits into the contiguous region dst.  Runs of
+ * bytes that need no escaping are copied in one go.  Returns the number
+ * of bytes written, the number of source bytes consumed is stored in
+ * consumed.
+ */
+static unsigned int escape_block(const guint32 *xmit_accm,
+					unsigned char *dst, unsigned int dst_len,
+					const unsigned char *src, unsigned int src_len,
+					unsigned int *consumed)
+{
+	unsigned int i = 0;
+	unsigned int o = 0;
+
+	while (i < src_len && o < dst_len) {
+		unsigned int limit = i + MIN(src_len - i, dst_len - o);
+		unsigned int run;
+
+		for (run = i; run < limit; run++)
+			if (NEED_ESCAPE(xmit_accm, src[run]))
+				break;
+
+		memcpy(dst + o, src + i, run - i);
+		o += run - i;
+		i = run;
+
+		if (i == limit || dst_len - o < 2)
+			break;
+
+		dst[o++] = HDLC_ESCAPE;
+		dst[o++] = src[i++] ^ HDLC_TRANS;
+	}
+
+	*consumed = i;
+
+	return o;
+}
+
+/*
+ * Writes escaped data at offset pos of the free area of the write buffer.
+ * The area up to wrap is contiguous, an escape sequence which straddles
+ * the wrap point is the only case handled byte by byte.
+ */
+static gboolean escape_to_buffer(GAtHDLC *hdlc, struct ring_buffer *rbuf,
+					unsigned int *pos, unsigned int avail,
+					unsigned int wrap,
+					const unsigned char *data, unsigned int size)
+{
+	unsigned int p = *pos;
+	unsigned int done;
+
+	if (p < wrap) {
+		p += escape_block(hdlc->xmit_accm,
+					ring_buffer_write_ptr(rbuf, p), wrap - p,
+					data, size, &done);
+		data += done;
+		size -= done;
+
+		if (size > 0 && p + 1 == wrap && avail > wrap) {
+			*ring_buffer_write_ptr(rbuf, p++) = HDLC_ESCAPE;
+			*ring_buffer_write_ptr(rbuf, p++) = *data++ ^ HDLC_TRANS;
+			size -= 1;
+		}
+	}
+
+	if (size > 0 && p < avail) {
+		p += escape_block(hdlc->xmit_accm,
+					ring_buffer_write_ptr(rbuf, p), avail - p,
+					data, size, &done);
+		size -= done;
+	}
+
+	*pos = p;
+
+	return size == 0;
+}
 
 gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
 {
@@ -536,12 +701,9 @@ gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
 
 	unsigned int avail = ring_buffer_avail(write_buffer);
 	unsigned int wrap = ring_buffer_avail_no_wrap(write_buffer);
-	unsigned char *buf;
 	unsigned char tail[2];
-	unsigned int i = 0;
-	guint16 fcs = HDLC_INITFCS;
-	gboolean escape = FALSE;
-	gsize pos = 0;
+	guint16 fcs;
+	unsigned int pos = 0;
 
 	if (avail < size + HDLC_OVERHEAD) {
 		if (g_queue_get_length(hdlc->write_queue) > MAX_BUFFERS)
@@ -557,83 +719,36 @@ gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
 		wrap = ring_buffer_avail_no_wrap(write_buffer);
 	}
 
-	i = 0;
-	buf = ring_buffer_write_ptr(write_buffer, 0);
-
 	if (hdlc->start_frame_marker == TRUE) {
 		/* Protocol requires 0x7e as start marker */
 		if (pos + 1 > avail)
 			return FALSE;
 
-		*buf++ = HDLC_FLAG;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
+		*ring_buffer_write_ptr(write_buffer, pos++) = HDLC_FLAG;
 	} else if (hdlc->wakeup_sent == FALSE) {
 		/* Write an initial 0x7e as wakeup character */
-		*buf++ = HDLC_FLAG;
-		pos++;
+		*ring_buffer_write_ptr(write_buffer, pos++) = HDLC_FLAG;
 
 		hdlc->wakeup_sent = TRUE;
 	}
 
-	while (pos < avail && i < size) {
-		if (escape == TRUE) {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, data[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++];
-		}
-
-		buf++;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
-
-	if (i < size)
+	if (escape_to_buffer(hdlc, write_buffer, &pos, avail, wrap,
+						data, size) == FALSE)
 		return FALSE;
 
-	fcs ^= HDLC_INITFCS;
+	fcs = crc_ccitt(HDLC_INITFCS, data, size) ^ HDLC_INITFCS;
 	tail[0] = fcs & 0xff;
 	tail[1] = fcs >> 8;
 
-	i = 0;
-
-	while (pos < avail && i < sizeof(tail)) {
-		if (escape == TRUE) {
-			*buf = tail[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, tail[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			*buf = tail[i++];
-		}
-
-		buf++;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
-
-	if (i < sizeof(tail))
+	if (escape_to_buffer(hdlc, write_buffer, &pos, avail, wrap,
+						tail, sizeof(tail)) == FALSE)
 		return FALSE;
 
 	if (pos + 1 > avail)
 		return FALSE;
 
 	/* Add 0x7e as end marker */
-	*buf = HDLC_FLAG;
-	pos++;
+	*ring_buffer_write_ptr(write_buffer, pos++) = HDLC_FLAG;
 
 	ring_buffer_write_advance(write_buffer, pos);
 
@@ -55,6 +55,9 @@ struct _GAtIO {
 	GAtDisconnectFunc write_done_func;	/* tx empty notifier */
 	gpointer write_done_data;		/* tx empty data */
 	gboolean destroyed;			/* Re-entrancy guard */
+	gboolean fd_backed;			/* Channel has a real fd */
+	guint write_calls;			/* Write syscalls made */
+	gsize write_bytes;			/* Bytes written */
 };
 
 static void read_watcher_destroy_notify(gpointer user_data)
@@ -141,6 +144,8 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 
 	status = g_io_channel_write_chars(io->channel, data,
 						count, &bytes_written, NULL);
+	io->write_calls++;
+	io->write_bytes += bytes_written;
 
 	if (status != G_IO_STATUS_NORMAL) {
 		g_source_remove(io->read_watch);
@@ -153,6 +158,63 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 	return bytes_written;
 }
 
+/*
+ * Gathers several buffers, typically both halves of a ring buffer, into
+ * a single write system call.  Channels without a file descriptor (e.g.
+ * GAtMux DLCs) get one write per buffer instead.  Returns the number of
+ * bytes written.
+ */
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt)
+{
+	ssize_t written;
+	gsize left;
+	int i;
+
+	if (io->channel == NULL)
+		return 0;
+
+	if (io->fd_backed == FALSE) {
+		gsize total = 0;
+
+		for (i = 0; i < iovcnt; i++) {
+			gsize len = g_at_io_write(io, iov[i].iov_base,
+							iov[i].iov_len);
+
+			total += len;
+
+			if (len < iov[i].iov_len)
+				break;
+		}
+
+		return total;
+	}
+
+	do {
+		written = writev(g_io_channel_unix_get_fd(io->channel),
+					iov, iovcnt);
+		io->write_calls++;
+	} while (written < 0 && errno == EINTR);
+
+	if (written < 0) {
+		if (errno != EAGAIN)
+			g_source_remove(io->read_watch);
+
+		return 0;
+	}
+
+	io->write_bytes += written;
+
+	for (i = 0, left = written; i < iovcnt && left > 0; i++) {
+		gsize len = MIN(left, iov[i].iov_len);
+
+		g_at_util_debug_chat(FALSE, iov[i].iov_base, len,
+					io->debugf, io->debug_data);
+		left -= len;
+	}
+
+	return written;
+}
+
 static void write_watcher_destroy_notify(gpointer user_data)
 {
 	GAtIO *io = user_data;
@@ -182,6 +244,33 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 	return io->write_handler(io->write_data);
 }
 
+/*
+ * Custom channels like the GAtMux DLCs don't have a file descriptor that
+ * writev() could be used on.  Compare against the funcs of a real unix
+ * channel, which are looked up once.
+ */
+static gboolean channel_is_unix(GIOChannel *channel)
+{
+	static GIOFuncs *unix_funcs;
+
+	if (unix_funcs == NULL) {
+		GIOChannel *probe;
+		int fds[2];
+
+		if (pipe(fds) < 0)
+			return FALSE;
+
+		probe = g_io_channel_unix_new(fds[0]);
+		unix_funcs = probe->funcs;
+		g_io_channel_unref(probe);
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	return channel->funcs == unix_funcs;
+}
+
 static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 {
 	GAtIO *io;
@@ -213,6 +302,7 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		goto error;
 
 	io->channel = channel;
+	io->fd_backed = channel_is_unix(channel);
 	io->read_watch = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
 				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 				received_data, io,
@@ -378,6 +468,20 @@ gboolean g_at_io_set_debug(GAtIO *io, GAtDebugFunc func, gpointer user_data)
 	return TRUE;
 }
 
+gboolean g_at_io_get_write_stats(GAtIO *io, guint *calls, gsize *bytes)
+{
+	if (io == NULL)
+		return FALSE;
+
+	if (calls)
+		*calls = io->write_calls;
+
+	if (bytes)
+		*bytes = io->write_bytes;
+
+	return TRUE;
+}
+
 void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 				gpointer user_data)
 {
@@ -26,6 +26,8 @@
 extern "C" {
 #endif
 
+#include <sys/uio.h>
+
 #include "gat.h"
 
 struct _GAtIO;
@@ -47,6 +49,11 @@ void g_at_io_unref(GAtIO *io);
 
 gboolean g_at_io_set_read_handler(GAtIO *io, GAtIOReadFunc read_handler,
 					gpointer user_data);
+/*
+ * The write handler runs from a G_IO_OUT watch, so everything queued for
+ * it during one main loop iteration is written out together in the next
+ * one.  Handlers use g_at_io_writev() to submit it in a single syscall.
+ */
 gboolean g_at_io_set_write_handler(GAtIO *io, GAtIOWriteFunc write_handler,
 					gpointer user_data);
 void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
@@ -55,6 +62,10 @@ void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 void g_at_io_drain_ring_buffer(GAtIO *io, guint len);
 
 gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count);
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt);
+
+/* Number of write syscalls made and bytes written so far */
+gboolean g_at_io_get_write_stats(GAtIO *io, guint *calls, gsize *bytes);
 
 gboolean g_at_io_set_disconnect_function(GAtIO *io,
 			GAtDisconnectFunc disconnect, gpointer user_data);
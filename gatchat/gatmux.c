@@ -56,6 +56,7 @@ typedef void (*GAtMuxWriteFrame)(GAtMux *mux, guint8 dlc, guint8 control,
 #define BITMAP_SIZE 8
 #define MUX_CHANNEL_BUFFER_SIZE 4096
 #define MUX_BUFFER_SIZE 4096
+#define MUX_MAX_READ_ATTEMPTS 3
 
 struct _GAtMuxChannel
 {
@@ -89,6 +90,7 @@ struct _GAtMux {
 	const GAtMuxDriver *driver;		/* Driver functions */
 	void *driver_data;			/* Driver data */
 	char buf[MUX_BUFFER_SIZE];		/* Buffer on the main mux */
+	int buf_start;				/* Offset of unparsed data */
 	int buf_used;				/* Bytes of buf being used */
 	gboolean shutdown;
 };
@@ -225,6 +227,36 @@ static void dispatch_sources(GAtMuxChannel *channel, GIOCondition condition)
 	g_slist_free_full(refs, (GDestroyNotify) g_source_unref);
 }
 
+/*
+ * A frame never carries more payload than it has bytes on the wire, so a
+ * read no larger than the free space of every channel which already got
+ * data in this batch cannot overflow any of them before they get a chance
+ * to consume it.  Channels not fed yet are not limited by this.
+ */
+static gsize channels_room(GAtMux *mux)
+{
+	gsize room = sizeof(mux->buf);
+	int i;
+
+	for (i = 1; i <= MAX_CHANNELS; i++) {
+		GAtMuxChannel *channel = mux->dlcs[i-1];
+		gsize avail;
+
+		if (!(mux->newdata[i / 8] & (1 << (i % 8))))
+			continue;
+
+		if (channel == NULL)
+			continue;
+
+		avail = ring_buffer_avail(channel->buffer);
+
+		if (avail < room)
+			room = avail;
+	}
+
+	return room;
+}
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 							gpointer data)
 {
@@ -232,33 +264,84 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 	int i;
 	GIOStatus status;
 	gsize bytes_read;
+	gsize total_read = 0;
+	gsize room;
+	gsize len;
+	guint read_count = 0;
 	gboolean buffer_full = FALSE;
+	int end;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
 
 	debug(mux, "received data");
 
-	bytes_read = 0;
-	status = g_io_channel_read_chars(mux->channel, mux->buf + mux->buf_used,
-					sizeof(mux->buf) - mux->buf_used,
-					&bytes_read, NULL);
+	memset(mux->newdata, 0, BITMAP_SIZE);
+
+	g_at_mux_ref(mux);
+
+	/*
+	 * Frames are parsed in place, the unparsed remainder is only moved
+	 * to the front of the buffer once there is no room left behind it.
+	 * Channels are dispatched once for the whole batch of reads.
+	 */
+	do {
+		end = mux->buf_start + mux->buf_used;
+
+		if (mux->buf_start > 0 && end == MUX_BUFFER_SIZE) {
+			memmove(mux->buf, mux->buf + mux->buf_start,
+					mux->buf_used);
+			mux->buf_start = 0;
+			end = mux->buf_used;
+		}
+
+		len = sizeof(mux->buf) - end;
 
-	mux->buf_used += bytes_read;
+		/*
+		 * Whatever is still unparsed may complete frames as well,
+		 * so it counts against the room left in the channels.
+		 */
+		if (read_count > 0) {
+			room = channels_room(mux);
 
-	if (bytes_read > 0 && mux->driver->feed_data) {
-		int nread;
+			if (room <= (gsize) mux->buf_used)
+				break;
+
+			if (len > room - mux->buf_used)
+				len = room - mux->buf_used;
+		}
 
-		memset(mux->newdata, 0, BITMAP_SIZE);
+		bytes_read = 0;
+		status = g_io_channel_read_chars(mux->channel, mux->buf + end,
+						len, &bytes_read, NULL);
 
-		nread = mux->driver->feed_data(mux, mux->buf, mux->buf_used);
-		mux->buf_used -= nread;
+		read_count++;
+
+		if (bytes_read == 0)
+			break;
 
-		if (mux->buf_used > 0)
-			memmove(mux->buf, mux->buf + nread, mux->buf_used);
+		total_read += bytes_read;
+		mux->buf_used += bytes_read;
 
-		g_at_mux_ref(mux);
+		if (mux->driver->feed_data) {
+			int nread;
 
+			nread = mux->driver->feed_data(mux,
+						mux->buf + mux->buf_start,
+						mux->buf_used);
+			mux->buf_start += nread;
+			mux->buf_used -= nread;
+
+			if (mux->buf_used == 0)
+				mux->buf_start = 0;
+		}
+
+		buffer_full = mux->buf_used == sizeof(mux->buf);
+	} while (status == G_IO_STATUS_NORMAL && !buffer_full &&
+			mux->shutdown == FALSE &&
+			read_count < MUX_MAX_READ_ATTEMPTS);
+
+	if (total_read > 0 && mux->driver->feed_data) {
 		for (i = 1; i <= MAX_CHANNELS; i++) {
 			int offset = i / 8;
 			int bit = i % 8;
@@ -271,12 +354,10 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 			dispatch_sources(mux->dlcs[i-1], G_IO_IN);
 		}
-
-		buffer_full = mux->buf_used == sizeof(mux->buf);
-
-		g_at_mux_unref(mux);
 	}
 
+	g_at_mux_unref(mux);
+
 	if (cond & (G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
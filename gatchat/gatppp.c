@@ -61,6 +61,10 @@ struct _GAtPPP {
 	enum ppp_phase phase;
 	struct pppcp_data *lcp;
 	struct pppcp_data *ipcp;
+	struct pppcp_data *ipv6cp;
+	gboolean ipv6_up;
+	char ipv6_local[INET6_ADDRSTRLEN];
+	char ipv6_peer[INET6_ADDRSTRLEN];
 	struct ppp_net *net;
 	struct ppp_chap *chap;
 	struct ppp_pap *pap;
@@ -71,6 +75,8 @@ struct _GAtPPP {
 	GAtPPPAuthMethod auth_method;
 	GAtPPPConnectFunc connect_cb;
 	gpointer connect_data;
+	GAtPPPIPv6ConnectFunc ipv6_connect_cb;
+	gpointer ipv6_connect_data;
 	GAtPPPDisconnectFunc disconnect_cb;
 	gpointer disconnect_data;
 	GAtPPPDisconnectReason disconnect_reason;
@@ -85,6 +91,7 @@ struct _GAtPPP {
 	gboolean suspended;
 	gboolean xmit_acfc;
 	gboolean xmit_pfc;
+	gboolean is_server;
 };
 
 void ppp_debug(GAtPPP *ppp, const char *str)
@@ -159,7 +166,8 @@ static inline gboolean ppp_drop_packet(GAtPPP *ppp, guint16 protocol)
 	case PPP_PHASE_NETWORK:
 		if (protocol != LCP_PROTOCOL && protocol != CHAP_PROTOCOL &&
 					protocol != PAP_PROTOCOL &&
-					protocol != IPCP_PROTO)
+					protocol != IPCP_PROTO &&
+					protocol != IPV6CP_PROTO)
 			return TRUE;
 		break;
 	case PPP_PHASE_LINK_UP:
@@ -217,12 +225,31 @@ static void ppp_receive(const unsigned char *buf, gsize len, void *data)
 	switch (protocol) {
 	case PPP_IP_PROTO:
 		ppp_net_process_packet(ppp->net, packet, len - offset);
+		break;
+	case PPP_IPV6_PROTO:
+		if (ppp->ipv6cp == NULL) {
+			pppcp_send_protocol_reject(ppp->lcp, buf, len);
+			break;
+		}
+
+		/* Silently discard until IPV6CP reaches the Opened state */
+		if (ppp->ipv6_up)
+			ppp_net_process_packet(ppp->net, packet, len - offset);
+
 		break;
 	case LCP_PROTOCOL:
 		pppcp_process_packet(ppp->lcp, packet, len - offset);
 		break;
 	case IPCP_PROTO:
 		pppcp_process_packet(ppp->ipcp, packet, len - offset);
+		break;
+	case IPV6CP_PROTO:
+		if (ppp->ipv6cp)
+			pppcp_process_packet(ppp->ipv6cp, packet,
+							len - offset);
+		else
+			pppcp_send_protocol_reject(ppp->lcp, buf, len);
+
 		break;
 	case PAP_PROTOCOL:
 		if (ppp->pap)
@@ -399,6 +426,12 @@ void ppp_auth_notify(GAtPPP *ppp, gboolean success)
 	/* Send UP & OPEN events to the IPCP layer */
 	pppcp_signal_open(ppp->ipcp);
 	pppcp_signal_up(ppp->ipcp);
+
+	/* IPV6CP, if enabled, is negotiated in parallel with IPCP */
+	if (ppp->ipv6cp) {
+		pppcp_signal_open(ppp->ipv6cp);
+		pppcp_signal_up(ppp->ipv6cp);
+	}
 }
 
 void ppp_ipcp_up_notify(GAtPPP *ppp, const char *local, const char *peer,
@@ -427,6 +460,11 @@ void ppp_ipcp_up_notify(GAtPPP *ppp, const char *local, const char *peer,
 		ppp->connect_cb(ppp_net_get_interface(ppp->net),
 					local, peer, dns1, dns2,
 					ppp->connect_data);
+
+	/* IPV6CP may have opened before the interface was there */
+	if (ppp->ipv6_up && ppp->ipv6_connect_cb)
+		ppp->ipv6_connect_cb(ppp->ipv6_local, ppp->ipv6_peer,
+					ppp->ipv6_connect_data);
 }
 
 void ppp_ipcp_down_notify(GAtPPP *ppp)
@@ -450,6 +488,70 @@ void ppp_ipcp_finished_notify(GAtPPP *ppp)
 	pppcp_signal_close(ppp->lcp);
 }
 
+void ppp_ipv6cp_up_notify(GAtPPP *ppp, const char *local, const char *peer)
+{
+	DBG(ppp, "local %s peer %s", local, peer);
+
+	ppp->ipv6_up = TRUE;
+	g_strlcpy(ppp->ipv6_local, local, sizeof(ppp->ipv6_local));
+	g_strlcpy(ppp->ipv6_peer, peer, sizeof(ppp->ipv6_peer));
+
+	/* IPv6 packets need the interface created once IPCP is up */
+	if (ppp->net == NULL)
+		return;
+
+	if (ppp->ipv6_connect_cb)
+		ppp->ipv6_connect_cb(local, peer, ppp->ipv6_connect_data);
+}
+
+void ppp_ipv6cp_down_notify(GAtPPP *ppp)
+{
+	ppp->ipv6_up = FALSE;
+}
+
+void ppp_ipv6cp_finished_notify(GAtPPP *ppp)
+{
+	/*
+	 * IPv6 is optional, a failed IPV6CP negotiation leaves the
+	 * IPv4 side of the link alone
+	 */
+	DBG(ppp, "IPV6CP negotiation failed");
+
+	ppp->ipv6_up = FALSE;
+
+	if (ppp->ipv6_connect_cb)
+		ppp->ipv6_connect_cb(NULL, NULL, ppp->ipv6_connect_data);
+}
+
+gboolean ppp_ipv6_is_up(GAtPPP *ppp)
+{
+	return ppp->ipv6_up;
+}
+
+/*
+ * Called when the peer sends an LCP Protocol-Reject.  Returns TRUE if
+ * the link can carry on without the rejected protocol.
+ */
+gboolean ppp_protocol_reject_notify(GAtPPP *ppp, guint16 protocol)
+{
+	if (protocol != IPV6CP_PROTO && protocol != PPP_IPV6_PROTO)
+		return FALSE;
+
+	if (ppp->ipv6cp == NULL)
+		return FALSE;
+
+	DBG(ppp, "peer does not support IPv6");
+
+	ipv6cp_free(ppp->ipv6cp);
+	ppp->ipv6cp = NULL;
+	ppp->ipv6_up = FALSE;
+
+	if (ppp->ipv6_connect_cb)
+		ppp->ipv6_connect_cb(NULL, NULL, ppp->ipv6_connect_data);
+
+	return TRUE;
+}
+
 void ppp_lcp_up_notify(GAtPPP *ppp)
 {
 	if (ppp->chap != NULL) {
@@ -473,9 +575,14 @@ void ppp_lcp_up_notify(GAtPPP *ppp)
 
 void ppp_lcp_down_notify(GAtPPP *ppp)
 {
-	if (ppp->phase == PPP_PHASE_NETWORK || ppp->phase == PPP_PHASE_LINK_UP)
+	if (ppp->phase == PPP_PHASE_NETWORK ||
+			ppp->phase == PPP_PHASE_LINK_UP) {
 		pppcp_signal_down(ppp->ipcp);
 
+		if (ppp->ipv6cp)
+			pppcp_signal_down(ppp->ipv6cp);
+	}
+
 	if (ppp->disconnect_reason == G_AT_PPP_REASON_UNKNOWN)
 		ppp->disconnect_reason = G_AT_PPP_REASON_PEER_CLOSED;
 
@@ -647,6 +754,17 @@ void g_at_ppp_set_connect_function(GAtPPP *ppp, GAtPPPConnectFunc func,
 	ppp->connect_data = user_data;
 }
 
+void g_at_ppp_set_ipv6_connect_function(GAtPPP *ppp,
+						GAtPPPIPv6ConnectFunc func,
+						gpointer user_data)
+{
+	if (func == NULL)
+		return;
+
+	ppp->ipv6_connect_cb = func;
+	ppp->ipv6_connect_data = user_data;
+}
+
 void g_at_ppp_set_disconnect_function(GAtPPP *ppp, GAtPPPDisconnectFunc func,
 							gpointer user_data)
 {
@@ -777,6 +895,9 @@ void g_at_ppp_unref(GAtPPP *ppp)
 	lcp_free(ppp->lcp);
 	ipcp_free(ppp->ipcp);
 
+	if (ppp->ipv6cp)
+		ipv6cp_free(ppp->ipv6cp);
+
 	if (ppp->ppp_dead_source) {
 		g_source_remove(ppp->ppp_dead_source);
 		ppp->ppp_dead_source = 0;
@@ -806,6 +927,33 @@ void g_at_ppp_set_server_info(GAtPPP *ppp, const char *remote,
 	ipcp_set_server_info(ppp->ipcp, r, d1, d2);
 }
 
+gboolean g_at_ppp_enable_ipv6(GAtPPP *ppp, const char *local,
+							const char *peer)
+{
+	struct pppcp_data *ipv6cp;
+	GError *error = NULL;
+
+	if (ppp->phase != PPP_PHASE_DEAD)
+		return FALSE;
+
+	ipv6cp = ipv6cp_new(ppp, ppp->is_server, local, peer, &error);
+	if (ipv6cp == NULL) {
+		if (error) {
+			DBG(ppp, "%s", error->message);
+			g_error_free(error);
+		}
+
+		return FALSE;
+	}
+
+	if (ppp->ipv6cp)
+		ipv6cp_free(ppp->ipv6cp);
+
+	ppp->ipv6cp = ipv6cp;
+
+	return TRUE;
+}
+
 void g_at_ppp_set_accm(GAtPPP *ppp, guint32 accm)
 {
 	lcp_set_accm(ppp->lcp, accm);
@@ -832,6 +980,7 @@ static GAtPPP *ppp_init_common(gboolean is_server, guint32 ip)
 	ppp->ref_count = 1;
 	ppp->suspended = TRUE;
 	ppp->fd = -1;
+	ppp->is_server = is_server;
 
 	/* set options to defaults */
 	ppp->mtu = DEFAULT_MTU;
@@ -53,6 +53,12 @@ typedef void (*GAtPPPConnectFunc)(const char *iface, const char *local,
 					const char *peer,
 					const char *dns1, const char *dns2,
 					gpointer user_data);
+/*
+ * Called with the link-local addresses once IPV6CP is up and the interface
+ * exists, or with NULL addresses if the peer refused IPv6.
+ */
+typedef void (*GAtPPPIPv6ConnectFunc)(const char *local, const char *peer,
+					gpointer user_data);
 typedef void (*GAtPPPDisconnectFunc)(GAtPPPDisconnectReason reason,
 					gpointer user_data);
 
@@ -64,6 +70,9 @@ gboolean g_at_ppp_open(GAtPPP *ppp, GAtIO *io);
 gboolean g_at_ppp_listen(GAtPPP *ppp, GAtIO *io);
 void g_at_ppp_set_connect_function(GAtPPP *ppp, GAtPPPConnectFunc callback,
 					gpointer user_data);
+void g_at_ppp_set_ipv6_connect_function(GAtPPP *ppp,
+						GAtPPPIPv6ConnectFunc func,
+						gpointer user_data);
 void g_at_ppp_set_disconnect_function(GAtPPP *ppp, GAtPPPDisconnectFunc func,
 					gpointer user_data);
 void g_at_ppp_set_suspend_function(GAtPPP *ppp, GAtSuspendFunc func,
@@ -88,6 +97,9 @@ void g_at_ppp_set_recording(GAtPPP *ppp, const char *filename);
 void g_at_ppp_set_server_info(GAtPPP *ppp, const char *remote_ip,
 				const char *dns1, const char *dns2);
 
+gboolean g_at_ppp_enable_ipv6(GAtPPP *ppp, const char *local,
+							const char *peer);
+
 void g_at_ppp_set_accm(GAtPPP *ppp, guint32 accm);
 void g_at_ppp_set_acfc_enabled(GAtPPP *ppp, gboolean enabled);
 void g_at_ppp_set_pfc_enabled(GAtPPP *ppp, gboolean enabled);
@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdarg.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <linux/if_tun.h>
@@ -44,8 +45,50 @@ struct _GAtRawIP {
 	struct ring_buffer *tun_write_buffer;
 	GAtDebugFunc debugf;
 	gpointer debug_data;
+	guint64 modem_bytes;		/* Relayed from the interface */
+	guint64 tun_bytes;		/* Relayed from the modem */
+	gint64 write_stalled;		/* Start of the current stalls */
+	gint64 tun_write_stalled;
+	guint stalls;
+	gint64 stall_time;		/* Total, in microseconds */
 };
 
+static void rawip_debug(GAtRawIP *rawip, const char *format, ...)
+{
+	char *str;
+	va_list ap;
+
+	if (rawip->debugf == NULL)
+		return;
+
+	va_start(ap, format);
+	str = g_strdup_vprintf(format, ap);
+	va_end(ap);
+
+	rawip->debugf(str, rawip->debug_data);
+
+	g_free(str);
+}
+
+/*
+ * A relay direction stalls when the receiving side can't take all the
+ * data at once, the remainder is then written from the write handler.
+ */
+static void relay_stall(GAtRawIP *rawip, gint64 *stalled)
+{
+	rawip->stalls += 1;
+	*stalled = g_get_monotonic_time();
+}
+
+static void relay_resume(GAtRawIP *rawip, gint64 *stalled)
+{
+	if (*stalled == 0)
+		return;
+
+	rawip->stall_time += g_get_monotonic_time() - *stalled;
+	*stalled = 0;
+}
+
 GAtRawIP *g_at_rawip_new(GIOChannel *channel)
 {
 	GAtRawIP *rawip;
@@ -113,22 +156,31 @@ static gboolean can_write_data(gpointer data)
 {
 	GAtRawIP *rawip = data;
 	unsigned int len;
-	unsigned char *buf;
+	unsigned int wrap;
+	struct iovec iov[2];
 	gsize bytes_written;
 
 	if (rawip->write_buffer == NULL)
 		return FALSE;
 
-	len = ring_buffer_len_no_wrap(rawip->write_buffer);
-	buf = ring_buffer_read_ptr(rawip->write_buffer, 0);
+	len = ring_buffer_len(rawip->write_buffer);
+	wrap = ring_buffer_len_no_wrap(rawip->write_buffer);
 
-	bytes_written = g_at_io_write(rawip->io, (gchar *) buf, len);
+	/* Write both halves of the ring buffer in one go */
+	iov[0].iov_base = ring_buffer_read_ptr(rawip->write_buffer, 0);
+	iov[0].iov_len = wrap;
+	iov[1].iov_base = ring_buffer_read_ptr(rawip->write_buffer, wrap);
+	iov[1].iov_len = len - wrap;
+
+	bytes_written = g_at_io_writev(rawip->io, iov, len > wrap ? 2 : 1);
 	ring_buffer_drain(rawip->write_buffer, bytes_written);
+	rawip->modem_bytes += bytes_written;
 
 	if (ring_buffer_len(rawip->write_buffer) > 0)
 		return TRUE;
 
 	rawip->write_buffer = NULL;
+	relay_resume(rawip, &rawip->write_stalled);
 
 	return FALSE;
 }
@@ -136,33 +188,54 @@ static gboolean can_write_data(gpointer data)
 static gboolean tun_write_data(gpointer data)
 {
 	GAtRawIP *rawip = data;
-	unsigned int len;
-	unsigned char *buf;
+	struct iovec iov;
 	gsize bytes_written;
 
 	if (rawip->tun_write_buffer == NULL)
 		return FALSE;
 
-	len = ring_buffer_len_no_wrap(rawip->tun_write_buffer);
-	buf = ring_buffer_read_ptr(rawip->tun_write_buffer, 0);
-
-	bytes_written = g_at_io_write(rawip->tun_io, (gchar *) buf, len);
-	ring_buffer_drain(rawip->tun_write_buffer, bytes_written);
-
-	if (ring_buffer_len(rawip->tun_write_buffer) > 0)
-		return TRUE;
+	/*
+	 * Packet boundaries are not tracked, data is written in contiguous
+	 * chunks as it was read.  A packet crossing the wrap point of the
+	 * ring buffer still ends up split over two writes.
+	 */
+	while ((iov.iov_len =
+			ring_buffer_len_no_wrap(rawip->tun_write_buffer)) > 0) {
+		iov.iov_base = ring_buffer_read_ptr(rawip->tun_write_buffer, 0);
+
+		bytes_written = g_at_io_writev(rawip->tun_io, &iov, 1);
+		if (bytes_written == 0)
+			return TRUE;
+
+		ring_buffer_drain(rawip->tun_write_buffer, bytes_written);
+		rawip->tun_bytes += bytes_written;
+	}
 
 	rawip->tun_write_buffer = NULL;
+	relay_resume(rawip, &rawip->tun_write_stalled);
 
 	return FALSE;
 }
 
+/*
+ * Relay newly read data straight away and only go through the write
+ * watch of the other side if it can't take everything, this saves a
+ * main loop iteration per chunk in the common case.
+ */
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
 	GAtRawIP *rawip = user_data;
 
 	rawip->tun_write_buffer = rbuf;
 
+	/* The pending write handler will pick the new data up */
+	if (rawip->tun_write_stalled)
+		return;
+
+	if (tun_write_data(rawip) == FALSE)
+		return;
+
+	relay_stall(rawip, &rawip->tun_write_stalled);
 	g_at_io_set_write_handler(rawip->tun_io, tun_write_data, rawip);
 }
 
@@ -172,6 +245,13 @@ static void tun_bytes(struct ring_buffer *rbuf, gpointer user_data)
 
 	rawip->write_buffer = rbuf;
 
+	if (rawip->write_stalled)
+		return;
+
+	if (can_write_data(rawip) == FALSE)
+		return;
+
+	relay_stall(rawip, &rawip->write_stalled);
 	g_at_io_set_write_handler(rawip->io, can_write_data, rawip);
 }
 
@@ -233,6 +313,15 @@ void g_at_rawip_shutdown(GAtRawIP *rawip)
 	g_at_io_set_read_handler(rawip->io, NULL, NULL);
 	g_at_io_set_read_handler(rawip->tun_io, NULL, NULL);
 
+	relay_resume(rawip, &rawip->write_stalled);
+	relay_resume(rawip, &rawip->tun_write_stalled);
+
+	rawip_debug(rawip, "relayed %" G_GUINT64_FORMAT " bytes to %s and %"
+			G_GUINT64_FORMAT " bytes to the modem, %u stalls, "
+			"%" G_GINT64_FORMAT " ms stalled",
+			rawip->tun_bytes, rawip->ifname, rawip->modem_bytes,
+			rawip->stalls, rawip->stall_time / 1000);
+
 	rawip->write_buffer = NULL;
 	rawip->tun_write_buffer = NULL;
 
@@ -33,9 +33,8 @@
 void g_at_result_iter_init(GAtResultIter *iter, GAtResult *result)
 {
 	iter->result = result;
-	iter->pre.next = result->lines;
-	iter->pre.data = NULL;
-	iter->l = &iter->pre;
+	iter->line = NULL;
+	iter->next_line = 0;
 	iter->line_pos = 0;
 }
 
@@ -45,8 +44,9 @@ gboolean g_at_result_iter_next(GAtResultIter *iter, const char *prefix)
 	int prefix_len = prefix ? strlen(prefix) : 0;
 	int linelen;
 
-	while ((iter->l = iter->l->next)) {
-		line = iter->l->data;
+	while (iter->next_line < iter->result->n_lines) {
+		line = iter->result->buf +
+			iter->result->offsets[iter->next_line++];
 		linelen = strlen(line);
 
 		if (linelen > G_AT_RESULT_LINE_LENGTH_MAX)
@@ -69,9 +69,12 @@ gboolean g_at_result_iter_next(GAtResultIter *iter, const char *prefix)
 		goto out;
 	}
 
+	iter->line = NULL;
 	return FALSE;
 
 out:
+	iter->line = line;
+
 	/* Already checked the length to be no more than buflen */
 	strcpy(iter->buf, line);
 	return TRUE;
@@ -84,10 +87,10 @@ const char *g_at_result_iter_raw_line(GAtResultIter *iter)
 	if (iter == NULL)
 		return NULL;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return NULL;
 
-	line = iter->l->data;
+	line = iter->line;
 
 	line += iter->line_pos;
 
@@ -117,10 +120,10 @@ gboolean g_at_result_iter_next_unquoted_string(GAtResultIter *iter,
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	pos = iter->line_pos;
@@ -166,10 +169,10 @@ gboolean g_at_result_iter_next_string(GAtResultIter *iter, const char **str)
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	pos = iter->line_pos;
@@ -218,10 +221,10 @@ gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	pos = iter->line_pos;
@@ -274,10 +277,10 @@ gboolean g_at_result_iter_next_number(GAtResultIter *iter, gint *number)
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	pos = iter->line_pos;
@@ -309,10 +312,10 @@ gboolean g_at_result_iter_next_number_default(GAtResultIter *iter, gint dflt,
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	pos = skip_to_next_field(line, iter->line_pos, len);
@@ -341,10 +344,10 @@ gboolean g_at_result_iter_next_range(GAtResultIter *iter, gint *min, gint *max)
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	pos = iter->line_pos;
@@ -431,10 +434,10 @@ gboolean g_at_result_iter_skip_next(GAtResultIter *iter)
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 
 	skipped_to = skip_until(line, iter->line_pos, ',');
 
@@ -454,10 +457,10 @@ gboolean g_at_result_iter_open_list(GAtResultIter *iter)
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	if (iter->line_pos >= len)
@@ -483,10 +486,10 @@ gboolean g_at_result_iter_close_list(GAtResultIter *iter)
 	if (iter == NULL)
 		return FALSE;
 
-	if (iter->l == NULL)
+	if (iter->line == NULL)
 		return FALSE;
 
-	line = iter->l->data;
+	line = iter->line;
 	len = strlen(line);
 
 	if (iter->line_pos >= len)
@@ -523,8 +526,5 @@ gint g_at_result_num_response_lines(GAtResult *result)
 	if (result == NULL)
 		return 0;
 
-	if (result->lines == NULL)
-		return 0;
-
-	return g_slist_length(result->lines);
+	return result->n_lines;
 }
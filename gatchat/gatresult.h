@@ -29,7 +29,9 @@ extern "C" {
 #endif
 
 struct _GAtResult {
-	GSList *lines;
+	char *buf;		/* Response lines, each NUL terminated */
+	const guint *offsets;	/* Start of each line within buf */
+	guint n_lines;
 	char *final_or_pdu;
 };
 
@@ -39,10 +41,10 @@ typedef struct _GAtResult GAtResult;
 
 struct _GAtResultIter {
 	GAtResult *result;
-	GSList *l;
+	char *line;
+	guint next_line;
 	char buf[G_AT_RESULT_LINE_LENGTH_MAX + 1];
 	unsigned int line_pos;
-	GSList pre;
 };
 
 typedef struct _GAtResultIter GAtResultIter;
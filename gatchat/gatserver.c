@@ -588,6 +588,7 @@ static inline gboolean is_extended_command_prefix(const char c)
 static void at_command_notify(GAtServer *server, char *command,
 				char *prefix, GAtServerRequestType type)
 {
+	static const guint offset = 0;
 	struct at_command *node;
 	GAtResult result;
 
@@ -598,12 +599,12 @@ static void at_command_notify(GAtServer *server, char *command,
 		return;
 	}
 
-	result.lines = g_slist_prepend(NULL, command);
+	result.buf = command;
+	result.offsets = &offset;
+	result.n_lines = 1;
 	result.final_or_pdu = 0;
 
 	node->notify(server, type, &result, node->user_data);
-
-	g_slist_free(result.lines);
 }
 
 static unsigned int parse_extended_command(GAtServer *server, char *buf)
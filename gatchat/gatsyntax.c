@@ -23,6 +23,8 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <glib.h>
 
 #include "gatsyntax.h"
@@ -59,6 +61,47 @@ enum GSM_PERMISSIVE_STATE {
 	GSM_PERMISSIVE_STATE_SHORT_PROMPT,
 };
 
+/*
+ * Returns the number of bytes before the first occurrence of a or b, or
+ * len if neither is found.  Used to skip over the body of a line in bulk.
+ */
+static gsize skip_until(const char *bytes, gsize len, char a, char b)
+{
+	const char *p;
+	gsize i;
+
+	if (a == b) {
+		p = memchr(bytes, a, len);
+		return p ? (gsize) (p - bytes) : len;
+	}
+
+	for (i = 0; i < len; i++)
+		if (bytes[i] == a || bytes[i] == b)
+			break;
+
+	return i;
+}
+
+/* Bytes which can be skipped without changing the state */
+static gsize gsmv1_skip(int state, const char *bytes, gsize len)
+{
+	switch (state) {
+	case GSMV1_STATE_RESPONSE:
+		return skip_until(bytes, len, '\r', '"');
+	case GSMV1_STATE_RESPONSE_STRING:
+		return skip_until(bytes, len, '"', '"');
+	case GSMV1_STATE_MULTILINE_RESPONSE:
+	case GSMV1_STATE_PDU:
+		return skip_until(bytes, len, '\r', '\r');
+	case GSMV1_STATE_ECHO:
+		return skip_until(bytes, len, '\r', 26);
+	case GSMV1_STATE_PPP_DATA:
+		return skip_until(bytes, len, '~', '~');
+	default:
+		return 0;
+	}
+}
+
 static void gsmv1_hint(GAtSyntax *syntax, GAtSyntaxExpectHint hint)
 {
 	switch (hint) {
@@ -83,7 +126,13 @@ static GAtSyntaxResult gsmv1_feed(GAtSyntax *syntax,
 	GAtSyntaxResult res = G_AT_SYNTAX_RESULT_UNSURE;
 
 	while (i < *len) {
-		char byte = bytes[i];
+		char byte;
+
+		i += gsmv1_skip(syntax->state, bytes + i, *len - i);
+		if (i == *len)
+			break;
+
+		byte = bytes[i];
 
 		switch (syntax->state) {
 		case GSMV1_STATE_IDLE:
@@ -272,6 +321,19 @@ static void gsm_permissive_hint(GAtSyntax *syntax, GAtSyntaxExpectHint hint)
 		syntax->state = GSM_PERMISSIVE_STATE_GUESS_SHORT_PROMPT;
 }
 
+static gsize gsm_permissive_skip(int state, const char *bytes, gsize len)
+{
+	switch (state) {
+	case GSM_PERMISSIVE_STATE_RESPONSE:
+	case GSM_PERMISSIVE_STATE_RESPONSE_STRING:
+		return skip_until(bytes, len, '\r', '"');
+	case GSM_PERMISSIVE_STATE_PDU:
+		return skip_until(bytes, len, '\r', '\r');
+	default:
+		return 0;
+	}
+}
+
 static GAtSyntaxResult gsm_permissive_feed(GAtSyntax *syntax,
 						const char *bytes, gsize *len)
 {
@@ -279,7 +341,13 @@ static GAtSyntaxResult gsm_permissive_feed(GAtSyntax *syntax,
 	GAtSyntaxResult res = G_AT_SYNTAX_RESULT_UNSURE;
 
 	while (i < *len) {
-		char byte = bytes[i];
+		char byte;
+
+		i += gsm_permissive_skip(syntax->state, bytes + i, *len - i);
+		if (i == *len)
+			break;
+
+		byte = bytes[i];
 
 		switch (syntax->state) {
 		case GSM_PERMISSIVE_STATE_IDLE:
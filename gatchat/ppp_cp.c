@@ -858,10 +858,16 @@ static guint8 pppcp_process_protocol_reject(struct pppcp_data *data,
 	 * return RXJ_PLUS if this reject is acceptable, RXJ_MINUS if
 	 * it is catastrophic.
 	 *
-	 * for now we always return RXJ_MINUS.  Any protocol
-	 * reject will be catastrophic, since we only support the
-	 * bare minimum number of protocols necessary to function.
+	 * Only the optional protocols (IPv6) may be rejected, losing
+	 * anything else is catastrophic.
 	 */
+	if (ntohs(packet->length) < sizeof(*packet) + 2)
+		return RXJ_MINUS;
+
+	if (ppp_protocol_reject_notify(data->ppp,
+					get_host_short(packet->data)))
+		return RXJ_PLUS;
+
 	return RXJ_MINUS;
 }
 
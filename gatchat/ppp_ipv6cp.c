@@ -96,7 +96,25 @@ static void ipv6cp_reset_config_options(struct ipv6cp_data *ipv6cp)
 
 static void ipv6cp_up(struct pppcp_data *pppcp)
 {
+	struct ipv6cp_data *ipv6cp = pppcp_get_data(pppcp);
+	struct in6_addr addr;
+	char local[INET6_ADDRSTRLEN];
+	char peer[INET6_ADDRSTRLEN];
+
+	/* Report the Interface Ids as link-local addresses */
+	memset(&addr, 0, sizeof(addr));
+	addr.s6_addr[0] = 0xfe;
+	addr.s6_addr[1] = 0x80;
+
+	memcpy(&addr.s6_addr[8], &ipv6cp->local_addr,
+					sizeof(ipv6cp->local_addr));
+	inet_ntop(AF_INET6, &addr, local, sizeof(local));
 
+	memcpy(&addr.s6_addr[8], &ipv6cp->peer_addr,
+					sizeof(ipv6cp->peer_addr));
+	inet_ntop(AF_INET6, &addr, peer, sizeof(peer));
+
+	ppp_ipv6cp_up_notify(pppcp_get_ppp(pppcp), local, peer);
 }
 
 static void ipv6cp_down(struct pppcp_data *pppcp)
@@ -106,11 +124,12 @@ static void ipv6cp_down(struct pppcp_data *pppcp)
 	ipv6cp_reset_config_options(ipv6cp);
 
 	pppcp_set_local_options(pppcp, ipv6cp->options, ipv6cp->options_len);
+	ppp_ipv6cp_down_notify(pppcp_get_ppp(pppcp));
 }
 
 static void ipv6cp_finished(struct pppcp_data *pppcp)
 {
-
+	ppp_ipv6cp_finished_notify(pppcp_get_ppp(pppcp));
 }
 
 static enum rcr_result ipv6cp_server_rcr(struct ipv6cp_data *ipv6cp,
@@ -39,6 +39,10 @@
 #include "ppp.h"
 
 #define MAX_PACKET 1500
+#define IPV6_HEADER_LEN 40
+
+/* Maximum number of packets read from the interface per wakeup */
+#define MAX_READ_PACKETS 16
 
 struct ppp_net {
 	GAtPPP *ppp;
@@ -47,6 +51,11 @@ struct ppp_net {
 	guint watch;
 	gint mtu;
 	struct ppp_header *ppp_packet;
+	guint64 read_packets;		/* Read from the interface */
+	guint64 read_bytes;
+	guint64 written_packets;	/* Written to the interface */
+	guint64 written_bytes;
+	guint64 write_errors;
 };
 
 gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
@@ -82,24 +91,78 @@ void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
 {
 	GIOStatus status;
 	gsize bytes_written;
-	guint16 len;
+	gsize len;
 
-	if (plen < 4)
+	if (plen == 0)
 		return;
 
 	/* find the length of the packet to transmit */
-	len = get_host_short(&packet[2]);
+	switch (packet[0] >> 4) {
+	case 4:
+		if (plen < 4)
+			return;
+
+		len = get_host_short(&packet[2]);
+		break;
+	case 6:
+		if (plen < IPV6_HEADER_LEN)
+			return;
+
+		/* Payload length excludes the fixed header */
+		len = get_host_short(&packet[4]) + IPV6_HEADER_LEN;
+		break;
+	default:
+		return;
+	}
+
 	status = g_io_channel_write_chars(net->channel, (gchar *) packet,
 						MIN(len, plen),
 						&bytes_written, NULL);
 
-	if (status != G_IO_STATUS_NORMAL)
+	if (status != G_IO_STATUS_NORMAL) {
+		net->write_errors += 1;
+		return;
+	}
+
+	net->written_packets += 1;
+	net->written_bytes += bytes_written;
+}
+
+/*
+ * The tun device is opened without packet information, so the PPP
+ * protocol is taken from the IP version of each packet.  IPv6 is only
+ * forwarded once IPV6CP has been negotiated.
+ */
+static void ppp_net_transmit(struct ppp_net *net, gsize len)
+{
+	guint16 proto;
+
+	switch (net->ppp_packet->info[0] >> 4) {
+	case 4:
+		proto = PPP_IP_PROTO;
+		break;
+	case 6:
+		if (ppp_ipv6_is_up(net->ppp) == FALSE)
+			return;
+
+		proto = PPP_IPV6_PROTO;
+		break;
+	default:
 		return;
+	}
+
+	net->read_packets += 1;
+	net->read_bytes += len;
+
+	put_network_short(&net->ppp_packet->proto, proto);
+	ppp_transmit(net->ppp, (guint8 *) net->ppp_packet, len);
 }
 
 /*
  * packets received by the tun interface need to be written to
- * the modem.  So, just read a packet, write out to the modem
+ * the modem.  So, read the packets queued up, one at a time, and
+ * write them out to the modem.  The HDLC layer flushes them in one go
+ * once we're done.
  */
 static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer userdata)
@@ -108,21 +171,31 @@ static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 	GIOStatus status;
 	gsize bytes_read;
 	gchar *buf = (gchar *) net->ppp_packet->info;
+	int i;
 
 	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
 		return FALSE;
 
-	if (cond & G_IO_IN) {
+	if (!(cond & G_IO_IN))
+		return TRUE;
+
+	for (i = 0; i < MAX_READ_PACKETS; i++) {
 		/* leave space to add PPP protocol field */
 		status = g_io_channel_read_chars(channel, buf, net->mtu,
 							&bytes_read, NULL);
-		if (bytes_read > 0)
-			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
-					bytes_read);
-
-		if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
+		if (status == G_IO_STATUS_ERROR)
 			return FALSE;
+
+		/* The channel is non-blocking, stop once the queue is empty */
+		if (bytes_read == 0)
+			break;
+
+		ppp_net_transmit(net, bytes_read);
+
+		if (status != G_IO_STATUS_NORMAL)
+			break;
 	}
+
 	return TRUE;
 }
 
@@ -181,7 +254,7 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 	if (channel == NULL)
 		goto error;
 
-	if (!g_at_util_setup_io(channel, 0))
+	if (!g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK))
 		goto error;
 
 	g_io_channel_set_buffered(channel, FALSE);
@@ -212,6 +285,15 @@ badalloc:
 
 void ppp_net_free(struct ppp_net *net)
 {
+	DBG(net->ppp, "%s read %" G_GUINT64_FORMAT " packets "
+			"%" G_GUINT64_FORMAT " bytes, "
+			"wrote %" G_GUINT64_FORMAT " packets "
+			"%" G_GUINT64_FORMAT " bytes, "
+			"%" G_GUINT64_FORMAT " write errors", net->if_name,
+			net->read_packets, net->read_bytes,
+			net->written_packets, net->written_bytes,
+			net->write_errors);
+
 	if (net->watch) {
 		g_source_remove(net->watch);
 		net->watch = 0;
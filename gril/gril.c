@@ -43,6 +43,9 @@
 #include "gril.h"
 #include "grilutil.h"
 
+/* Maximum number of requests written to rild but not yet answered */
+#define RIL_MAX_IN_FLIGHT 8
+
 #define RIL_TRACE(ril, fmt, arg...) do {	\
 	if (ril->trace == TRUE)			\
 		ofono_debug(fmt, ## arg);	\
@@ -57,6 +60,7 @@ struct ril_request {
 	GRilResponseFunc callback;
 	gpointer user_data;
 	GDestroyNotify notify;
+	gint64 sent_time;
 };
 
 struct ril_notify_node {
@@ -80,8 +84,8 @@ struct ril_s {
 	guint next_notify_id;			/* Next notify id */
 	guint next_gid;				/* Next group id */
 	GRilIO *io;				/* GRil IO */
-	GQueue *command_queue;			/* Command queue */
-	GQueue *out_queue;			/* Commands sent/been sent */
+	GQueue *command_queue;			/* Commands not yet sent */
+	GHashTable *out_table;			/* Sent commands by serial */
 	guint req_bytes_written;		/* bytes written from req */
 	GHashTable *notify_list;		/* List of notification reg */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
@@ -311,9 +315,9 @@ static void ril_cleanup(struct ril_s *p)
 		p->command_queue = NULL;
 	}
 
-	if (p->out_queue) {
-		g_queue_free(p->out_queue);
-		p->out_queue = NULL;
+	if (p->out_table) {
+		g_hash_table_destroy(p->out_table);
+		p->out_table = NULL;
 	}
 
 	/* Cleanup registered notifications */
@@ -351,60 +355,45 @@ static void io_disconnect(gpointer user_data)
 
 static void handle_response(struct ril_s *p, struct ril_msg *message)
 {
-	guint count = g_queue_get_length(p->command_queue);
 	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
-
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
-
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
 
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
-
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
+	req = g_hash_table_lookup(p->out_table,
+					GINT_TO_POINTER(message->serial_no));
+	if (req == NULL) {
+		ofono_error("No matching request for reply: %s serial_no: %d!",
+			request_id_to_string(p, message->req),
+			message->serial_no);
+		return;
+	}
 
-			/* gril may have been destroyed in the request callback */
-			if (p->destroyed) {
-				ril_request_destroy(req);
-				return;
-			}
+	g_hash_table_remove(p->out_table, GINT_TO_POINTER(req->id));
+	message->req = req->req;
 
-			len = g_queue_get_length(p->out_queue);
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+			p->slot, message->serial_no,
+			request_id_to_string(p, message->req),
+			ril_error_to_string(message->error));
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	RIL_TRACE(p, "[%d,%04d]< %s answered in %" G_GINT64_FORMAT " us, "
+			"%u in flight, %u queued", p->slot,
+			message->serial_no,
+			request_id_to_string(p, message->req),
+			g_get_monotonic_time() - req->sent_time,
+			g_hash_table_size(p->out_table),
+			g_queue_get_length(p->command_queue));
 
-			ril_request_destroy(req);
+	if (req->callback)
+		req->callback(message, req->user_data);
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	ril_request_destroy(req);
 
-			break;
-		}
-	}
-
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
-			request_id_to_string(p, message->req),
-			message->serial_no);
+	/* gril may have been destroyed in the request callback */
+	if (p->destroyed)
+		return;
 
+	if (g_queue_peek_head(p->command_queue))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -647,73 +636,22 @@ static gboolean can_write_data(gpointer data)
 {
 	struct ril_s *ril = data;
 	struct ril_request *req;
-	gsize bytes_written, towrite, len;
-	guint qlen, oqlen;
-	gint id;
-	gboolean written = TRUE;
-	guint i, j;
+	gsize bytes_written, towrite;
 
-	qlen = g_queue_get_length(ril->command_queue);
-	if (qlen < 1)
+	/*
+	 * The head of command_queue is always the next request to send,
+	 * possibly partially written already.  Once fully written it moves
+	 * to out_table, where the response looks it up by serial.
+	 */
+	req = g_queue_peek_head(ril->command_queue);
+	if (req == NULL)
 		return FALSE;
 
-	/* if the whole request was not written */
-	if (ril->req_bytes_written != 0) {
-
-		for (i = 0; i < qlen; i++) {
-			req = g_queue_peek_nth(ril->command_queue, i);
-			if (req) {
-				id = GPOINTER_TO_INT(g_queue_peek_head(
-							ril->out_queue));
-				if (req->id == id)
-					goto out;
-			} else {
-				return FALSE;
-			}
-		}
-	}
-	/* if no requests already sent */
-	oqlen = g_queue_get_length(ril->out_queue);
-	if (oqlen < 1) {
-		req = g_queue_peek_head(ril->command_queue);
-		if (req == NULL)
-			return FALSE;
-
-		g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-		goto out;
-	}
-
-	for (i = 0; i < qlen; i++) {
-		req = g_queue_peek_nth(ril->command_queue, i);
-		if (req == NULL)
-			return FALSE;
-
-		for (j = 0; j < oqlen; j++) {
-			id = GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, j));
-			if (req->id == id) {
-				written = TRUE;
-				break;
-			} else {
-				written = FALSE;
-			}
-		}
-
-		if (written == FALSE)
-			break;
-	}
-
-	/* watcher fired though requests already written */
-	if (written == TRUE)
+	if (ril->req_bytes_written == 0 &&
+			g_hash_table_size(ril->out_table) >= RIL_MAX_IN_FLIGHT)
 		return FALSE;
 
-	g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-out:
-	len = req->data_len;
-
-	towrite = len - ril->req_bytes_written;
+	towrite = req->data_len - ril->req_bytes_written;
 
 #ifdef WRITE_SCHEDULER_DEBUG
 	if (towrite > 5)
@@ -730,10 +668,17 @@ out:
 	ril->req_bytes_written += bytes_written;
 	if (bytes_written < towrite)
 		return TRUE;
-	else
-		ril->req_bytes_written = 0;
 
-	return FALSE;
+	ril->req_bytes_written = 0;
+	req->sent_time = g_get_monotonic_time();
+
+	g_queue_pop_head(ril->command_queue);
+	g_hash_table_insert(ril->out_table, GINT_TO_POINTER(req->id), req);
+
+	if (g_queue_peek_head(ril->command_queue) == NULL)
+		return FALSE;
+
+	return g_hash_table_size(ril->out_table) < RIL_MAX_IN_FLIGHT;
 }
 
 static void ril_wakeup_writer(struct ril_s *ril)
@@ -882,11 +827,7 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 		goto error;
 	}
 
-	ril->out_queue = g_queue_new();
-	if (ril->out_queue == NULL) {
-		ofono_error("create_ril: Couldn't create out_queue.");
-		goto error;
-	}
+	ril->out_table = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
@@ -925,38 +866,39 @@ static struct ril_notify *ril_notify_create(struct ril_s *ril,
 
 static void ril_cancel_group(struct ril_s *ril, guint group)
 {
-	int n = 0;
-	guint len, i;
+	GHashTableIter iter;
+	gpointer value;
 	struct ril_request *req;
-	gboolean sent;
+	GList *l, *next;
 
 	if (ril->command_queue == NULL)
 		return;
 
-	while ((req = g_queue_peek_nth(ril->command_queue, n)) != NULL) {
-		if (req->id == 0 || req->gid != group) {
-			n += 1;
+	/* Requests already sent stay around until rild answers them */
+	g_hash_table_iter_init(&iter, ril->out_table);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		req = value;
+
+		if (req->gid == group)
+			req->callback = NULL;
+	}
+
+	for (l = ril->command_queue->head; l; l = next) {
+		next = l->next;
+		req = l->data;
+
+		if (req->id == 0 || req->gid != group)
 			continue;
-		}
 
 		req->callback = NULL;
-		sent = FALSE;
-
-		len = g_queue_get_length(ril->out_queue);
-		for (i = 0; i < len; i++) {
-			if (GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, i))
-					== req->id) {
-				n += 1;
-				sent = TRUE;
-				break;
-			}
-		 }
 
-		if (sent)
+		/* The head may be partially written already */
+		if (l == ril->command_queue->head &&
+				ril->req_bytes_written != 0)
 			continue;
 
-		g_queue_remove(ril->command_queue, req);
+		g_queue_delete_link(ril->command_queue, l);
 		ril_request_destroy(req);
 	}
 }
@@ -44,32 +44,64 @@
 
 #define PAD_SIZE(s) (((s)+3)&~3)
 
+/*
+ * Initial capacity of a parcel, large enough for the vast majority of
+ * requests.  Buffers of this size are recycled through a small pool
+ * rather than returned to the allocator.
+ */
+#define PARCEL_INITIAL_SIZE 256
+#define PARCEL_POOL_SIZE 8
+
 typedef uint16_t char16_t;
 
+static char *parcel_pool[PARCEL_POOL_SIZE];
+static unsigned int parcel_pool_len;
+
 void parcel_init(struct parcel *p)
 {
-	p->data = g_malloc0(sizeof(int32_t));
+	if (parcel_pool_len > 0)
+		p->data = parcel_pool[--parcel_pool_len];
+	else
+		p->data = g_malloc(PARCEL_INITIAL_SIZE);
+
 	p->size = 0;
-	p->capacity = sizeof(int32_t);
+	p->capacity = PARCEL_INITIAL_SIZE;
 	p->offset = 0;
 	p->malformed = 0;
 }
 
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t capacity = p->capacity * 2;
+
+	if (capacity < p->capacity + size)
+		capacity = p->capacity + size;
+
+	p->data = g_realloc(p->data, capacity);
+	p->capacity = capacity;
 }
 
 void parcel_free(struct parcel *p)
 {
-	g_free(p->data);
+	if (p->capacity == PARCEL_INITIAL_SIZE &&
+			parcel_pool_len < PARCEL_POOL_SIZE)
+		parcel_pool[parcel_pool_len++] = p->data;
+	else
+		g_free(p->data);
+
+	p->data = NULL;
 	p->size = 0;
 	p->capacity = 0;
 	p->offset = 0;
 }
 
+/* Make room for len more bytes at the current offset */
+static void parcel_reserve(struct parcel *p, size_t len)
+{
+	if (p->offset + len > p->capacity)
+		parcel_grow(p, p->offset + len - p->capacity);
+}
+
 int32_t parcel_r_int32(struct parcel *p)
 {
 	int32_t ret;
@@ -90,79 +122,79 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
-
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
-		}
-	}
+	parcel_reserve(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
+
 	return 0;
 }
 
+/* Number of UTF-16 code units needed for str, or -1 if not valid UTF-8 */
+static glong utf16_len(const char *str)
+{
+	glong len = 0;
+	gunichar c;
+
+	for (; *str; str = g_utf8_next_char(str)) {
+		c = g_utf8_get_char_validated(str, -1);
+		if (c == (gunichar) -1 || c == (gunichar) -2)
+			return -1;
+
+		len += c >= 0x10000 ? 2 : 1;
+	}
+
+	return len;
+}
+
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
+	char16_t *dst;
+	glong len16;
 	size_t len;
-	size_t gs16_size;
+	size_t padded;
+	gunichar c;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
+	len16 = utf16_len(str);
+	if (len16 < 0) {
+		ofono_error("%s: wrong UTF8 coding", __func__);
+		parcel_w_int32(p, -1);
+		return -1;
+	}
 
-	if (parcel_w_int32(p, gs16_len) == -1)
+	if (parcel_w_int32(p, len16) == -1)
 		return -1;
 
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	/* Encode straight into the parcel, NUL terminated and padded */
+	len = (len16 + 1) * sizeof(char16_t);
+	padded = PAD_SIZE(len);
+	parcel_reserve(p, padded);
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
+	dst = (char16_t *) (void *) (p->data + p->offset);
 
+	for (; *str; str = g_utf8_next_char(str)) {
+		c = g_utf8_get_char(str);
+
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			*dst++ = 0xd800 + (c >> 10);
+			*dst++ = 0xdc00 + (c & 0x3ff);
 		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
+			*dst++ = c;
 		}
 	}
 
-	g_free(gs16);
+	memset(dst, 0, padded - len + sizeof(char16_t));
+
+	p->offset += padded;
+	p->size += padded;
+
 	return 0;
 }
 
@@ -228,20 +260,12 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 	}
 
 	parcel_w_int32(p, len);
+	parcel_reserve(p, len);
 
-	for (;;) {
+	memcpy(p->data + p->offset, data, len);
+	p->offset += len;
+	p->size += len;
 
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += len;
-			p->size += len;
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, len);
-		}
-	}
 	return 0;
 }
 
@@ -174,6 +174,14 @@ const char *ofono_dbus_access_method_name(enum ofono_dbus_access_intf intf,
 ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
 	enum ofono_dbus_access_intf iface, int method, const char *arg);
 
+/*
+ * Since 1.29+git9
+ *
+ * Verdicts are cached per sender until it leaves the bus. Plugins
+ * must call this when their policy changes. NULL flushes everything.
+ */
+void ofono_dbus_access_flush(const char *sender);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,11 @@ ofono_bool_t ofono_dbus_clients_remove(struct ofono_dbus_clients *clients,
 
 void ofono_dbus_clients_signal(struct ofono_dbus_clients *clients,
 							DBusMessage *signal);
+/*
+ * PropertyChanged signals are sent from an idle callback, a newer value
+ * of the same property replaces the one which hasn't been sent yet.
+ * ofono_dbus_clients_signal() sends the pending ones first.
+ */
 void ofono_dbus_clients_signal_property_changed(struct ofono_dbus_clients *dc,
 		const char *path, const char *interface, const char *name,
 		int type, const void *value);
@@ -132,56 +132,28 @@ static void mbim_remove(struct ofono_modem *modem)
 	l_free(data);
 }
 
-static void mbim_radio_state_init_cb(struct mbim_message *message, void *user)
+static bool mbim_radio_state_init(struct mbim_message *message)
 {
-	struct ofono_modem *modem = user;
-	struct mbim_data *md = ofono_modem_get_data(modem);
 	uint32_t hw_state;
 	uint32_t sw_state;
 	bool r;
 
 	if (mbim_message_get_error(message) != 0)
-		goto error;
+		return false;
 
 	r = mbim_message_get_arguments(message, "uu",
 					&hw_state, &sw_state);
 	if (!r)
-		goto error;
+		return false;
 
 	/* TODO: How to handle HwRadioState != 1 */
 	DBG("HwRadioState: %u, SwRadioState: %u", hw_state, sw_state);
-	ofono_modem_set_powered(modem, TRUE);
-	return;
-
-error:
-	mbim_device_shutdown(md->device);
+	return true;
 }
 
-static void mbim_device_subscribe_list_set_cb(struct mbim_message *message,
-						void *user)
+static bool mbim_device_caps_info(struct ofono_modem *modem,
+					struct mbim_message *message)
 {
-	struct ofono_modem *modem = user;
-	struct mbim_data *md = ofono_modem_get_data(modem);
-
-	if (mbim_message_get_error(message) != 0)
-		goto error;
-
-	message = mbim_message_new(mbim_uuid_basic_connect,
-					MBIM_CID_RADIO_STATE,
-					MBIM_COMMAND_TYPE_SET);
-
-	mbim_message_set_arguments(message, "u", 0);
-	if (mbim_device_send(md->device, 0, message,
-				mbim_radio_state_init_cb, modem, NULL))
-		return;
-
-error:
-	mbim_device_shutdown(md->device);
-}
-
-static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
-{
-	struct ofono_modem *modem = user;
 	struct mbim_data *md = ofono_modem_get_data(modem);
 	uint32_t device_type;
 	uint32_t cellular_class;
@@ -198,7 +170,7 @@ static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
 	bool r;
 
 	if (mbim_message_get_error(message) != 0)
-		goto error;
+		return false;
 
 	r = mbim_message_get_arguments(message, "uuuuuuuussss",
 					&device_type, &cellular_class,
@@ -207,7 +179,7 @@ static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
 					&custom_data_class, &device_id,
 					&firmware_info, &hardware_info);
 	if (!r)
-		goto error;
+		return false;
 
 	md->max_sessions = max_sessions;
 
@@ -223,28 +195,26 @@ static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
 	l_free(firmware_info);
 	l_free(hardware_info);
 
-	message = mbim_message_new(mbim_uuid_basic_connect,
-					MBIM_CID_DEVICE_SERVICE_SUBSCRIBE_LIST,
-					MBIM_COMMAND_TYPE_SET);
+	return true;
+}
 
-	mbim_message_set_arguments(message, "av", 2,
-					"16yuuuuuuu",
-					mbim_uuid_basic_connect, 6,
-					MBIM_CID_SUBSCRIBER_READY_STATUS,
-					MBIM_CID_RADIO_STATE,
-					MBIM_CID_REGISTER_STATE,
-					MBIM_CID_PACKET_SERVICE,
-					MBIM_CID_SIGNAL_STATE,
-					MBIM_CID_CONNECT,
-					"16yuuuu", mbim_uuid_sms, 3,
-					MBIM_CID_SMS_CONFIGURATION,
-					MBIM_CID_SMS_READ,
-					MBIM_CID_SMS_MESSAGE_STORE_STATUS);
+static void mbim_device_init_cb(struct mbim_message **replies,
+					unsigned int n_replies, void *user)
+{
+	struct ofono_modem *modem = user;
+	struct mbim_data *md = ofono_modem_get_data(modem);
 
-	if (mbim_device_send(md->device, 0, message,
-				mbim_device_subscribe_list_set_cb,
-				modem, NULL))
-		return;
+	if (!mbim_device_caps_info(modem, replies[0]))
+		goto error;
+
+	if (mbim_message_get_error(replies[1]) != 0)
+		goto error;
+
+	if (!mbim_radio_state_init(replies[2]))
+		goto error;
+
+	ofono_modem_set_powered(modem, TRUE);
+	return;
 
 error:
 	mbim_device_shutdown(md->device);
@@ -265,13 +235,50 @@ static void mbim_device_ready(void *user_data)
 {
 	struct ofono_modem *modem = user_data;
 	struct mbim_data *md = ofono_modem_get_data(modem);
-	struct mbim_message *message =
-		mbim_message_new(mbim_uuid_basic_connect,
-					1, MBIM_COMMAND_TYPE_QUERY);
+	struct mbim_message *messages[3];
+	unsigned int i;
+
+	/*
+	 * None of these depend on each other's replies, submit them together
+	 * so that the device can work on them in parallel if it allows more
+	 * than one outstanding command
+	 */
+	messages[0] = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_DEVICE_CAPS,
+					MBIM_COMMAND_TYPE_QUERY);
+	mbim_message_set_arguments(messages[0], "");
+
+	messages[1] = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_DEVICE_SERVICE_SUBSCRIBE_LIST,
+					MBIM_COMMAND_TYPE_SET);
+	mbim_message_set_arguments(messages[1], "av", 2,
+					"16yuuuuuuu",
+					mbim_uuid_basic_connect, 6,
+					MBIM_CID_SUBSCRIBER_READY_STATUS,
+					MBIM_CID_RADIO_STATE,
+					MBIM_CID_REGISTER_STATE,
+					MBIM_CID_PACKET_SERVICE,
+					MBIM_CID_SIGNAL_STATE,
+					MBIM_CID_CONNECT,
+					"16yuuuu", mbim_uuid_sms, 3,
+					MBIM_CID_SMS_CONFIGURATION,
+					MBIM_CID_SMS_READ,
+					MBIM_CID_SMS_MESSAGE_STORE_STATUS);
+
+	messages[2] = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_RADIO_STATE,
+					MBIM_COMMAND_TYPE_SET);
+	mbim_message_set_arguments(messages[2], "u", 0);
+
+	if (mbim_device_send_batch(md->device, 0, messages,
+					L_ARRAY_SIZE(messages),
+					mbim_device_init_cb, modem, NULL))
+		return;
 
-	mbim_message_set_arguments(message, "");
-	mbim_device_send(md->device, 0, message,
-				mbim_device_caps_info_cb, modem, NULL);
+	for (i = 0; i < L_ARRAY_SIZE(messages); i++)
+		mbim_message_unref(messages[i]);
+
+	mbim_device_shutdown(md->device);
 }
 
 static int mbim_enable(struct ofono_modem *modem)
@@ -29,6 +29,7 @@ typedef struct cell_entry {
 	guint cell_id;
 	char *path;
 	struct ofono_cell cell;
+	gboolean removed;
 } CellEntry;
 
 typedef struct cell_info_dbus {
@@ -39,13 +40,35 @@ typedef struct cell_info_dbus {
 	gulong handler_id;
 	guint next_cell_id;
 	GSList *entries;
+	GPtrArray *sorted; /* Entries sorted by location */
 	struct ofono_dbus_clients *clients;
+	struct ofono_dbus_clients *subscriber_clients;
+	GHashTable *subscribers;
 } CellInfoDBus;
 
+/* Client receiving CellsChanged, also the update interval request tag */
+typedef struct cell_info_subscriber {
+	CellInfoDBus *dbus;
+	char *name;
+} CellInfoSubscriber;
+
+/* Cell reported by the modem along with its position in the report */
+typedef struct cell_sort_item {
+	const struct ofono_cell *cell;
+	guint index;
+} CellSortItem;
+
+typedef struct cell_update {
+	CellEntry *entry;
+	int diff;
+} CellUpdate;
+
 #define CELL_INFO_DBUS_INTERFACE            "org.nemomobile.ofono.CellInfo"
 #define CELL_INFO_DBUS_CELLS_ADDED_SIGNAL   "CellsAdded"
 #define CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL "CellsRemoved"
+#define CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL "CellsChanged"
 #define CELL_INFO_DBUS_UNSUBSCRIBED_SIGNAL  "Unsubscribed"
+#define CELL_INFO_DBUS_UPDATE_INTERVAL      (5000) /* ms */
 
 #define CELL_DBUS_INTERFACE_VERSION         (1)
 #define CELL_DBUS_INTERFACE                 "org.nemomobile.ofono.Cell"
@@ -129,10 +152,28 @@ static const struct cell_property cell_nr_properties [] = {
 typedef void (*cell_info_dbus_append_fn)(DBusMessageIter *it,
 	const CellEntry *entry);
 
-static void cell_info_dbus_set_updates_enabled(CellInfoDBus *dbus, gboolean on)
+static void cell_info_dbus_update_control(CellInfoDBus *dbus)
 {
-	cell_info_control_set_enabled(dbus->ctl, dbus, on);
-	cell_info_control_set_update_interval(dbus->ctl, dbus, on ? 5000 : -1);
+	const gboolean legacy = ofono_dbus_clients_count(dbus->clients) > 0;
+
+	/*
+	 * GetCells clients get the default interval, subscribers have
+	 * requested their own under their own tags. The control picks
+	 * the shortest one.
+	 */
+	cell_info_control_set_enabled(dbus->ctl, dbus, legacy ||
+		g_hash_table_size(dbus->subscribers));
+	cell_info_control_set_update_interval(dbus->ctl, dbus,
+		legacy ? CELL_INFO_DBUS_UPDATE_INTERVAL : -1);
+}
+
+static void cell_info_dbus_subscriber_free(gpointer data)
+{
+	CellInfoSubscriber *sub = data;
+
+	cell_info_control_drop_requests(sub->dbus->ctl, sub);
+	g_free(sub->name);
+	g_free(sub);
 }
 
 static const char *cell_info_dbus_cell_type_str(enum ofono_cell_type type)
@@ -341,54 +382,35 @@ static guint cell_info_dbus_next_cell_id(CellInfoDBus *dbus)
 	return dbus->next_cell_id++;
 }
 
-static const struct ofono_cell *cell_info_dbus_find_ofono_cell
-	(struct ofono_cell_info *info, const struct ofono_cell *cell)
+static void cell_info_dbus_append_path_list(DBusMessageIter *it,
+	GPtrArray *list)
 {
-	const ofono_cell_ptr *c;
-
-	for (c = info->cells; *c; c++) {
-		if (!ofono_cell_compare_location(*c, cell)) {
-			return *c;
-		}
-	}
-	return NULL;
-}
+	DBusMessageIter a;
 
-static CellEntry *cell_info_dbus_find_cell(CellInfoDBus *dbus,
-	const struct ofono_cell *cell)
-{
-	if (cell) {
-		GSList *l;
+	dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "o", &a);
+	if (list) {
+		guint i;
 
-		for (l = dbus->entries; l; l = l->next) {
-			CellEntry *e = l->data;
+		for (i = 0; i < list->len; i++) {
+			const char* path = list->pdata[i];
 
-			if (!ofono_cell_compare_location(&e->cell, cell)) {
-				return e;
-			}
+			dbus_message_iter_append_basic(&a,
+				DBUS_TYPE_OBJECT_PATH, &path);
 		}
 	}
-	return NULL;
+	dbus_message_iter_close_container(it, &a);
 }
 
 static void cell_info_dbus_emit_path_list(CellInfoDBus *dbus, const char *name,
 	GPtrArray *list)
 {
 	if (ofono_dbus_clients_count(dbus->clients)) {
-		guint i;
-		DBusMessageIter it, a;
+		DBusMessageIter it;
 		DBusMessage *signal = dbus_message_new_signal(dbus->path,
 			CELL_INFO_DBUS_INTERFACE, name);
 
 		dbus_message_iter_init_append(signal, &it);
-		dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "o", &a);
-		for (i = 0; i < list->len; i++) {
-			const char* path = list->pdata[i];
-
-			dbus_message_iter_append_basic(&a,
-				DBUS_TYPE_OBJECT_PATH, &path);
-		}
-		dbus_message_iter_close_container(&it, &a);
+		cell_info_dbus_append_path_list(&it, list);
 		ofono_dbus_clients_signal(dbus->clients, signal);
 		dbus_message_unref(signal);
 	}
@@ -476,65 +498,207 @@ static void cell_info_dbus_property_changed(CellInfoDBus *dbus,
 	}
 }
 
+static void cell_info_dbus_append_changed_properties(DBusMessageIter *it,
+	const CellEntry *entry, int mask)
+{
+	int i, n;
+	DBusMessageIter dict;
+	const struct ofono_cell *cell = &entry->cell;
+	const struct cell_property *prop =
+		cell_info_dbus_cell_properties(cell->type, &n);
+
+	dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "{sv}", &dict);
+	for (i = 0; i < n && mask; i++) {
+		if (mask & prop[i].flag) {
+			ofono_dbus_dict_append(&dict, prop[i].name,
+				prop[i].type,
+				G_STRUCT_MEMBER_P(&cell->info, prop[i].off));
+			mask &= ~prop[i].flag;
+		}
+	}
+	dbus_message_iter_close_container(it, &dict);
+}
+
+static void cell_info_dbus_emit_cells_changed(CellInfoDBus *dbus,
+	GPtrArray *added, GPtrArray *removed, GArray *changed)
+{
+	guint i;
+	DBusMessageIter it, a;
+	DBusMessage *signal = dbus_message_new_signal(dbus->path,
+		CELL_INFO_DBUS_INTERFACE, CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL);
+
+	dbus_message_iter_init_append(signal, &it);
+	cell_info_dbus_append_path_list(&it, added);
+	cell_info_dbus_append_path_list(&it, removed);
+	dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "(oba{sv})",
+		&a);
+	for (i = 0; i < changed->len; i++) {
+		const CellUpdate *update = &g_array_index(changed, CellUpdate, i);
+		const CellEntry *entry = update->entry;
+		const dbus_bool_t registered = (entry->cell.registered != FALSE);
+		DBusMessageIter s;
+
+		dbus_message_iter_open_container(&a, DBUS_TYPE_STRUCT, NULL,
+			&s);
+		dbus_message_iter_append_basic(&s, DBUS_TYPE_OBJECT_PATH,
+			&entry->path);
+		dbus_message_iter_append_basic(&s, DBUS_TYPE_BOOLEAN,
+			&registered);
+		cell_info_dbus_append_changed_properties(&s, entry,
+			update->diff);
+		dbus_message_iter_close_container(&a, &s);
+	}
+	dbus_message_iter_close_container(&it, &a);
+	ofono_dbus_clients_signal(dbus->subscriber_clients, signal);
+	dbus_message_unref(signal);
+}
+
+static int cell_info_dbus_sort_compare(const void *a, const void *b)
+{
+	const CellSortItem *c1 = a;
+	const CellSortItem *c2 = b;
+	const int diff = ofono_cell_compare_location(c1->cell, c2->cell);
+
+	/* Keep the reported order of cells sharing the same location */
+	return diff ? diff : ((c1->index < c2->index) ? -1 : 1);
+}
+
+static void cell_info_dbus_update_entry(CellEntry *entry,
+	const struct ofono_cell *cell, GArray *changed)
+{
+	if (changed) {
+		const int diff = cell_info_dbus_compare(cell, &entry->cell);
+
+		if (diff) {
+			CellUpdate *last = changed->len ? &g_array_index
+				(changed, CellUpdate, changed->len - 1) : NULL;
+
+			/* Same location may be reported more than once */
+			if (last && last->entry == entry) {
+				last->diff |= diff;
+			} else {
+				CellUpdate update;
+
+				update.entry = entry;
+				update.diff = diff;
+				g_array_append_val(changed, update);
+			}
+		}
+	}
+	entry->cell = *cell;
+}
+
 static void cell_info_dbus_update_entries(CellInfoDBus *dbus, gboolean emit)
 {
-	GSList *l;
-	GPtrArray* added = NULL;
-	GPtrArray* removed = NULL;
-	const ofono_cell_ptr *c;
+	const ofono_cell_ptr *cells = dbus->info->cells;
+	GPtrArray *old_sorted = dbus->sorted;
+	GPtrArray *gone = g_ptr_array_new();
+	GPtrArray *added = NULL;
+	GPtrArray *removed = NULL;
+	GArray *changed = emit ? g_array_new(FALSE, FALSE,
+		sizeof(CellUpdate)) : NULL;
+	CellEntry **created;
+	CellEntry *last = NULL;
+	CellSortItem *sorted_cells;
+	GSList *l, *entries = NULL;
+	guint i, j, n;
+
+	/*
+	 * Both the reported cells and the existing entries are put
+	 * in the location order, which turns the diff into a single
+	 * merge pass.
+	 */
+	for (n = 0; cells[n]; n++);
+	sorted_cells = g_new(CellSortItem, n);
+	for (j = 0; j < n; j++) {
+		sorted_cells[j].cell = cells[j];
+		sorted_cells[j].index = j;
+	}
+	qsort(sorted_cells, n, sizeof(CellSortItem),
+		cell_info_dbus_sort_compare);
+
+	created = g_new0(CellEntry*, n);
+	dbus->sorted = g_ptr_array_sized_new(n);
+
+	i = j = 0;
+	while (i < old_sorted->len || j < n) {
+		CellEntry *entry = (i < old_sorted->len) ?
+			old_sorted->pdata[i] : NULL;
+		const struct ofono_cell *cell = (j < n) ?
+			sorted_cells[j].cell : NULL;
+
+		if (entry && (!cell ||
+			ofono_cell_compare_location(&entry->cell, cell) < 0)) {
+			/* Not reported anymore */
+			entry->removed = TRUE;
+			g_ptr_array_add(gone, entry);
+			i++;
+		} else if (last &&
+			!ofono_cell_compare_location(&last->cell, cell)) {
+			cell_info_dbus_update_entry(last, cell, changed);
+			j++;
+		} else if (entry &&
+			!ofono_cell_compare_location(&entry->cell, cell)) {
+			cell_info_dbus_update_entry(entry, cell, changed);
+			g_ptr_array_add(dbus->sorted, entry);
+			last = entry;
+			i++;
+			j++;
+		} else {
+			/* Registered below, in the reported order */
+			last = g_new0(CellEntry, 1);
+			last->cell = *cell;
+			created[sorted_cells[j].index] = last;
+			g_ptr_array_add(dbus->sorted, last);
+			j++;
+		}
+	}
 
-	/* Remove non-existent cells */
-	l = dbus->entries;
-	while (l) {
-		GSList *next = l->next;
+	/* Drop the removed entries, keeping the order of the rest */
+	for (l = dbus->entries; l; l = l->next) {
 		CellEntry *entry = l->data;
 
-		if (!cell_info_dbus_find_ofono_cell(dbus->info, &entry->cell)) {
-			DBG("%s removed", entry->path);
-			dbus->entries = g_slist_delete_link(dbus->entries, l);
-			cell_info_dbus_emit_signal(dbus, entry->path,
-				CELL_DBUS_INTERFACE,
-				CELL_DBUS_REMOVED_SIGNAL,
-				DBUS_TYPE_INVALID);
-			g_dbus_unregister_interface(dbus->conn, entry->path,
-				CELL_DBUS_INTERFACE);
-			if (emit) {
-				if (!removed) {
-					removed = g_ptr_array_new_with_free_func
-						(g_free);
-				}
-				/* Steal the path */
-				g_ptr_array_add(removed, entry->path);
-				entry->path = NULL;
+		if (!entry->removed) {
+			entries = g_slist_prepend(entries, entry);
+		}
+	}
+	g_slist_free(dbus->entries);
+	dbus->entries = g_slist_reverse(entries);
+
+	/* Remove non-existent cells */
+	for (i = 0; i < gone->len; i++) {
+		CellEntry *entry = gone->pdata[i];
+
+		DBG("%s removed", entry->path);
+		cell_info_dbus_emit_signal(dbus, entry->path,
+			CELL_DBUS_INTERFACE,
+			CELL_DBUS_REMOVED_SIGNAL,
+			DBUS_TYPE_INVALID);
+		g_dbus_unregister_interface(dbus->conn, entry->path,
+			CELL_DBUS_INTERFACE);
+		if (emit) {
+			if (!removed) {
+				removed = g_ptr_array_new_with_free_func
+					(g_free);
 			}
-			cell_info_destroy_entry(entry);
+			/* Steal the path */
+			g_ptr_array_add(removed, entry->path);
+			entry->path = NULL;
 		}
-		l = next;
+		cell_info_destroy_entry(entry);
 	}
+	g_ptr_array_free(gone, TRUE);
 
 	/* Add new cells */
-	for (c = dbus->info->cells; *c; c++) {
-		const struct ofono_cell *cell = *c;
-		CellEntry *entry = cell_info_dbus_find_cell(dbus, cell);
+	entries = NULL;
+	for (j = 0; j < n; j++) {
+		CellEntry *entry = created[j];
 
 		if (entry) {
-			if (emit) {
-				const int diff = cell_info_dbus_compare(cell,
-					&entry->cell);
-
-				entry->cell = *cell;
-				cell_info_dbus_property_changed(dbus, entry,
-					diff);
-			} else {
-				entry->cell = *cell;
-			}
-		} else {
-			entry = g_new0(CellEntry, 1);
-			entry->cell = *cell;
 			entry->cell_id = cell_info_dbus_next_cell_id(dbus);
 			entry->path = g_strdup_printf("%s/cell_%u", dbus->path,
 				entry->cell_id);
-			dbus->entries = g_slist_append(dbus->entries, entry);
+			entries = g_slist_prepend(entries, entry);
 			DBG("%s added", entry->path);
 			g_dbus_register_interface(dbus->conn, entry->path,
 				CELL_DBUS_INTERFACE,
@@ -549,18 +713,51 @@ static void cell_info_dbus_update_entries(CellInfoDBus *dbus, gboolean emit)
 			}
 		}
 	}
+	dbus->entries = g_slist_concat(dbus->entries,
+		g_slist_reverse(entries));
+
+	g_ptr_array_free(old_sorted, TRUE);
+	g_free(sorted_cells);
+	g_free(created);
+
+	if (changed && ofono_dbus_clients_count(dbus->clients)) {
+		for (i = 0; i < changed->len; i++) {
+			const CellUpdate *update =
+				&g_array_index(changed, CellUpdate, i);
+
+			cell_info_dbus_property_changed(dbus, update->entry,
+				update->diff);
+		}
+	}
 
 	if (removed) {
 		cell_info_dbus_emit_path_list(dbus,
 			CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL, removed);
-		g_ptr_array_free(removed, TRUE);
 	}
 
 	if (added) {
 		cell_info_dbus_emit_path_list(dbus,
 			CELL_INFO_DBUS_CELLS_ADDED_SIGNAL, added);
+	}
+
+	/* Subscribers get everything in one go */
+	if (ofono_dbus_clients_count(dbus->subscriber_clients) &&
+		(added || removed || (changed && changed->len))) {
+		cell_info_dbus_emit_cells_changed(dbus, added, removed,
+			changed);
+	}
+
+	if (removed) {
+		g_ptr_array_free(removed, TRUE);
+	}
+
+	if (added) {
 		g_ptr_array_free(added, TRUE);
 	}
+
+	if (changed) {
+		g_array_free(changed, TRUE);
+	}
 }
 
 static void cell_info_dbus_cells_changed_cb(struct ofono_cell_info *info,
@@ -577,6 +774,25 @@ static DBusMessage *cell_info_dbus_error_failed(DBusMessage *msg,
 								explanation);
 }
 
+static DBusMessage *cell_info_dbus_cells_reply(CellInfoDBus *dbus,
+	DBusMessage *msg)
+{
+	DBusMessage *reply = dbus_message_new_method_return(msg);
+	DBusMessageIter it, a;
+	GSList *l;
+
+	dbus_message_iter_init_append(reply, &it);
+	dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "o", &a);
+	for (l = dbus->entries; l; l = l->next) {
+		const CellEntry *entry = l->data;
+
+		dbus_message_iter_append_basic(&a,
+				DBUS_TYPE_OBJECT_PATH, &entry->path);
+	}
+	dbus_message_iter_close_container(&it, &a);
+	return reply;
+}
+
 static DBusMessage *cell_info_dbus_get_cells(DBusConnection *conn,
 	DBusMessage *msg, void *data)
 {
@@ -584,21 +800,38 @@ static DBusMessage *cell_info_dbus_get_cells(DBusConnection *conn,
 	const char *sender = dbus_message_get_sender(msg);
 
 	if (ofono_dbus_clients_add(dbus->clients, sender)) {
-		DBusMessage *reply = dbus_message_new_method_return(msg);
-		DBusMessageIter it, a;
-		GSList *l;
+		cell_info_dbus_update_control(dbus);
+		return cell_info_dbus_cells_reply(dbus, msg);
+	}
+	return cell_info_dbus_error_failed(msg, "Operation failed");
+}
 
-		cell_info_dbus_set_updates_enabled(dbus, TRUE);
-		dbus_message_iter_init_append(reply, &it);
-		dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "o", &a);
-		for (l = dbus->entries; l; l = l->next) {
-			const CellEntry *entry = l->data;
+static DBusMessage *cell_info_dbus_subscribe(DBusConnection *conn,
+	DBusMessage *msg, void *data)
+{
+	CellInfoDBus *dbus = data;
+	const char *sender = dbus_message_get_sender(msg);
+	dbus_int32_t ms;
 
-			dbus_message_iter_append_basic(&a,
-					DBUS_TYPE_OBJECT_PATH, &entry->path);
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INT32, &ms,
+						DBUS_TYPE_INVALID) || ms < 0) {
+		return __ofono_error_invalid_args(msg);
+	}
+
+	DBG("%s %d ms", sender, ms);
+	if (ofono_dbus_clients_add(dbus->subscriber_clients, sender)) {
+		CellInfoSubscriber *sub =
+			g_hash_table_lookup(dbus->subscribers, sender);
+
+		if (!sub) {
+			sub = g_new0(CellInfoSubscriber, 1);
+			sub->dbus = dbus;
+			sub->name = g_strdup(sender);
+			g_hash_table_insert(dbus->subscribers, sub->name, sub);
 		}
-		dbus_message_iter_close_container(&it, &a);
-		return reply;
+		cell_info_control_set_update_interval(dbus->ctl, sub, ms);
+		cell_info_dbus_update_control(dbus);
+		return cell_info_dbus_cells_reply(dbus, msg);
 	}
 	return cell_info_dbus_error_failed(msg, "Operation failed");
 }
@@ -608,16 +841,19 @@ static DBusMessage *cell_info_dbus_unsubscribe(DBusConnection *conn,
 {
 	CellInfoDBus *dbus = data;
 	const char *sender = dbus_message_get_sender(msg);
+	const gboolean polling = ofono_dbus_clients_remove(dbus->clients,
+		sender);
+	const gboolean subscribed =
+		ofono_dbus_clients_remove(dbus->subscriber_clients, sender);
 
 	DBG("%s", sender);
-	if (ofono_dbus_clients_remove(dbus->clients, sender)) {
+	if (polling || subscribed) {
 		DBusMessage *signal = dbus_message_new_signal(dbus->path,
 			CELL_INFO_DBUS_INTERFACE,
 			CELL_INFO_DBUS_UNSUBSCRIBED_SIGNAL);
 
-		if (!ofono_dbus_clients_count(dbus->clients)) {
-			cell_info_dbus_set_updates_enabled(dbus, FALSE);
-		}
+		g_hash_table_remove(dbus->subscribers, sender);
+		cell_info_dbus_update_control(dbus);
 		dbus_message_set_destination(signal, sender);
 		g_dbus_send_message(dbus->conn, signal);
 		return dbus_message_new_method_return(msg);
@@ -629,6 +865,10 @@ static const GDBusMethodTable cell_info_dbus_methods[] = {
 	{ GDBUS_METHOD("GetCells", NULL,
 			GDBUS_ARGS({ "paths", "ao" }),
 			cell_info_dbus_get_cells) },
+	{ GDBUS_METHOD("Subscribe",
+			GDBUS_ARGS({ "interval", "i" }),
+			GDBUS_ARGS({ "paths", "ao" }),
+			cell_info_dbus_subscribe) },
 	{ GDBUS_METHOD("Unsubscribe", NULL, NULL,
 			cell_info_dbus_unsubscribe) },
 	{ }
@@ -639,18 +879,27 @@ static const GDBusSignalTable cell_info_dbus_signals[] = {
 			GDBUS_ARGS({ "paths", "ao" })) },
 	{ GDBUS_SIGNAL(CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL,
 			GDBUS_ARGS({ "paths", "ao" })) },
+	{ GDBUS_SIGNAL(CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL,
+			GDBUS_ARGS({ "added", "ao" },
+			           { "removed", "ao" },
+			           { "changed", "a(oba{sv})" })) },
 	{ GDBUS_SIGNAL(CELL_INFO_DBUS_UNSUBSCRIBED_SIGNAL,
 			GDBUS_ARGS({})) },
 	{ }
 };
 
 static void cell_info_dbus_disconnect_cb(const char *name, void *data)
+{
+	cell_info_dbus_update_control((CellInfoDBus *) data);
+}
+
+static void cell_info_dbus_subscriber_disconnect_cb(const char *name,
+	void *data)
 {
 	CellInfoDBus *dbus = data;
 
-	if (!ofono_dbus_clients_count(dbus->clients)) {
-		cell_info_dbus_set_updates_enabled(dbus, FALSE);
-	}
+	g_hash_table_remove(dbus->subscribers, name);
+	cell_info_dbus_update_control(dbus);
 }
 
 CellInfoDBus *cell_info_dbus_new(struct ofono_modem *modem,
@@ -665,6 +914,9 @@ CellInfoDBus *cell_info_dbus_new(struct ofono_modem *modem,
 		dbus->conn = dbus_connection_ref(ofono_dbus_get_connection());
 		dbus->info = ofono_cell_info_ref(info);
 		dbus->ctl = cell_info_control_ref(ctl);
+		dbus->sorted = g_ptr_array_new();
+		dbus->subscribers = g_hash_table_new_full(g_str_hash,
+			g_str_equal, NULL, cell_info_dbus_subscriber_free);
 		dbus->handler_id = ofono_cell_info_add_change_handler(info,
 			cell_info_dbus_cells_changed_cb, dbus);
 
@@ -679,6 +931,9 @@ CellInfoDBus *cell_info_dbus_new(struct ofono_modem *modem,
 			cell_info_dbus_update_entries(dbus, FALSE);
 			dbus->clients = ofono_dbus_clients_new(dbus->conn,
 				cell_info_dbus_disconnect_cb, dbus);
+			dbus->subscriber_clients =
+				ofono_dbus_clients_new(dbus->conn,
+				cell_info_dbus_subscriber_disconnect_cb, dbus);
 			return dbus;
 		} else {
 			ofono_error("CellInfo D-Bus register failed");
@@ -695,6 +950,7 @@ void cell_info_dbus_free(CellInfoDBus *dbus)
 
 		DBG("%s", dbus->path);
 		ofono_dbus_clients_free(dbus->clients);
+		ofono_dbus_clients_free(dbus->subscriber_clients);
 		g_dbus_unregister_interface(dbus->conn, dbus->path,
 			CELL_INFO_DBUS_INTERFACE);
 
@@ -708,12 +964,14 @@ void cell_info_dbus_free(CellInfoDBus *dbus)
 			l = l->next;
 		}
 		g_slist_free(dbus->entries);
+		g_ptr_array_free(dbus->sorted, TRUE);
 
 		dbus_connection_unref(dbus->conn);
 
 		ofono_cell_info_remove_handler(dbus->info, dbus->handler_id);
 		ofono_cell_info_unref(dbus->info);
 
+		g_hash_table_destroy(dbus->subscribers);
 		cell_info_control_drop_requests(dbus->ctl, dbus);
 		cell_info_control_unref(dbus->ctl);
 
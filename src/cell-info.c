@@ -81,7 +81,8 @@ int ofono_cell_compare_location(const struct ofono_cell *c1,
 			} else if (n1->mnc != n2->mnc) {
 				return n1->mnc - n2->mnc;
 			} else if (n1->nci != n2->nci) {
-				return n1->nci - n2->nci;
+				/* 36-bit value, the difference may not fit */
+				return (n1->nci < n2->nci) ? -1 : 1;
 			} else if (n1->pci != n2->pci) {
 				return n1->pci - n2->pci;
 			} else {
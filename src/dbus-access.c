@@ -19,7 +19,28 @@
 #include <errno.h>
 #include <string.h>
 
+#include <gdbus.h>
+
+/*
+ * Verdicts are cached per sender. Unique bus names are never reused
+ * and their credentials don't change, so an entry stays valid until
+ * the sender leaves the bus or the set of plugins (or their policy)
+ * changes. Calls with an argument aren't cached, the argument can be
+ * anything.
+ */
+struct dbus_access_sender {
+	char *name;
+	guint watch_id;
+	GHashTable *verdicts;
+};
+
+#define DBUS_ACCESS_KEY(intf,method) \
+	GUINT_TO_POINTER(((guint)(intf) << 16) | (guint)(method))
+
 static GSList *dbus_access_plugins = NULL;
+static GHashTable *dbus_access_senders = NULL;
+static unsigned int dbus_access_cache_hits;
+static unsigned int dbus_access_cache_misses;
 
 const char *ofono_dbus_access_intf_name(enum ofono_dbus_access_intf intf)
 {
@@ -208,7 +229,62 @@ const char *ofono_dbus_access_method_name(enum ofono_dbus_access_intf intf,
 	return NULL;
 }
 
-ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+static void dbus_access_sender_free(gpointer data)
+{
+	struct dbus_access_sender *entry = data;
+
+	if (entry->watch_id) {
+		g_dbus_remove_watch(ofono_dbus_get_connection(),
+							entry->watch_id);
+	}
+	g_hash_table_destroy(entry->verdicts);
+	g_free(entry->name);
+	g_slice_free(struct dbus_access_sender, entry);
+}
+
+static void dbus_access_sender_gone(DBusConnection *conn, void *user_data)
+{
+	struct dbus_access_sender *entry = user_data;
+
+	DBG("%s is gone", entry->name);
+	g_hash_table_remove(dbus_access_senders, entry->name);
+}
+
+static struct dbus_access_sender *dbus_access_sender_get(const char *sender)
+{
+	struct dbus_access_sender *entry;
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	if (!conn) {
+		return NULL;
+	}
+
+	if (dbus_access_senders) {
+		entry = g_hash_table_lookup(dbus_access_senders, sender);
+		if (entry) {
+			return entry;
+		}
+	} else {
+		dbus_access_senders = g_hash_table_new_full(g_str_hash,
+				g_str_equal, NULL, dbus_access_sender_free);
+	}
+
+	entry = g_slice_new0(struct dbus_access_sender);
+	entry->name = g_strdup(sender);
+	entry->verdicts = g_hash_table_new(g_direct_hash, g_direct_equal);
+	entry->watch_id = g_dbus_add_disconnect_watch(conn, entry->name,
+				dbus_access_sender_gone, entry, NULL);
+	if (!entry->watch_id) {
+		/* Can't tell when the cached verdicts would become stale */
+		dbus_access_sender_free(entry);
+		return NULL;
+	}
+
+	g_hash_table_insert(dbus_access_senders, entry->name, entry);
+	return entry;
+}
+
+static ofono_bool_t dbus_access_check(const char *sender,
 					enum ofono_dbus_access_intf intf,
 					int method, const char *arg)
 {
@@ -233,6 +309,60 @@ ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
 	return TRUE;
 }
 
+ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+					enum ofono_dbus_access_intf intf,
+					int method, const char *arg)
+{
+	struct dbus_access_sender *entry;
+	gpointer key, value;
+	ofono_bool_t allowed;
+
+	if (!dbus_access_plugins || arg || !sender ||
+			!ofono_dbus_access_method_name(intf, method)) {
+		return dbus_access_check(sender, intf, method, arg);
+	}
+
+	entry = dbus_access_sender_get(sender);
+	if (!entry) {
+		return dbus_access_check(sender, intf, method, arg);
+	}
+
+	key = DBUS_ACCESS_KEY(intf, method);
+	if (g_hash_table_lookup_extended(entry->verdicts, key, NULL, &value)) {
+		dbus_access_cache_hits++;
+		return GPOINTER_TO_INT(value);
+	}
+
+	dbus_access_cache_misses++;
+	allowed = dbus_access_check(sender, intf, method, arg);
+	g_hash_table_insert(entry->verdicts, key, GINT_TO_POINTER(allowed));
+	return allowed;
+}
+
+void ofono_dbus_access_flush(const char *sender)
+{
+	if (dbus_access_senders) {
+		if (sender) {
+			g_hash_table_remove(dbus_access_senders, sender);
+		} else {
+			DBG("");
+			g_hash_table_destroy(dbus_access_senders);
+			dbus_access_senders = NULL;
+		}
+	}
+}
+
+void __ofono_dbus_access_cache_stats(unsigned int *hits,
+						unsigned int *misses)
+{
+	if (hits) {
+		*hits = dbus_access_cache_hits;
+	}
+	if (misses) {
+		*misses = dbus_access_cache_misses;
+	}
+}
+
 /**
  * Returns 0 if both are equal;
  * <0 if a comes before b;
@@ -266,6 +396,7 @@ int ofono_dbus_access_plugin_register
 		DBG("%s", plugin->name);
 		dbus_access_plugins = g_slist_insert_sorted(dbus_access_plugins,
 				(void*)plugin, ofono_dbus_access_plugin_sort);
+		ofono_dbus_access_flush(NULL);
 		return 0;
 	}
 }
@@ -277,6 +408,7 @@ void ofono_dbus_access_plugin_unregister
 		DBG("%s", plugin->name);
 		dbus_access_plugins = g_slist_remove(dbus_access_plugins,
 								plugin);
+		ofono_dbus_access_flush(NULL);
 	}
 }
 
@@ -24,13 +24,29 @@ struct ofono_dbus_client {
 	unsigned int watch_id;
 };
 
+/* PropertyChanged signal waiting to be sent */
+struct ofono_dbus_clients_pending {
+	char *name;
+	DBusMessage *signal;
+};
+
 struct ofono_dbus_clients {
 	DBusConnection* conn;
 	GHashTable* table;
 	ofono_dbus_clients_notify_func notify;
 	void *user_data;
+	GSList *pending;
+	guint flush_id;
 };
 
+/*
+ * If this much is sitting in the outgoing queue, the bus isn't reading
+ * from us fast enough. Property changes are then held back (and keep
+ * superseding each other) until the queue drains.
+ */
+#define DBUS_CLIENTS_OUTGOING_LIMIT	(256 * 1024)
+#define DBUS_CLIENTS_BACKOFF_MS		(100)
+
 /* Compatible with GDestroyNotify */
 static void ofono_dbus_client_free(struct ofono_dbus_client *client)
 {
@@ -44,6 +60,118 @@ static void ofono_dbus_client_free(struct ofono_dbus_client *client)
 	g_slice_free(struct ofono_dbus_client, client);
 }
 
+static void ofono_dbus_clients_pending_free(gpointer data)
+{
+	struct ofono_dbus_clients_pending *pending = data;
+
+	dbus_message_unref(pending->signal);
+	g_free(pending->name);
+	g_slice_free(struct ofono_dbus_clients_pending, pending);
+}
+
+static void ofono_dbus_clients_send(struct ofono_dbus_clients *self,
+							DBusMessage *signal)
+{
+	const guint n = g_hash_table_size(self->table);
+	GHashTableIter it;
+	gpointer key;
+	guint i = 0;
+
+	g_hash_table_iter_init(&it, self->table);
+	while (g_hash_table_iter_next(&it, &key, NULL)) {
+		/*
+		 * The last one gets the caller's message (which still
+		 * owns it when we are done), the others get a copy.
+		 * Copying doesn't re-marshal the body.
+		 */
+		DBusMessage *msg = (++i < n) ? dbus_message_copy(signal) :
+			dbus_message_ref(signal);
+
+		dbus_message_set_destination(msg, key);
+		if (i == 1) {
+			/*
+			 * g_dbus_send_message() validates the signal and
+			 * flushes pending gdbus property changes. That only
+			 * needs to be done once. It also drops the reference.
+			 */
+			if (!g_dbus_send_message(self->conn, msg)) {
+				break;
+			}
+		} else {
+			dbus_connection_send(self->conn, msg, NULL);
+			dbus_message_unref(msg);
+		}
+	}
+}
+
+static void ofono_dbus_clients_flush(struct ofono_dbus_clients *self)
+{
+	if (self->flush_id) {
+		g_source_remove(self->flush_id);
+		self->flush_id = 0;
+	}
+
+	while (self->pending) {
+		GSList *l = self->pending;
+		struct ofono_dbus_clients_pending *pending = l->data;
+
+		self->pending = g_slist_delete_link(l, l);
+		ofono_dbus_clients_send(self, pending->signal);
+		ofono_dbus_clients_pending_free(pending);
+	}
+}
+
+static gboolean ofono_dbus_clients_flush_cb(gpointer data)
+{
+	struct ofono_dbus_clients *self = data;
+
+	self->flush_id = 0;
+	if (dbus_connection_get_outgoing_size(self->conn) >
+					DBUS_CLIENTS_OUTGOING_LIMIT) {
+		DBG("%ld bytes queued, holding back",
+			dbus_connection_get_outgoing_size(self->conn));
+		self->flush_id = g_timeout_add(DBUS_CLIENTS_BACKOFF_MS,
+				ofono_dbus_clients_flush_cb, self);
+	} else {
+		ofono_dbus_clients_flush(self);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void ofono_dbus_clients_queue(struct ofono_dbus_clients *self,
+					DBusMessage *signal, const char *name)
+{
+	const char *path = dbus_message_get_path(signal);
+	const char *interface = dbus_message_get_interface(signal);
+	struct ofono_dbus_clients_pending *pending;
+	GSList *l;
+
+	/* The new value supersedes the one which hasn't been sent yet */
+	for (l = self->pending; l; l = l->next) {
+		pending = l->data;
+		if (!g_strcmp0(pending->name, name) &&
+			!g_strcmp0(dbus_message_get_path(pending->signal),
+								path) &&
+			!g_strcmp0(dbus_message_get_interface(pending->signal),
+								interface)) {
+			dbus_message_unref(pending->signal);
+			pending->signal = signal;
+			return;
+		}
+	}
+
+	pending = g_slice_new(struct ofono_dbus_clients_pending);
+	pending->name = g_strdup(name);
+	pending->signal = signal;
+	self->pending = g_slist_append(self->pending, pending);
+
+	/* High priority, to go out before the next incoming call is handled */
+	if (!self->flush_id) {
+		self->flush_id = g_idle_add_full(G_PRIORITY_HIGH,
+				ofono_dbus_clients_flush_cb, self, NULL);
+	}
+}
+
 static void ofono_dbus_clients_disconnect_notify(DBusConnection *connection,
 							void *user_data)
 {
@@ -86,6 +214,7 @@ struct ofono_dbus_clients *ofono_dbus_clients_new(DBusConnection *conn,
 void ofono_dbus_clients_free(struct ofono_dbus_clients *self)
 {
 	if (self) {
+		ofono_dbus_clients_flush(self);
 		g_hash_table_destroy(self->table);
 		dbus_connection_unref(self->conn);
 		g_slice_free(struct ofono_dbus_clients, self);
@@ -133,30 +262,9 @@ void ofono_dbus_clients_signal(struct ofono_dbus_clients *self,
 							DBusMessage *signal)
 {
 	if (self && signal && g_hash_table_size(self->table)) {
-		GHashTableIter it;
-		gpointer key;
-		const char *last_name = NULL;
-
-		g_hash_table_iter_init(&it, self->table);
-		g_hash_table_iter_next(&it, &key, NULL);
-		last_name = key;
-
-		while (g_hash_table_iter_next(&it, &key, NULL)) {
-			DBusMessage *copy = dbus_message_copy(signal);
-
-			dbus_message_set_destination(copy, key);
-			g_dbus_send_message(self->conn, copy);
-		}
-
-		/*
-		 * The last one. Note that g_dbus_send_message() unrefs
-		 * the message, we need compensate for that by adding a
-		 * reference. The caller still owns the message when this
-		 * function returns.
-		 */
-		dbus_message_ref(signal);
-		dbus_message_set_destination(signal, last_name);
-		g_dbus_send_message(self->conn, signal);
+		/* Preserve the order in which the signals were emitted */
+		ofono_dbus_clients_flush(self);
+		ofono_dbus_clients_send(self, signal);
 	}
 }
 
@@ -165,11 +273,10 @@ void ofono_dbus_clients_signal_property_changed(struct ofono_dbus_clients *self,
 		int type, const void *value)
 {
 	if (self && g_hash_table_size(self->table)) {
-		DBusMessage *sig = ofono_dbus_signal_new_property_changed(path,
-			interface, name, type, value);
-
-		ofono_dbus_clients_signal(self, sig);
-		dbus_message_unref(sig);
+		/* The queue takes the ownership of the signal */
+		ofono_dbus_clients_queue(self,
+			ofono_dbus_signal_new_property_changed(path,
+				interface, name, type, value), name);
 	}
 }
 
@@ -41,6 +41,9 @@
 
 #define RING_TIMEOUT 3
 
+#define EMULATOR_IPV6_LOCAL_ID "fe80::1"
+#define EMULATOR_IPV6_PEER_ID "fe80::2"
+
 #define CVSD_OFFSET 0
 #define MSBC_OFFSET 1
 #define CODECS_COUNT (MSBC_OFFSET + 1)
@@ -176,6 +179,14 @@ static void request_private_network_cb(
 	g_at_ppp_set_acfc_enabled(em->ppp, TRUE);
 	g_at_ppp_set_pfc_enabled(em->ppp, TRUE);
 
+	/*
+	 * Offer IPv6 as well, the Interface Ids only need to be unique
+	 * on the link.  Clients without IPv6 support reject IPV6CP and
+	 * carry on with IPv4 only.
+	 */
+	g_at_ppp_enable_ipv6(em->ppp, EMULATOR_IPV6_LOCAL_ID,
+					EMULATOR_IPV6_PEER_ID);
+
 	g_at_ppp_set_credentials(em->ppp, "", "");
 	g_at_ppp_set_debug(em->ppp, emulator_debug, "PPP");
 
@@ -616,6 +616,10 @@ ofono_bool_t __ofono_private_network_request(ofono_private_network_cb_t cb,
 
 
 #include <ofono/dbus-access.h>
+
+void __ofono_dbus_access_cache_stats(unsigned int *hits,
+						unsigned int *misses);
+
 #include <ofono/slot.h>
 
 void __ofono_slot_manager_init(void);
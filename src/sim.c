@@ -95,6 +95,7 @@ struct ofono_sim {
 	unsigned char efsst_length;
 
 	char *imsi;
+	char *fetched_imsi;	/* Read ahead, until initialization allows */
 	char mcc[OFONO_MAX_MCC_LENGTH + 1];
 	char mnc[OFONO_MAX_MNC_LENGTH + 1];
 	struct ofono_watchlist *imsi_watches;
@@ -141,6 +142,7 @@ struct ofono_sim {
 	GSList *aid_sessions;
 	GSList *aid_list;
 	char *impi;
+	gint64 init_start;	/* For the initialization trace */
 	bool reading_spn : 1;
 	bool language_prefs_update : 1;
 	bool fixed_dialing : 1;
@@ -148,8 +150,18 @@ struct ofono_sim {
 	bool sdn_ready : 1;
 	bool initialized : 1;
 	bool wait_initialized : 1;
+	bool imsi_requested : 1;
+	bool imsi_fetched : 1;
+	bool imsi_wanted : 1;
 };
 
+static void sim_init_trace(struct ofono_sim *sim, const char *step)
+{
+	DBG("%s: %s after %" G_GINT64_FORMAT " ms",
+			__ofono_atom_get_path(sim->atom), step,
+			(g_get_monotonic_time() - sim->init_start) / 1000);
+}
+
 struct cached_pin {
 	char *id;
 	char *pin;
@@ -1833,10 +1845,37 @@ static void sim_imsi_obtained(struct ofono_sim *sim, const char *imsi)
 	}
 
 	imsi_watches_notify(sim);
+	sim_init_trace(sim, "ready");
 	sim_set_ready(sim);
 
 }
 
+/*
+ * The IMSI is requested as soon as the PIN is verified, in parallel
+ * with the EF reads that decide whether initialization may complete.
+ * It is only acted upon once those say so, see sim_retrieve_imsi().
+ * A failed read is only reported then as well, e.g. 2G SIMs with FDN
+ * enabled are expected to refuse it before initialization stops.
+ */
+static void sim_imsi_fetched(struct ofono_sim *sim, const char *imsi)
+{
+	if (!sim->imsi_requested || sim->imsi_fetched)
+		return;
+
+	sim->imsi_fetched = true;
+	sim->fetched_imsi = l_strdup(imsi);
+
+	sim_init_trace(sim, "IMSI read");
+
+	if (!sim->imsi_wanted)
+		return;
+
+	if (sim->fetched_imsi)
+		sim_imsi_obtained(sim, sim->fetched_imsi);
+	else
+		ofono_error("Unable to read IMSI, emergency calls only");
+}
+
 static void sim_efimsi_cb(const struct ofono_error *error,
 				const unsigned char *data, int len, void *user)
 {
@@ -1869,11 +1908,11 @@ static void sim_efimsi_cb(const struct ofono_error *error,
 	if ((strlen(imsi + 1) % 2) != parity)
 		goto error;
 
-	sim_imsi_obtained(sim, imsi + 1);
+	sim_imsi_fetched(sim, imsi + 1);
 	return;
 
 error:
-	ofono_error("Unable to read IMSI, emergency calls only");
+	sim_imsi_fetched(sim, NULL);
 }
 
 static void sim_imsi_cb(const struct ofono_error *error, const char *imsi,
@@ -1882,13 +1921,13 @@ static void sim_imsi_cb(const struct ofono_error *error, const char *imsi,
 	struct ofono_sim *sim = data;
 
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_imsi_obtained(sim, imsi);
+		sim_imsi_fetched(sim, imsi);
 		return;
 	}
 
 	/* Driver function failed, try via EF reads if possible */
 	if (sim->driver->read_file_transparent == NULL) {
-		ofono_error("Unable to read IMSI, emergency calls only");
+		sim_imsi_fetched(sim, NULL);
 		return;
 	}
 
@@ -1896,8 +1935,13 @@ static void sim_imsi_cb(const struct ofono_error *error, const char *imsi,
 						NULL, 0, sim_efimsi_cb, sim);
 }
 
-static void sim_retrieve_imsi(struct ofono_sim *sim)
+static void sim_request_imsi(struct ofono_sim *sim)
 {
+	if (sim->imsi_requested)
+		return;
+
+	sim->imsi_requested = true;
+
 	if (sim->driver->read_imsi) {
 		sim->driver->read_imsi(sim, sim_imsi_cb, sim);
 		return;
@@ -1913,6 +1957,26 @@ static void sim_retrieve_imsi(struct ofono_sim *sim)
 						NULL, 0, sim_efimsi_cb, sim);
 }
 
+static void sim_retrieve_imsi(struct ofono_sim *sim)
+{
+	if (sim->imsi_wanted)
+		return;
+
+	sim_init_trace(sim, "service tables checked");
+
+	sim->imsi_wanted = true;
+
+	if (!sim->imsi_requested) {
+		sim_request_imsi(sim);
+		return;
+	}
+
+	if (sim->fetched_imsi)
+		sim_imsi_obtained(sim, sim->fetched_imsi);
+	else if (sim->imsi_fetched)
+		ofono_error("Unable to read IMSI, emergency calls only");
+}
+
 static void sim_fdn_enabled(struct ofono_sim *sim)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
@@ -2204,6 +2268,8 @@ static void sim_efphase_read_cb(int ok, int length, int record,
 
 static void sim_initialize_after_pin(struct ofono_sim *sim)
 {
+	sim_init_trace(sim, "PIN verified");
+
 	sim->context = ofono_sim_context_create(sim);
 
 	/*
@@ -2227,6 +2293,12 @@ static void sim_initialize_after_pin(struct ofono_sim *sim)
 	ofono_sim_read(sim->context, SIM_EF_CPHS_INFORMATION_FILEID,
 			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
 			sim_cphs_information_read_cb, sim);
+
+	/*
+	 * Nothing that the IMSI read depends on is pending, only its use
+	 * has to wait for the FDN and BDN checks above.
+	 */
+	sim_request_imsi(sim);
 }
 
 static void sim_efli_read_cb(int ok, int length, int record,
@@ -2383,6 +2455,7 @@ static void sim_iccid_read_cb(int ok, int length, int record,
 	extract_bcd_number(data, length, iccid);
 	iccid[20] = '\0';
 	sim->iccid = l_strdup(iccid);
+	sim_init_trace(sim, "ICCID read");
 
 	ofono_dbus_signal_property_changed(conn, path,
 						OFONO_SIM_MANAGER_INTERFACE,
@@ -2461,6 +2534,8 @@ static void sim_initialize(struct ofono_sim *sim)
 	 * in the EFust
 	 */
 
+	sim->init_start = g_get_monotonic_time();
+
 	if (sim->early_context == NULL)
 		sim->early_context = ofono_sim_context_create(sim);
 
@@ -2751,6 +2826,12 @@ static void sim_free_main_state(struct ofono_sim *sim)
 		sim->imsi = NULL;
 	}
 
+	l_free(sim->fetched_imsi);
+	sim->fetched_imsi = NULL;
+	sim->imsi_requested = false;
+	sim->imsi_fetched = false;
+	sim->imsi_wanted = false;
+
 	sim->mcc[0] = '\0';
 	sim->mnc[0] = '\0';
 
@@ -70,6 +70,7 @@ struct sim_fs_op {
 	unsigned char path_len;
 	gconstpointer cb;
 	gboolean is_read;
+	gboolean complete;
 	void *userdata;
 	struct ofono_sim_context *context;
 };
@@ -83,7 +84,9 @@ struct sim_fs {
 	GQueue *op_q;
 	gint op_source;
 	unsigned char bitmap[32];
+	gboolean bitmap_dirty;
 	int fd;
+	struct sim_fs_op *last_read;
 	struct ofono_sim *sim;
 	const struct ofono_sim_driver *driver;
 	GSList *contexts;
@@ -100,6 +103,15 @@ static void sim_fs_op_free(gpointer pointer)
 	g_free(node);
 }
 
+static void sim_fs_drop_last_read(struct sim_fs *fs)
+{
+	if (fs->last_read == NULL)
+		return;
+
+	sim_fs_op_free(fs->last_read);
+	fs->last_read = NULL;
+}
+
 void sim_fs_free(struct sim_fs *fs)
 {
 	if (fs == NULL)
@@ -119,6 +131,8 @@ void sim_fs_free(struct sim_fs *fs)
 		fs->op_q = NULL;
 	}
 
+	sim_fs_drop_last_read(fs);
+
 	while (fs->contexts)
 		sim_fs_context_free(fs->contexts->data);
 
@@ -265,6 +279,19 @@ void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 
 }
 
+/* The contents of EF id (-1 for all) must be read from the SIM again */
+static void sim_fs_forget_contents(struct sim_fs *fs, int id)
+{
+	struct sim_fs_op *op;
+
+	if (fs->last_read && (id == -1 || fs->last_read->id == id))
+		sim_fs_drop_last_read(fs);
+
+	op = fs->op_q ? g_queue_peek_head(fs->op_q) : NULL;
+	if (op && (id == -1 || op->id == id))
+		op->complete = FALSE;
+}
+
 static void sim_fs_end_current(struct sim_fs *fs)
 {
 	struct sim_fs_op *op = g_queue_pop_head(fs->op_q);
@@ -275,11 +302,31 @@ static void sim_fs_end_current(struct sim_fs *fs)
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
 	if (fs->fd != -1) {
+		/* Present bits are written once, after all of the blocks */
+		if (fs->bitmap_dirty)
+			L_TFR(pwrite(fs->fd, fs->bitmap, sizeof(fs->bitmap),
+						SIM_FILE_INFO_SIZE));
+
 		L_TFR(close(fs->fd));
 		fs->fd = -1;
 	}
 
 	memset(fs->bitmap, 0, sizeof(fs->bitmap));
+	fs->bitmap_dirty = FALSE;
+
+	/*
+	 * Keep the contents of a completed read around while more
+	 * operations are queued, so that the same EF requested again
+	 * from another context is not read from the SIM a second time.
+	 * Any write may change the contents, so forget them then.
+	 */
+	if (op->is_read == FALSE || g_queue_get_length(fs->op_q) == 0)
+		sim_fs_drop_last_read(fs);
+	else if (op->complete && op->buffer) {
+		sim_fs_drop_last_read(fs);
+		fs->last_read = op;
+		return;
+	}
 
 	sim_fs_op_free(op);
 }
@@ -309,39 +356,24 @@ static void sim_fs_op_error(struct sim_fs *fs)
 static gboolean cache_block(struct sim_fs *fs, int block, int block_len,
 				const unsigned char *data, int num_bytes)
 {
-	int offset;
-	int bit;
 	ssize_t r;
-	unsigned char b;
 
 	if (fs->fd == -1)
 		return FALSE;
 
-	if (lseek(fs->fd, block * block_len +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-		return FALSE;
-
-	r = L_TFR(write(fs->fd, data, num_bytes));
+	r = L_TFR(pwrite(fs->fd, data, num_bytes,
+				block * block_len + SIM_CACHE_HEADER_SIZE));
 
 	if (r != num_bytes)
 		return FALSE;
 
-	/* update present bit for this block */
-	offset = block / 8;
-	bit = block % 8;
-
-	/* lseek to correct byte (skip file info) */
-	lseek(fs->fd, offset + SIM_FILE_INFO_SIZE, SEEK_SET);
-
-	b = fs->bitmap[offset];
-	b |= 1 << bit;
-
-	r = L_TFR(write(fs->fd, &b, sizeof(b)));
-
-	if (r != sizeof(b))
-		return FALSE;
-
-	fs->bitmap[offset] = b;
+	/*
+	 * Update the present bit for this block, the bitmap is written
+	 * back when the operation ends.  A block is thus never marked
+	 * present on disk before its data made it there.
+	 */
+	fs->bitmap[block / 8] |= 1 << (block % 8);
+	fs->bitmap_dirty = TRUE;
 
 	return TRUE;
 }
@@ -412,6 +444,7 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 	if (op->current > end_block) {
 		ofono_sim_file_read_cb_t cb = op->cb;
 
+		op->complete = TRUE;
 		cb(1, op->num_bytes, 0, op->buffer,
 				op->record_length, op->userdata);
 
@@ -473,10 +506,8 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		DBG("bufoff: %d, seekoff: %d, toread: %d",
 				bufoff, seekoff, toread);
 
-		if (lseek(fs->fd, seekoff, SEEK_SET) == (off_t) -1)
-			break;
-
-		if (L_TFR(read(fs->fd, op->buffer + bufoff, toread)) != toread)
+		if (L_TFR(pread(fs->fd, op->buffer + bufoff, toread,
+						seekoff)) != toread)
 			break;
 
 		op->current += 1;
@@ -485,6 +516,7 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 	if (op->current > end_block) {
 		ofono_sim_file_read_cb_t cb = op->cb;
 
+		op->complete = TRUE;
 		cb(1, op->num_bytes, 0, op->buffer,
 				op->record_length, op->userdata);
 
@@ -531,12 +563,17 @@ static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
 		return;
 	}
 
+	if (op->buffer)
+		memcpy(op->buffer + (op->current - 1) * op->record_length,
+				data, op->record_length);
+
 	cb(1, op->length, op->current, data, op->record_length, op->userdata);
 
 	if (op->current < total) {
 		op->current += 1;
 		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
 	} else {
+		op->complete = TRUE;
 		sim_fs_end_current(fs);
 	}
 }
@@ -556,6 +593,10 @@ static gboolean sim_fs_op_read_record(gpointer user)
 		return FALSE;
 	}
 
+	/* Collect the records, in case the same EF is asked for again */
+	if (op->current == 1 && op->buffer == NULL)
+		op->buffer = g_try_new0(unsigned char, op->length);
+
 	while (fs->fd != -1 && op->current <= total) {
 		int offset = (op->current - 1) / 8;
 		int bit = 1 << ((op->current - 1) % 8);
@@ -564,13 +605,15 @@ static gboolean sim_fs_op_read_record(gpointer user)
 		if ((fs->bitmap[offset] & bit) == 0)
 			break;
 
-		if (lseek(fs->fd, (op->current - 1) * op->record_length +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
+		if (L_TFR(pread(fs->fd, buf, op->record_length,
+				(op->current - 1) * op->record_length +
+				SIM_CACHE_HEADER_SIZE)) != op->record_length)
 			break;
 
-		if (L_TFR(read(fs->fd, buf, op->record_length)) !=
-				op->record_length)
-			break;
+		if (op->buffer)
+			memcpy(op->buffer +
+				(op->current - 1) * op->record_length,
+				buf, op->record_length);
 
 		cb(1, op->length, op->current,
 				buf, op->record_length, op->userdata);
@@ -579,6 +622,7 @@ static gboolean sim_fs_op_read_record(gpointer user)
 	}
 
 	if (op->current > total) {
+		op->complete = TRUE;
 		sim_fs_end_current(fs);
 
 		return FALSE;
@@ -919,6 +963,83 @@ static void get_session_cb(ofono_bool_t active, int session_id,
 			op->path_len, session_read_info_cb, fs);
 }
 
+static gboolean sim_fs_op_same_read(const struct sim_fs_op *op,
+					const struct sim_fs_op *last)
+{
+	if (op->is_read == FALSE || op->info_only == TRUE)
+		return FALSE;
+
+	if (op->id != last->id || op->structure != last->structure)
+		return FALSE;
+
+	if (op->path_len != last->path_len ||
+			memcmp(op->path, last->path, op->path_len))
+		return FALSE;
+
+	if (op->structure != OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+		return TRUE;
+
+	if (op->offset != last->offset)
+		return FALSE;
+
+	/* A zero length read gets the whole file */
+	if (op->num_bytes == 0)
+		return last->num_bytes == last->length;
+
+	return op->num_bytes == last->num_bytes;
+}
+
+/*
+ * Answer a read from the contents of the previous operation on the
+ * same EF, the same way as if the EF had been read from the cache.
+ */
+static gboolean sim_fs_op_reuse_last(struct sim_fs *fs)
+{
+	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *last = fs->last_read;
+	ofono_sim_file_read_cb_t cb;
+	int total;
+
+	if (last == NULL || fs->session != NULL)
+		return FALSE;
+
+	if (sim_fs_op_same_read(op, last) == FALSE)
+		return FALSE;
+
+	DBG("fileid %04x served from the previous read", op->id);
+
+	/* Take the contents over, this op becomes the last read */
+	op->buffer = last->buffer;
+	op->length = last->length;
+	op->record_length = last->record_length;
+	op->num_bytes = last->num_bytes;
+	op->complete = TRUE;
+
+	last->buffer = NULL;
+	sim_fs_drop_last_read(fs);
+
+	if (op->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
+		cb = op->cb;
+		cb(1, op->num_bytes, 0, op->buffer,
+				op->record_length, op->userdata);
+
+		sim_fs_end_current(fs);
+		return TRUE;
+	}
+
+	total = op->length / op->record_length;
+
+	for (op->current = 1; op->cb && op->current <= total; op->current++) {
+		cb = op->cb;
+		cb(1, op->length, op->current,
+			op->buffer + (op->current - 1) * op->record_length,
+			op->record_length, op->userdata);
+	}
+
+	sim_fs_end_current(fs);
+	return TRUE;
+}
+
 static gboolean sim_fs_op_next(gpointer user_data)
 {
 	struct sim_fs *fs = user_data;
@@ -938,6 +1059,9 @@ static gboolean sim_fs_op_next(gpointer user_data)
 	}
 
 	if (op->is_read == TRUE) {
+		if (sim_fs_op_reuse_last(fs))
+			return FALSE;
+
 		if (sim_fs_op_check_cached(fs))
 			return FALSE;
 
@@ -1270,6 +1394,8 @@ void sim_fs_cache_flush(struct sim_fs *fs)
 
 	l_free(path);
 
+	sim_fs_forget_contents(fs, -1);
+
 	if (len > 0) {
 		/* Remove all file ids */
 		while (len--) {
@@ -1289,6 +1415,8 @@ void sim_fs_cache_flush_file(struct sim_fs *fs, int id)
 	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
 	char *path = l_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
 
+	sim_fs_forget_contents(fs, id);
+
 	remove(path);
 	l_free(path);
 }
@@ -40,6 +40,7 @@ struct sim_eons {
 	GSList *opl_list;
 	gboolean pnn_valid;
 	int pnn_max;
+	struct opl_index *opl_index;
 };
 
 struct spdi_operator {
@@ -55,6 +56,33 @@ struct opl_operator {
 	guint8 id;
 };
 
+/*
+ * Lookup structure built by sim_eons_optimize().  OPL records are
+ * referred to by their position in the file, the lowest position that
+ * matches wins.
+ */
+struct opl_index {
+	struct opl_operator **records;
+	int num_records;
+	GHashTable *plmns;	/* Records without wildcards, by PLMN */
+	int *wildcards;		/* Records with wildcards */
+	int num_wildcards;
+};
+
+/* All records of one PLMN, with the LAC ranges flattened */
+struct opl_plmn {
+	guint64 plmn;
+	int any_lac;		/* First record covering all LACs, or -1 */
+	struct opl_segment *segments;
+	int num_segments;
+};
+
+/* From start up to the start of the next segment, first is matched */
+struct opl_segment {
+	guint32 start;
+	int first;
+};
+
 #define MF	1
 #define DF	2
 #define EF	4
@@ -1009,6 +1037,247 @@ static void pnn_operator_free(struct sim_eons_operator_info *oper)
 	l_free(oper->longname);
 }
 
+static gboolean opl_operator_match_plmn(const struct opl_operator *opl,
+					const char *mcc, const char *mnc)
+{
+	int i;
+
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
+		if (mcc[i] != opl->mcc[i] &&
+				!(opl->mcc[i] == 'b' && mcc[i]))
+			return FALSE;
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
+		if (mnc[i] != opl->mnc[i] &&
+				!(opl->mnc[i] == 'b' && mnc[i]))
+			return FALSE;
+
+	return TRUE;
+}
+
+static inline gboolean opl_operator_any_lac(const struct opl_operator *opl)
+{
+	return opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe;
+}
+
+static gboolean opl_operator_match_lac(const struct opl_operator *opl,
+					gboolean have_lac, guint16 lac)
+{
+	if (opl_operator_any_lac(opl))
+		return TRUE;
+
+	if (have_lac == FALSE)
+		return FALSE;
+
+	return lac >= opl->lac_tac_low && lac <= opl->lac_tac_high;
+}
+
+static guint64 opl_plmn_key(const char *mcc, const char *mnc)
+{
+	guint64 key = 0;
+	int i;
+
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
+		key = (key << 8) | (guint8) mcc[i];
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
+		key = (key << 8) | (guint8) mnc[i];
+
+	return key;
+}
+
+static gboolean opl_operator_has_wildcard(const struct opl_operator *opl)
+{
+	return memchr(opl->mcc, 'b', OFONO_MAX_MCC_LENGTH) != NULL ||
+		memchr(opl->mnc, 'b', OFONO_MAX_MNC_LENGTH) != NULL;
+}
+
+static void opl_plmn_free(gpointer data)
+{
+	struct opl_plmn *plmn = data;
+
+	g_free(plmn->segments);
+	g_free(plmn);
+}
+
+static int guint32_compare(const void *a, const void *b)
+{
+	guint32 x = *(const guint32 *) a;
+	guint32 y = *(const guint32 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Split the LAC space at every range boundary of the given records and
+ * note the first record matching within each piece.  Records are in
+ * file order, so the first match is the first hit.
+ */
+static void opl_plmn_build_segments(struct opl_plmn *plmn,
+					struct opl_operator **records,
+					const int *members, int num_members)
+{
+	guint32 *bounds = g_new(guint32, 2 * num_members + 1);
+	int num_bounds = 0;
+	int i, j;
+
+	bounds[num_bounds++] = 0;
+
+	for (i = 0; i < num_members; i++) {
+		const struct opl_operator *opl = records[members[i]];
+
+		if (opl_operator_any_lac(opl) ||
+				opl->lac_tac_low > opl->lac_tac_high)
+			continue;
+
+		bounds[num_bounds++] = opl->lac_tac_low;
+		bounds[num_bounds++] = opl->lac_tac_high + 1;
+	}
+
+	qsort(bounds, num_bounds, sizeof(guint32), guint32_compare);
+
+	plmn->segments = g_new(struct opl_segment, num_bounds);
+	plmn->num_segments = 0;
+
+	for (i = 0; i < num_bounds; i++) {
+		guint32 start = bounds[i];
+		int first = -1;
+
+		if (i > 0 && start == bounds[i - 1])
+			continue;
+
+		for (j = 0; j < num_members; j++) {
+			const struct opl_operator *opl = records[members[j]];
+
+			if (opl_operator_any_lac(opl))
+				continue;
+
+			if (start >= opl->lac_tac_low &&
+					start <= opl->lac_tac_high) {
+				first = members[j];
+				break;
+			}
+		}
+
+		/* Merge with the previous piece if nothing changes */
+		if (plmn->num_segments > 0 && plmn->segments[
+				plmn->num_segments - 1].first == first)
+			continue;
+
+		plmn->segments[plmn->num_segments].start = start;
+		plmn->segments[plmn->num_segments].first = first;
+		plmn->num_segments += 1;
+	}
+
+	g_free(bounds);
+}
+
+static int opl_plmn_lookup(const struct opl_plmn *plmn,
+				gboolean have_lac, guint16 lac)
+{
+	int lo = 0;
+	int hi = plmn->num_segments - 1;
+	int first;
+
+	if (have_lac == FALSE)
+		return plmn->any_lac;
+
+	/* Last segment starting at or before lac, the first one is at 0 */
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+
+		if (plmn->segments[mid].start <= lac)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	first = plmn->segments[lo].first;
+
+	if (first == -1 || (plmn->any_lac != -1 && plmn->any_lac < first))
+		return plmn->any_lac;
+
+	return first;
+}
+
+static void opl_index_free(struct opl_index *index)
+{
+	if (index == NULL)
+		return;
+
+	g_free(index->records);
+	g_free(index->wildcards);
+	g_hash_table_destroy(index->plmns);
+	g_free(index);
+}
+
+static struct opl_index *opl_index_new(GSList *opl_list)
+{
+	struct opl_index *index = g_new0(struct opl_index, 1);
+	GHashTable *members;
+	GHashTableIter iter;
+	gpointer value;
+	GSList *l;
+	int i;
+
+	index->num_records = g_slist_length(opl_list);
+	index->records = g_new(struct opl_operator *, index->num_records);
+	index->wildcards = g_new(int, index->num_records);
+	index->plmns = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+						NULL, opl_plmn_free);
+
+	/* Positions of the records of each PLMN, in file order */
+	members = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+					NULL, (GDestroyNotify) g_array_unref);
+
+	for (l = opl_list, i = 0; l; l = l->next, i++) {
+		struct opl_operator *opl = l->data;
+		struct opl_plmn *plmn;
+		GArray *array;
+		guint64 key;
+
+		index->records[i] = opl;
+
+		if (opl_operator_has_wildcard(opl)) {
+			index->wildcards[index->num_wildcards++] = i;
+			continue;
+		}
+
+		key = opl_plmn_key(opl->mcc, opl->mnc);
+		plmn = g_hash_table_lookup(index->plmns, &key);
+
+		if (plmn == NULL) {
+			plmn = g_new0(struct opl_plmn, 1);
+			plmn->plmn = key;
+			plmn->any_lac = -1;
+			g_hash_table_insert(index->plmns, &plmn->plmn, plmn);
+
+			array = g_array_new(FALSE, FALSE, sizeof(int));
+			g_hash_table_insert(members, &plmn->plmn, array);
+		} else
+			array = g_hash_table_lookup(members, &key);
+
+		if (plmn->any_lac == -1 && opl_operator_any_lac(opl))
+			plmn->any_lac = i;
+
+		g_array_append_val(array, i);
+	}
+
+	g_hash_table_iter_init(&iter, index->plmns);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct opl_plmn *plmn = value;
+		GArray *array = g_hash_table_lookup(members, &plmn->plmn);
+
+		opl_plmn_build_segments(plmn, index->records,
+					(int *) array->data, array->len);
+	}
+
+	g_hash_table_destroy(members);
+
+	return index;
+}
+
 struct sim_eons *sim_eons_new(int pnn_records)
 {
 	struct sim_eons *eons = g_new0(struct sim_eons, 1);
@@ -1083,11 +1352,18 @@ void sim_eons_add_opl_record(struct sim_eons *eons,
 	}
 
 	eons->opl_list = g_slist_prepend(eons->opl_list, oper);
+
+	/* Records added after sim_eons_optimize() are not indexed */
+	opl_index_free(eons->opl_index);
+	eons->opl_index = NULL;
 }
 
 void sim_eons_optimize(struct sim_eons *eons)
 {
 	eons->opl_list = g_slist_reverse(eons->opl_list);
+
+	opl_index_free(eons->opl_index);
+	eons->opl_index = opl_index_new(eons->opl_list);
 }
 
 void sim_eons_free(struct sim_eons *eons)
@@ -1103,50 +1379,71 @@ void sim_eons_free(struct sim_eons *eons)
 	g_free(eons->pnn_list);
 
 	g_slist_free_full(eons->opl_list, g_free);
+	opl_index_free(eons->opl_index);
 
 	g_free(eons);
 }
 
-static const struct sim_eons_operator_info *
-	sim_eons_lookup_common(struct sim_eons *eons,
-				const char *mcc, const char *mnc,
-				gboolean have_lac, guint16 lac)
+static const struct opl_operator *opl_index_lookup(
+					const struct opl_index *index,
+					const char *mcc, const char *mnc,
+					gboolean have_lac, guint16 lac)
 {
-	GSList *l;
-	const struct opl_operator *opl;
+	guint64 key = opl_plmn_key(mcc, mnc);
+	const struct opl_plmn *plmn;
+	int best = -1;
 	int i;
 
-	for (l = eons->opl_list; l; l = l->next) {
-		opl = l->data;
+	plmn = g_hash_table_lookup(index->plmns, &key);
+	if (plmn)
+		best = opl_plmn_lookup(plmn, have_lac, lac);
 
-		for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
-			if (mcc[i] != opl->mcc[i] &&
-					!(opl->mcc[i] == 'b' && mcc[i]))
-				break;
-		if (i < OFONO_MAX_MCC_LENGTH)
-			continue;
+	/* Wildcard records only matter if they come first */
+	for (i = 0; i < index->num_wildcards; i++) {
+		int pos = index->wildcards[i];
+		const struct opl_operator *opl = index->records[pos];
 
-		for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
-			if (mnc[i] != opl->mnc[i] &&
-					!(opl->mnc[i] == 'b' && mnc[i]))
-				break;
-		if (i < OFONO_MAX_MNC_LENGTH)
-			continue;
-
-		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe)
+		if (best != -1 && pos > best)
 			break;
 
-		if (have_lac == FALSE)
-			continue;
-
-		if ((lac >= opl->lac_tac_low) && (lac <= opl->lac_tac_high))
+		if (opl_operator_match_plmn(opl, mcc, mnc) &&
+				opl_operator_match_lac(opl, have_lac, lac)) {
+			best = pos;
 			break;
+		}
 	}
 
-	if (l == NULL)
+	if (best == -1)
 		return NULL;
 
-	opl = l->data;
+	return index->records[best];
+}
+
+static const struct sim_eons_operator_info *
+	sim_eons_lookup_common(struct sim_eons *eons,
+				const char *mcc, const char *mnc,
+				gboolean have_lac, guint16 lac)
+{
+	const struct opl_operator *opl = NULL;
+	GSList *l;
+
+	if (eons->opl_index)
+		opl = opl_index_lookup(eons->opl_index, mcc, mnc,
+							have_lac, lac);
+	else {
+		for (l = eons->opl_list; l; l = l->next) {
+			const struct opl_operator *cur = l->data;
+
+			if (opl_operator_match_plmn(cur, mcc, mnc) &&
+				opl_operator_match_lac(cur, have_lac, lac)) {
+				opl = cur;
+				break;
+			}
+		}
+	}
+
+	if (opl == NULL)
+		return NULL;
 
 	/* 0 is not a valid record id */
 	if (opl->id == 0)
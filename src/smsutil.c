@@ -30,6 +30,7 @@
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -43,11 +44,15 @@
 #define uninitialized_var(x) x = x
 
 #define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
+#define SMS_BACKUP_JOURNAL SMS_BACKUP_PATH ".journal"
+#define SMS_BACKUP_KEY "%s-%i-%i/%03i"
 
 #define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
-#define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
+#define SMS_SR_BACKUP_JOURNAL SMS_SR_BACKUP_PATH ".journal"
+#define SMS_SR_BACKUP_KEY "%s-%s"
+
+/* Don't bother rewriting journals holding fewer records than this */
+#define SMS_JOURNAL_COMPACT_MIN 64
 
 #define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
 #define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
@@ -2419,6 +2424,307 @@ gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr)
 	return TRUE;
 }
 
+/*
+ * Incomplete messages and pending status reports are backed up in an
+ * append-only journal per IMSI.  Every record either sets or deletes the
+ * value stored under a key, the last record for a given key wins.  Once
+ * the journal has grown to twice the number of records it had after the
+ * last rewrite, it is rewritten from the in-memory state.
+ */
+enum sms_journal_op {
+	SMS_JOURNAL_SET = 1,
+	SMS_JOURNAL_DEL = 2,
+};
+
+struct sms_journal_record {
+	guint8 op;
+	guint8 key_len;
+	guint16 data_len;
+} __attribute__((packed));
+
+struct sms_journal {
+	char *path;
+	int fd;
+	unsigned int records;
+	unsigned int compact_at;
+};
+
+typedef void (*sms_journal_entry_func)(const char *key, const void *data,
+					size_t len, void *user_data);
+typedef void (*sms_journal_dump_func)(void *user_data);
+
+static struct sms_journal *sms_journal_new(char *path)
+{
+	struct sms_journal *journal = g_new0(struct sms_journal, 1);
+
+	journal->path = path;
+	journal->fd = -1;
+	journal->compact_at = SMS_JOURNAL_COMPACT_MIN;
+
+	return journal;
+}
+
+static void sms_journal_free(struct sms_journal *journal)
+{
+	if (journal == NULL)
+		return;
+
+	if (journal->fd >= 0)
+		L_TFR(close(journal->fd));
+
+	l_free(journal->path);
+	g_free(journal);
+}
+
+/*
+ * Calls func for every key left set once all records have been applied.
+ * A record cut short by a crash ends the journal.
+ */
+static void sms_journal_replay(struct sms_journal *journal,
+				sms_journal_entry_func func, void *user_data)
+{
+	struct sms_journal_record rec;
+	GHashTable *entries;
+	GHashTableIter iter;
+	gpointer key, value;
+	gchar *contents;
+	const char *p;
+	gsize size;
+	gsize pos = 0;
+	gsize len;
+
+	if (!g_file_get_contents(journal->path, &contents, &size, NULL))
+		return;
+
+	entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					(GDestroyNotify) g_bytes_unref);
+
+	while (pos + sizeof(rec) <= size) {
+		memcpy(&rec, contents + pos, sizeof(rec));
+
+		if (pos + sizeof(rec) + rec.key_len + rec.data_len > size)
+			break;
+
+		p = contents + pos + sizeof(rec);
+		key = g_strndup(p, rec.key_len);
+
+		if (rec.op == SMS_JOURNAL_SET) {
+			g_hash_table_replace(entries, key,
+					g_bytes_new(p + rec.key_len,
+							rec.data_len));
+		} else {
+			g_hash_table_remove(entries, key);
+			g_free(key);
+		}
+
+		pos += sizeof(rec) + rec.key_len + rec.data_len;
+		journal->records += 1;
+	}
+
+	g_free(contents);
+
+	g_hash_table_iter_init(&iter, entries);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		const void *data = g_bytes_get_data(value, &len);
+
+		func(key, data, len, user_data);
+	}
+
+	g_hash_table_destroy(entries);
+}
+
+static void sms_journal_write(struct sms_journal *journal,
+				enum sms_journal_op op, const char *key,
+				const void *data, size_t len)
+{
+	struct sms_journal_record rec;
+	struct iovec iov[3];
+	ssize_t total;
+
+	if (journal == NULL || journal->fd < 0)
+		return;
+
+	rec.op = op;
+	rec.key_len = strlen(key);
+	rec.data_len = len;
+
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+	iov[1].iov_base = (void *) key;
+	iov[1].iov_len = rec.key_len;
+	iov[2].iov_base = (void *) data;
+	iov[2].iov_len = len;
+
+	total = sizeof(rec) + rec.key_len + len;
+
+	/*
+	 * Appending after a partial record would corrupt everything that
+	 * follows, so stop journaling until the next rewrite instead.
+	 */
+	if (L_TFR(writev(journal->fd, iov, 3)) != total) {
+		L_TFR(close(journal->fd));
+		journal->fd = -1;
+		return;
+	}
+
+	journal->records += 1;
+}
+
+/*
+ * Rewrite the journal from scratch, dump is expected to write a SET
+ * record for everything currently stored.  The new journal replaces the
+ * old one atomically, on failure we keep appending to the old one.
+ */
+static gboolean sms_journal_compact(struct sms_journal *journal,
+					sms_journal_dump_func dump,
+					void *user_data)
+{
+	char *tmp;
+	gboolean ret = FALSE;
+	int fd;
+
+	if (create_dirs(journal->path) < 0)
+		return FALSE;
+
+	tmp = l_strdup_printf("%s.tmp", journal->path);
+
+	fd = L_TFR(open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600));
+	if (fd < 0)
+		goto out;
+
+	if (journal->fd >= 0)
+		L_TFR(close(journal->fd));
+
+	journal->fd = fd;
+	journal->records = 0;
+
+	dump(user_data);
+
+	if (journal->fd >= 0 && rename(tmp, journal->path) == 0) {
+		ret = TRUE;
+		goto out;
+	}
+
+	unlink(tmp);
+
+	if (journal->fd >= 0)
+		L_TFR(close(journal->fd));
+
+	journal->fd = L_TFR(open(journal->path,
+					O_WRONLY | O_APPEND | O_CREAT, 0600));
+
+out:
+	journal->compact_at = MAX(SMS_JOURNAL_COMPACT_MIN,
+					journal->records * 2);
+	l_free(tmp);
+
+	return ret;
+}
+
+static void sms_journal_maybe_compact(struct sms_journal *journal,
+					sms_journal_dump_func dump,
+					void *user_data)
+{
+	if (journal == NULL || journal->records < journal->compact_at)
+		return;
+
+	sms_journal_compact(journal, dump, user_data);
+}
+
+/* Removes a backup directory in the layout used before the journal */
+static void sms_backup_remove_dir(const char *path)
+{
+	struct dirent **entries;
+	char *entry_path;
+	int len;
+
+	len = scandir(path, &entries, NULL, alphasort);
+	if (len < 0)
+		return;
+
+	while (len--) {
+		const struct dirent *dir = entries[len];
+
+		if (strcmp(dir->d_name, ".") && strcmp(dir->d_name, "..")) {
+			entry_path = l_strdup_printf("%s/%s", path,
+							dir->d_name);
+
+			if (dir->d_type == DT_DIR)
+				sms_backup_remove_dir(entry_path);
+			else
+				unlink(entry_path);
+
+			l_free(entry_path);
+		}
+
+		free(entries[len]);
+	}
+
+	free(entries);
+	rmdir(path);
+}
+
+static guint sms_assembly_node_hash(gconstpointer key)
+{
+	const struct sms_assembly_node *node = key;
+
+	return g_str_hash(node->addr.address) ^ node->ref;
+}
+
+static gboolean sms_assembly_node_equal(gconstpointer a, gconstpointer b)
+{
+	const struct sms_assembly_node *node_a = a;
+	const struct sms_assembly_node *node_b = b;
+
+	if (node_a->ref != node_b->ref)
+		return FALSE;
+
+	if (node_a->addr.number_type != node_b->addr.number_type)
+		return FALSE;
+
+	if (node_a->addr.numbering_plan != node_b->addr.numbering_plan)
+		return FALSE;
+
+	return strcmp(node_a->addr.address, node_b->addr.address) == 0;
+}
+
+static void sms_assembly_load_entry(const char *key, const void *data,
+					size_t len, void *user_data)
+{
+	struct sms_assembly *assembly = user_data;
+	struct sms_address addr;
+	DECLARE_SMS_ADDR_STR(straddr);
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	gint64 ts;
+	char endc;
+	struct sms segment;
+	GSList *completed;
+
+	if (sscanf(key, SMS_ADDR_FMT "-%hu-%hhu/%hhu%c",
+				straddr, &ref, &max, &seq, &endc) != 4)
+		return;
+
+	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
+		return;
+
+	if (len < sizeof(ts))
+		return;
+
+	memcpy(&ts, data, sizeof(ts));
+
+	if (!sms_deserialize((const unsigned char *) data + sizeof(ts),
+				&segment, len - sizeof(ts)))
+		return;
+
+	completed = sms_assembly_add_fragment_backup(assembly, &segment, ts,
+						&addr, ref, max, seq, FALSE);
+	g_slist_free_full(completed, g_free);
+}
+
+/* Imports a message stored one file per fragment by older versions */
 static void sms_assembly_load(struct sms_assembly *assembly,
 				const struct dirent *dir)
 {
@@ -2436,6 +2742,7 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 	int i;
 	unsigned char buf[177];
 	struct sms segment;
+	GSList *completed;
 
 	if (dir->d_type != DT_DIR)
 		return;
@@ -2482,10 +2789,11 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 		if (r != 0)
 			continue;
 
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
+		completed = sms_assembly_add_fragment_backup(assembly,
+						&segment,
 						segment_stat.st_mtime,
 						&addr, ref, max, seq, FALSE);
+		g_slist_free_full(completed, g_free);
 	}
 
 	for (i = 0; i < len; i++)
@@ -2494,37 +2802,40 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 	free(segments);
 }
 
-static gboolean sms_assembly_store(struct sms_assembly *assembly,
+static void sms_assembly_store(struct sms_assembly *assembly,
 				struct sms_assembly_node *node,
 				const struct sms *sms, guint8 seq)
 {
-	unsigned char buf[177];
-	int len;
+	unsigned char buf[sizeof(gint64) + 177];
+	gint64 ts = node->ts;
 	DECLARE_SMS_ADDR_STR(straddr);
+	char key[48];
+	int len;
 
-	if (assembly->imsi == NULL)
-		return FALSE;
+	if (assembly->journal == NULL)
+		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
-		return FALSE;
+		return;
 
-	len = sms_serialize(buf, sms);
+	snprintf(key, sizeof(key), SMS_BACKUP_KEY, straddr, node->ref,
+			node->max_fragments, seq);
 
-	if (write_file(buf, len, SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	memcpy(buf, &ts, sizeof(ts));
+	len = sms_serialize(buf + sizeof(ts), sms);
 
-	return TRUE;
+	sms_journal_write(assembly->journal, SMS_JOURNAL_SET, key,
+				buf, sizeof(ts) + len);
 }
 
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
 	int seq;
 	DECLARE_SMS_ADDR_STR(straddr);
+	char key[48];
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
@@ -2535,18 +2846,35 @@ static void sms_assembly_backup_free(struct sms_assembly *assembly,
 		int bit = 1 << (seq % 32);
 
 		if (node->bitmap[offset] & bit) {
-			path = l_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
+			snprintf(key, sizeof(key), SMS_BACKUP_KEY, straddr,
 					node->ref, node->max_fragments, seq);
-			unlink(path);
-			l_free(path);
+			sms_journal_write(assembly->journal, SMS_JOURNAL_DEL,
+						key, NULL, 0);
 		}
 	}
+}
 
-	path = l_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	l_free(path);
+static void sms_assembly_dump(void *user_data)
+{
+	struct sms_assembly *assembly = user_data;
+	GSList *l;
+	GSList *f;
+	int seq;
+
+	for (l = assembly->assembly_list; l; l = l->next) {
+		struct sms_assembly_node *node = l->data;
+
+		/* Fragments are kept sorted by sequence number */
+		f = node->fragment_list;
+
+		for (seq = 0; seq < node->max_fragments && f; seq++) {
+			if (!(node->bitmap[seq / 32] & (1 << (seq % 32))))
+				continue;
+
+			sms_assembly_store(assembly, node, f->data, seq);
+			f = f->next;
+		}
+	}
 }
 
 struct sms_assembly *sms_assembly_new(const char *imsi)
@@ -2556,26 +2884,43 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 	struct dirent **entries;
 	int len;
 
-	if (imsi) {
-		ret->imsi = imsi;
+	ret->assembly_table = g_hash_table_new(sms_assembly_node_hash,
+						sms_assembly_node_equal);
 
-		/* Restore state from backup */
+	if (imsi == NULL)
+		return ret;
 
-		path = l_strdup_printf(SMS_BACKUP_PATH, imsi);
-		len = scandir(path, &entries, NULL, alphasort);
-		l_free(path);
+	ret->imsi = imsi;
 
-		if (len < 0)
-			return ret;
+	/* Restore state from backup */
+	ret->journal = sms_journal_new(l_strdup_printf(SMS_BACKUP_JOURNAL,
+								imsi));
+	sms_journal_replay(ret->journal, sms_assembly_load_entry, ret);
 
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
+	path = l_strdup_printf(SMS_BACKUP_PATH, imsi);
+	len = scandir(path, &entries, NULL, alphasort);
+
+	if (len >= 0) {
+		int i;
+
+		for (i = len - 1; i >= 0; i--) {
+			sms_assembly_load(ret, entries[i]);
+			free(entries[i]);
 		}
 
 		free(entries);
 	}
 
+	/*
+	 * Start off with a compact journal, and only drop the old backup
+	 * once everything it held has been safely written to it
+	 */
+	if (sms_journal_compact(ret->journal, sms_assembly_dump, ret) &&
+			len >= 0)
+		sms_backup_remove_dir(path);
+
+	l_free(path);
+
 	return ret;
 }
 
@@ -2591,6 +2936,8 @@ void sms_assembly_free(struct sms_assembly *assembly)
 	}
 
 	g_slist_free(assembly->assembly_list);
+	g_hash_table_destroy(assembly->assembly_table);
+	sms_journal_free(assembly->journal);
 	g_free(assembly);
 }
 
@@ -2599,8 +2946,15 @@ GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms_address *addr,
 					guint16 ref, guint8 max, guint8 seq)
 {
-	return sms_assembly_add_fragment_backup(assembly, sms,
-						ts, addr, ref, max, seq, TRUE);
+	GSList *completed;
+
+	completed = sms_assembly_add_fragment_backup(assembly, sms, ts, addr,
+							ref, max, seq, TRUE);
+
+	sms_journal_maybe_compact(assembly->journal, sms_assembly_dump,
+					assembly);
+
+	return completed;
 }
 
 static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
@@ -2611,32 +2965,19 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 {
 	unsigned int offset = seq / 32;
 	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
+	struct sms_assembly_node lookup;
 	struct sms *newsms;
 	struct sms_assembly_node *node;
 	GSList *completed;
 	unsigned int position;
 	unsigned int i;
-	unsigned int j;
-
-	prev = NULL;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
-
-		if (node->addr.number_type != addr->number_type)
-			continue;
 
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
+	memcpy(&lookup.addr, addr, sizeof(struct sms_address));
+	lookup.ref = ref;
 
-		if (strcmp(node->addr.address, addr->address))
-			continue;
-
-		if (ref != node->ref)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table, &lookup);
 
+	if (node != NULL) {
 		/*
 		 * Message Reference and address the same, but max is not
 		 * ignore the SMS completely
@@ -2649,21 +2990,16 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 			return NULL;
 
 		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
+		 * Count the fragments stored before the bit we care
+		 * about (offset:bit) in the bitmap -- that gives us in
+		 * which position we have to insert.
 		 */
 		position = 0;
 		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
+			position += __builtin_popcount(node->bitmap[i]);
 
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
+		position += __builtin_popcount(node->bitmap[offset] &
+								(bit - 1));
 
 		goto out;
 	}
@@ -2676,9 +3012,8 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 
 	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
 							node);
+	g_hash_table_insert(assembly->assembly_table, node, node);
 
-	prev = NULL;
-	l = assembly->assembly_list;
 	position = 0;
 
 out:
@@ -2701,13 +3036,11 @@ out:
 
 	sms_assembly_backup_free(assembly, node);
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+	g_hash_table_remove(assembly->assembly_table, node);
+	assembly->assembly_list = g_slist_remove(assembly->assembly_list,
+							node);
 
 	g_free(node);
-	g_slist_free_1(l);
 	return completed;
 }
 
@@ -2735,6 +3068,7 @@ void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 		}
 
 		sms_assembly_backup_free(assembly, node);
+		g_hash_table_remove(assembly->assembly_table, node);
 
 		g_slist_free_full(node->fragment_list, g_free);
 		g_free(node);
@@ -2748,6 +3082,9 @@ void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 		cur = cur->next;
 		g_slist_free_1(tmp);
 	}
+
+	sms_journal_maybe_compact(assembly->journal, sms_assembly_dump,
+					assembly);
 }
 
 static gboolean sha1_equal(gconstpointer v1, gconstpointer v2)
@@ -2764,32 +3101,26 @@ static guint sha1_hash(gconstpointer v)
 	return h;
 }
 
-static void sr_assembly_load_backup(GHashTable *assembly_table,
-					const char *imsi,
-					const struct dirent *addr_dir)
+static void sr_assembly_load_entry(const char *key, const void *data,
+					size_t len, void *user_data)
 {
+	GHashTable *assembly_table = user_data;
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
 	struct id_table_node *node;
 	GHashTable *id_table;
-	int r;
 	char *assembly_table_key;
 	unsigned int *id_table_key;
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
 	unsigned char msgid[SMS_MSGID_LEN];
 	char endc;
 
-	if (addr_dir->d_type != DT_REG)
-		return;
-
 	/*
-	 * All SMS-messages under the same IMSI-code are
-	 * included in the same directory.
-	 * So, SMS-address and message ID are included in the same file name
+	 * SMS-address and message ID are both included in the key
 	 * Max of SMS address size is 12 bytes, hex encoded
 	 * Max of SMS SHA1 hash is 20 bytes, hex encoded
 	 */
-	if (sscanf(addr_dir->d_name, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
+	if (sscanf(key, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
 				straddr, msgid_str, &endc) != 2)
 		return;
 
@@ -2803,17 +3134,10 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 				NULL, 0, msgid) == NULL)
 		return;
 
-	node = g_new0(struct id_table_node, 1);
-
-	r = read_file((unsigned char *) node,
-			sizeof(struct id_table_node),
-			SMS_SR_BACKUP_PATH "/%s",
-			imsi, addr_dir->d_name);
-
-	if (r < 0) {
-		g_free(node);
+	if (len != sizeof(struct id_table_node))
 		return;
-	}
+
+	node = g_memdup2(data, len);
 
 	id_table = g_hash_table_lookup(assembly_table,
 					sms_address_to_string(&addr));
@@ -2834,100 +3158,153 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 	g_hash_table_insert(id_table, id_table_key, node);
 }
 
-struct status_report_assembly *status_report_assembly_new(const char *imsi)
+/* Imports a status report node stored in its own file by older versions */
+static void sr_assembly_load_backup(GHashTable *assembly_table,
+					const char *imsi,
+					const struct dirent *addr_dir)
 {
-	char *path;
-	int len;
-	struct dirent **addresses;
-	struct status_report_assembly *ret =
-				g_new0(struct status_report_assembly, 1);
-
-	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
-				g_free, (GDestroyNotify) g_hash_table_destroy);
-
-	if (imsi) {
-		ret->imsi = imsi;
+	struct id_table_node node;
+	int r;
 
-		/* Restore state from backup */
-		path = l_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
-		len = scandir(path, &addresses, NULL, alphasort);
-		l_free(path);
+	if (addr_dir->d_type != DT_REG)
+		return;
 
-		if (len < 0)
-			return ret;
+	memset(&node, 0, sizeof(node));
 
-		/*
-		 * Go through different addresses. Each address can relate to
-		 * 1-n msg_ids.
-		 */
-
-		while (len--) {
-			sr_assembly_load_backup(ret->assembly_table, imsi,
-								addresses[len]);
-			g_free(addresses[len]);
-		}
+	r = read_file((unsigned char *) &node,
+			sizeof(struct id_table_node),
+			SMS_SR_BACKUP_PATH "/%s",
+			imsi, addr_dir->d_name);
 
-		g_free(addresses);
-	}
+	if (r < 0)
+		return;
 
-	return ret;
+	sr_assembly_load_entry(addr_dir->d_name, &node, sizeof(node),
+				assembly_table);
 }
 
-static gboolean sr_assembly_add_fragment_backup(const char *imsi,
+static void sr_assembly_add_fragment_backup(
+					struct status_report_assembly *assembly,
 					const struct id_table_node *node,
 					const struct sms_address *addr,
 					const unsigned char *msgid)
 {
-	int len = sizeof(struct id_table_node);
 	DECLARE_SMS_ADDR_STR(straddr);
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	char key[sizeof(straddr) + sizeof(msgid_str) + 1];
 
-	if (imsi == NULL)
-		return FALSE;
+	if (assembly->journal == NULL)
+		return;
 
 	if (sms_address_to_hex_string(addr, straddr) == FALSE)
-		return FALSE;
+		return;
 
 	if (encode_hex_own_buf(msgid, SMS_MSGID_LEN, 0, msgid_str) == NULL)
-		return FALSE;
+		return;
 
-	/* storagedir/%s/sms_sr/%s-%s */
-	if (write_file((unsigned char *) node, len,
-			SMS_SR_BACKUP_PATH_FILE, imsi,
-			straddr, msgid_str) != len)
-		return FALSE;
+	snprintf(key, sizeof(key), SMS_SR_BACKUP_KEY, straddr, msgid_str);
 
-	return TRUE;
+	sms_journal_write(assembly->journal, SMS_JOURNAL_SET, key,
+				node, sizeof(struct id_table_node));
 }
 
-static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
+static void sr_assembly_remove_fragment_backup(
+					struct status_report_assembly *assembly,
 					const struct sms_address *addr,
 					const unsigned char *sha1)
 {
-	char *path;
 	DECLARE_SMS_ADDR_STR(straddr);
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	char key[sizeof(straddr) + sizeof(msgid_str) + 1];
 
-	if (imsi == NULL)
-		return FALSE;
+	if (assembly->journal == NULL)
+		return;
 
 	if (sms_address_to_hex_string(addr, straddr) == FALSE)
-		return FALSE;
+		return;
 
-	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == FALSE)
-		return FALSE;
+	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == NULL)
+		return;
+
+	snprintf(key, sizeof(key), SMS_SR_BACKUP_KEY, straddr, msgid_str);
+
+	sms_journal_write(assembly->journal, SMS_JOURNAL_DEL, key, NULL, 0);
+}
+
+static void sr_assembly_dump(void *user_data)
+{
+	struct status_report_assembly *assembly = user_data;
+	GHashTableIter iter_addr, iter_node;
+	struct sms_address addr;
+	gpointer straddr, id_table;
+	gpointer msgid, node;
+
+	g_hash_table_iter_init(&iter_addr, assembly->assembly_table);
+
+	while (g_hash_table_iter_next(&iter_addr, &straddr, &id_table)) {
+		__sms_address_from_string(&addr, straddr);
+		g_hash_table_iter_init(&iter_node, id_table);
+
+		while (g_hash_table_iter_next(&iter_node, &msgid, &node))
+			sr_assembly_add_fragment_backup(assembly, node,
+							&addr, msgid);
+	}
+}
+
+struct status_report_assembly *status_report_assembly_new(const char *imsi)
+{
+	char *path;
+	int len;
+	struct dirent **addresses;
+	struct status_report_assembly *ret =
+				g_new0(struct status_report_assembly, 1);
+
+	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify) g_hash_table_destroy);
+
+	if (imsi == NULL)
+		return ret;
+
+	ret->imsi = imsi;
+
+	/* Restore state from backup */
+	ret->journal = sms_journal_new(l_strdup_printf(SMS_SR_BACKUP_JOURNAL,
+								imsi));
+	sms_journal_replay(ret->journal, sr_assembly_load_entry,
+				ret->assembly_table);
+
+	path = l_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
+	len = scandir(path, &addresses, NULL, alphasort);
+
+	if (len >= 0) {
+		int i;
+
+		/*
+		 * Go through different addresses. Each address can relate to
+		 * 1-n msg_ids.
+		 */
+		for (i = len - 1; i >= 0; i--) {
+			sr_assembly_load_backup(ret->assembly_table, imsi,
+							addresses[i]);
+			free(addresses[i]);
+		}
+
+		free(addresses);
+	}
+
+	if (sms_journal_compact(ret->journal, sr_assembly_dump, ret) &&
+			len >= 0)
+		sms_backup_remove_dir(path);
 
-	path = l_strdup_printf(SMS_SR_BACKUP_PATH_FILE,
-					imsi, straddr, msgid_str);
-	unlink(path);
 	l_free(path);
 
-	return TRUE;
+	return ret;
 }
 
 void status_report_assembly_free(struct status_report_assembly *assembly)
 {
 	g_hash_table_destroy(assembly->assembly_table);
+	sms_journal_free(assembly->journal);
 	g_free(assembly);
 }
 
@@ -3091,8 +3468,9 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		 * More status reports expected, and already received
 		 * reports completed. Update backup file.
 		 */
-		sr_assembly_add_fragment_backup(assembly->imsi, node,
-						&addr, msgid);
+		sr_assembly_add_fragment_backup(assembly, node, &addr, msgid);
+		sms_journal_maybe_compact(assembly->journal, sr_assembly_dump,
+						assembly);
 
 		return FALSE;
 	}
@@ -3103,13 +3481,16 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 	if (out_msgid)
 		memcpy(out_msgid, msgid, SMS_MSGID_LEN);
 
-	sr_assembly_remove_fragment_backup(assembly->imsi, &addr, msgid);
+	sr_assembly_remove_fragment_backup(assembly, &addr, msgid);
 	id_table = g_hash_table_iter_get_hash_table(&iter);
 	g_hash_table_iter_remove(&iter);
 
 	if (g_hash_table_size(id_table) == 0)
 		g_hash_table_remove(assembly->assembly_table, straddr);
 
+	sms_journal_maybe_compact(assembly->journal, sr_assembly_dump,
+					assembly);
+
 	return TRUE;
 }
 
@@ -3155,7 +3536,10 @@ void status_report_assembly_add_fragment(
 	node->mrs[offset] |= bit;
 	node->expiration = expiration;
 	node->sent_mrs++;
-	sr_assembly_add_fragment_backup(assembly->imsi, node, to, msgid);
+	sr_assembly_add_fragment_backup(assembly, node, to, msgid);
+
+	sms_journal_maybe_compact(assembly->journal, sr_assembly_dump,
+					assembly);
 }
 
 void status_report_assembly_expire(struct status_report_assembly *assembly,
@@ -3185,15 +3569,13 @@ void status_report_assembly_expire(struct status_report_assembly *assembly,
 						(gpointer) &node)) {
 			/*
 			 * If message is expired, removed it from the
-			 * hash-table and remove the backup-file
+			 * hash-table and remove it from the backup
 			 */
 			if (node->expiration <= before) {
-				g_hash_table_iter_remove(&iter_node);
+				sr_assembly_remove_fragment_backup(assembly,
+								&addr, key);
 
-				sr_assembly_remove_fragment_backup(
-								assembly->imsi,
-								&addr,
-								key);
+				g_hash_table_iter_remove(&iter_node);
 			}
 		}
 
@@ -3204,6 +3586,9 @@ void status_report_assembly_expire(struct status_report_assembly *assembly,
 		if (g_hash_table_size(id_table) == 0)
 			g_hash_table_iter_remove(&iter_addr);
 	}
+
+	sms_journal_maybe_compact(assembly->journal, sr_assembly_dump,
+					assembly);
 }
 
 static int sms_tx_load_filter(const struct dirent *dent)
@@ -360,9 +360,13 @@ struct sms_assembly_node {
 	unsigned int bitmap[8];
 };
 
+struct sms_journal;
+
 struct sms_assembly {
 	const char *imsi;
 	GSList *assembly_list;
+	GHashTable *assembly_table;
+	struct sms_journal *journal;
 };
 
 struct id_table_node {
@@ -376,6 +380,7 @@ struct id_table_node {
 struct status_report_assembly {
 	const char *imsi;
 	GHashTable *assembly_table;
+	struct sms_journal *journal;
 };
 
 struct cbs {
@@ -70,21 +70,25 @@ struct codepoint {
 	unsigned short to;
 };
 
+/* Unicode to GSM, paged by the high byte of the codepoint */
+struct unicode_map {
+	/* Page number plus one for each high byte, 0 if there is none */
+	unsigned char index[256];
+	unsigned short *pages;
+};
+
 struct conversion_table {
-	/* To unicode locking shift table */
-	const struct codepoint *locking_u;
-	unsigned int locking_len_u;
+	/* To unicode locking shift table, fixed size */
+	const unsigned short *locking_g;
 
-	/* To unicode single shift table */
-	const struct codepoint *single_u;
-	unsigned int single_len_u;
+	/* To unicode single shift table, fixed size */
+	const unsigned short *single_g;
 
-	/* To GSM locking shift table, fixed size */
-	const unsigned short *locking_g;
+	/* To GSM locking shift table */
+	const struct unicode_map *locking_u;
 
 	/* To GSM single shift table */
-	const struct codepoint *single_g;
-	unsigned int single_len_g;
+	const struct unicode_map *single_u;
 };
 
 /* GSM to Unicode extension table, for GSM sequences starting with 0x1B */
@@ -2640,254 +2644,344 @@ const struct codepoint urd_unicode[] = {
 	{ 0x06CC, 0x59 }, { 0x06D0, 0x5A }, { 0x06D2, 0x5B }, { 0x06D5, 0x55 }
 };
 
-static int compare_codepoints(const void *a, const void *b)
+struct dialect {
+	const unsigned short *locking_g;
+	const struct codepoint *locking_u;
+	unsigned int locking_len_u;
+	const struct codepoint *single_g;
+	unsigned int single_len_g;
+	const struct codepoint *single_u;
+	unsigned int single_len_u;
+};
+
+#define DIALECT(locking, single) {					\
+	locking##_gsm, locking##_unicode, L_ARRAY_SIZE(locking##_unicode), \
+	single##_ext_gsm, L_ARRAY_SIZE(single##_ext_gsm),		\
+	single##_ext_unicode, L_ARRAY_SIZE(single##_ext_unicode)	\
+}
+
+static const struct dialect dialects[] = {
+	[GSM_DIALECT_DEFAULT] = DIALECT(def, def),
+	[GSM_DIALECT_TURKISH] = DIALECT(tur, tur),
+	/* Spanish dialect uses the default locking shift table */
+	[GSM_DIALECT_SPANISH] = DIALECT(def, spa),
+	[GSM_DIALECT_PORTUGUESE] = DIALECT(por, por),
+	[GSM_DIALECT_BENGALI] = DIALECT(ben, ben),
+	[GSM_DIALECT_GUJARATI] = DIALECT(guj, guj),
+	[GSM_DIALECT_HINDI] = DIALECT(hin, hin),
+	[GSM_DIALECT_KANNADA] = DIALECT(kan, kan),
+	[GSM_DIALECT_MALAYALAM] = DIALECT(mal, mal),
+	[GSM_DIALECT_ORIYA] = DIALECT(ori, ori),
+	[GSM_DIALECT_PUNJABI] = DIALECT(pun, pun),
+	[GSM_DIALECT_TAMIL] = DIALECT(tam, tam),
+	[GSM_DIALECT_TELUGU] = DIALECT(tel, tel),
+	[GSM_DIALECT_URDU] = DIALECT(urd, urd),
+};
+
+/*
+ * Direct mapped versions of the tables above.  They are expanded the
+ * first time a dialect is used and kept around, most setups only ever
+ * need the default one.
+ */
+static struct {
+	bool locking_ready;
+	struct unicode_map locking_u;
+	bool single_ready;
+	unsigned short single_g[128];
+	struct unicode_map single_u;
+} dialect_maps[L_ARRAY_SIZE(dialects)];
+
+static void unicode_map_init(struct unicode_map *map,
+				const struct codepoint *table,
+				unsigned int len)
 {
-	const struct codepoint *ca = (const struct codepoint *) a;
-	const struct codepoint *cb = (const struct codepoint *) b;
+	unsigned int num_pages = 0;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		unsigned char high = table[i].from >> 8;
+
+		if (map->index[high] == 0)
+			map->index[high] = ++num_pages;
+	}
 
-	return (ca->from > cb->from) - (ca->from < cb->from);
+	map->pages = l_malloc(num_pages * 256 * sizeof(unsigned short));
+	memset(map->pages, 0xff, num_pages * 256 * sizeof(unsigned short));
+
+	/*
+	 * Some extension tables list a character twice, keep the first
+	 * encoding
+	 */
+	for (i = 0; i < len; i++) {
+		unsigned short *entry = &map->pages[
+				(map->index[table[i].from >> 8] - 1) * 256 +
+				(table[i].from & 0xff)];
+
+		if (*entry == GUND)
+			*entry = table[i].to;
+	}
 }
 
-static unsigned short codepoint_lookup(struct codepoint *key,
-					const struct codepoint *table,
-					unsigned int len)
+static unsigned short unicode_map_lookup(const struct unicode_map *map,
+						unsigned short k)
 {
-	struct codepoint *result = NULL;
+	unsigned char page = map->index[k >> 8];
 
-	result = bsearch(key, table, len, sizeof(struct codepoint),
-				compare_codepoints);
+	if (page == 0)
+		return GUND;
 
-	return result ? result->to : GUND;
+	return map->pages[(page - 1) * 256 + (k & 0xff)];
 }
 
-static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
+static unsigned short gsm_locking_shift_lookup(const struct conversion_table *t,
 						unsigned char k)
 {
 	return t->locking_g[k];
 }
 
-static unsigned short gsm_single_shift_lookup(struct conversion_table *t,
+static unsigned short gsm_single_shift_lookup(const struct conversion_table *t,
 						unsigned char k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_g, t->single_len_g);
+	if (k > 0x7f)
+		return GUND;
+
+	return t->single_g[k];
+}
+
+static unsigned short unicode_locking_shift_lookup(
+					const struct conversion_table *t,
+					unsigned short k)
+{
+	return unicode_map_lookup(t->locking_u, k);
 }
 
-static unsigned short unicode_locking_shift_lookup(struct conversion_table *t,
-							unsigned short k)
+static unsigned short unicode_single_shift_lookup(
+					const struct conversion_table *t,
+					unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->locking_u, t->locking_len_u);
+	return unicode_map_lookup(t->single_u, k);
 }
 
-static unsigned short unicode_single_shift_lookup(struct conversion_table *t,
-							unsigned short k)
+static unsigned short unicode_lookup(const struct conversion_table *t,
+					unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_u, t->single_len_u);
+	unsigned short converted = unicode_locking_shift_lookup(t, k);
+
+	if (converted == GUND)
+		converted = unicode_single_shift_lookup(t, k);
+
+	return converted;
 }
 
 static bool populate_locking_shift(struct conversion_table *t,
 					enum gsm_dialect lang)
 {
-	switch (lang) {
-	case GSM_DIALECT_DEFAULT:
-	case GSM_DIALECT_SPANISH:
-		t->locking_g = def_gsm;
-		t->locking_u = def_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(def_unicode);
-		return true;
+	const struct dialect *d;
 
-	case GSM_DIALECT_TURKISH:
-		t->locking_g = tur_gsm;
-		t->locking_u = tur_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(tur_unicode);
-		return true;
+	if ((unsigned int) lang >= L_ARRAY_SIZE(dialects))
+		return false;
 
-	case GSM_DIALECT_PORTUGUESE:
-		t->locking_g = por_gsm;
-		t->locking_u = por_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(por_unicode);
-		return true;
+	d = &dialects[lang];
 
-	case GSM_DIALECT_BENGALI:
-		t->locking_g = ben_gsm;
-		t->locking_u = ben_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(ben_unicode);
-		return true;
+	if (!dialect_maps[lang].locking_ready) {
+		unicode_map_init(&dialect_maps[lang].locking_u,
+					d->locking_u, d->locking_len_u);
+		dialect_maps[lang].locking_ready = true;
+	}
 
-	case GSM_DIALECT_GUJARATI:
-                t->locking_g = guj_gsm;
-                t->locking_u = guj_unicode;
-                t->locking_len_u = L_ARRAY_SIZE(guj_unicode);
-                return true;
+	t->locking_g = d->locking_g;
+	t->locking_u = &dialect_maps[lang].locking_u;
 
-	case GSM_DIALECT_HINDI:
-		t->locking_g = hin_gsm;
-		t->locking_u = hin_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(hin_unicode);
-		return true;
+	return true;
+}
 
-	case GSM_DIALECT_KANNADA:
-		t->locking_g = kan_gsm;
-		t->locking_u = kan_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(kan_unicode);
-		return true;
+static bool populate_single_shift(struct conversion_table *t,
+					enum gsm_dialect lang)
+{
+	const struct dialect *d;
+	unsigned int i;
 
-	case GSM_DIALECT_MALAYALAM:
-		t->locking_g = mal_gsm;
-		t->locking_u = mal_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(mal_unicode);
-		return true;
+	if ((unsigned int) lang >= L_ARRAY_SIZE(dialects))
+		return false;
 
-	case GSM_DIALECT_ORIYA:
-		t->locking_g = ori_gsm;
-		t->locking_u = ori_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(ori_unicode);
-		return true;
+	d = &dialects[lang];
 
-	case GSM_DIALECT_PUNJABI:
-		t->locking_g = pun_gsm;
-		t->locking_u = pun_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(pun_unicode);
-		return true;
+	if (!dialect_maps[lang].single_ready) {
+		unsigned short *single_g = dialect_maps[lang].single_g;
 
-	case GSM_DIALECT_TAMIL:
-		t->locking_g = tam_gsm;
-		t->locking_u = tam_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(tam_unicode);
-		return true;
+		for (i = 0; i < L_ARRAY_SIZE(dialect_maps[lang].single_g); i++)
+			single_g[i] = GUND;
 
-	case GSM_DIALECT_TELUGU:
-		t->locking_g = tel_gsm;
-		t->locking_u = tel_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(tel_unicode);
-		return true;
+		for (i = 0; i < d->single_len_g; i++)
+			single_g[d->single_g[i].from] = d->single_g[i].to;
 
-	case GSM_DIALECT_URDU:
-		t->locking_g = urd_gsm;
-		t->locking_u = urd_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(urd_unicode);
-		return true;
-        }
+		unicode_map_init(&dialect_maps[lang].single_u,
+					d->single_u, d->single_len_u);
+		dialect_maps[lang].single_ready = true;
+	}
 
-	return false;
+	t->single_g = dialect_maps[lang].single_g;
+	t->single_u = &dialect_maps[lang].single_u;
+
+	return true;
 }
 
-static bool populate_single_shift(struct conversion_table *t,
-					enum gsm_dialect lang)
+static bool conversion_table_init(struct conversion_table *t,
+					enum gsm_dialect locking,
+					enum gsm_dialect single)
 {
-	switch (lang) {
-	case GSM_DIALECT_DEFAULT:
-		t->single_g = def_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(def_ext_gsm);
-		t->single_u = def_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(def_ext_unicode);
-		return true;
+	return populate_locking_shift(t, locking) &&
+			populate_single_shift(t, single);
+}
 
-	case GSM_DIALECT_TURKISH:
-		t->single_g = tur_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(tur_ext_gsm);
-		t->single_u = tur_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(tur_ext_unicode);
-		return true;
+/*
+ * Converts len GSM characters into buf, which must have room for three
+ * bytes per character plus the terminating '\0'.  Returns the number of
+ * bytes written, or -1 if the text is not valid GSM.  The number of
+ * characters consumed is returned in items_read in both cases.
+ */
+static long gsm_to_utf8_own_buf(const struct conversion_table *t,
+				const unsigned char *text, long len,
+				long *items_read, char *buf)
+{
+	char *out = buf;
+	long i;
 
-	case GSM_DIALECT_SPANISH:
-		t->single_g = spa_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(spa_ext_gsm);
-		t->single_u = spa_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(spa_ext_unicode);
-		return true;
+	for (i = 0; i < len; i++) {
+		unsigned short c;
 
-	case GSM_DIALECT_PORTUGUESE:
-		t->single_g = por_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(por_ext_gsm);
-		t->single_u = por_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(por_ext_unicode);
-		return true;
+		if (text[i] > 0x7f)
+			goto error;
 
-	case GSM_DIALECT_BENGALI:
-		t->single_g = ben_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(ben_ext_gsm);
-		t->single_u = ben_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(ben_ext_unicode);
-		return true;
+		if (text[i] == 0x1b) {
+			++i;
+			if (i >= len || text[i] > 0x7f)
+				goto error;
 
-	case GSM_DIALECT_GUJARATI:
-                t->single_g = guj_ext_gsm;
-                t->single_len_g = L_ARRAY_SIZE(guj_ext_gsm);
-                t->single_u = guj_ext_unicode;
-                t->single_len_u = L_ARRAY_SIZE(guj_ext_unicode);
-                return true;
-
-	case GSM_DIALECT_HINDI:
-		t->single_g = hin_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(hin_ext_gsm);
-		t->single_u = hin_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(hin_ext_unicode);
-		return true;
+			c = gsm_single_shift_lookup(t, text[i]);
 
-	case GSM_DIALECT_KANNADA:
-		t->single_g = kan_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(kan_ext_gsm);
-		t->single_u = kan_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(kan_ext_unicode);
-		return true;
+			/*
+			 * According to the comment in the table from
+			 * 3GPP 23.038, Section 6.2.1.1:
+			 * "In the event that an MS receives a code where
+			 * a symbol is not represented in the above table
+			 * then the MS shall display either the character
+			 * shown in the main GSM 7 bit default  alphabet
+			 * table in subclause 6.2.1., or the character from
+			 * the National Language Locking Shift Table in the
+			 * case where the locking shift mechanism as defined
+			 * in subclause 6.2.1.2.3 is used."
+			 */
+			if (c == GUND)
+				c = gsm_locking_shift_lookup(t, text[i]);
+		} else
+			c = gsm_locking_shift_lookup(t, text[i]);
 
-	case GSM_DIALECT_MALAYALAM:
-		t->single_g = mal_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(mal_ext_gsm);
-		t->single_u = mal_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(mal_ext_unicode);
-		return true;
+		out += l_utf8_from_wchar(c, out);
+	}
 
-	case GSM_DIALECT_ORIYA:
-		t->single_g = ori_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(ori_ext_gsm);
-		t->single_u = ori_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(ori_ext_unicode);
-		return true;
+	*out = '\0';
+	*items_read = i;
 
-	case GSM_DIALECT_PUNJABI:
-		t->single_g = pun_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(pun_ext_gsm);
-		t->single_u = pun_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(pun_ext_unicode);
-		return true;
+	return out - buf;
 
-	case GSM_DIALECT_TAMIL:
-		t->single_g = tam_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(tam_ext_gsm);
-		t->single_u = tam_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(tam_ext_unicode);
-		return true;
+error:
+	*items_read = i;
 
-	case GSM_DIALECT_TELUGU:
-		t->single_g = tel_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(tel_ext_gsm);
-		t->single_u = tel_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(tel_ext_unicode);
-		return true;
+	return -1;
+}
 
-	case GSM_DIALECT_URDU:
-		t->single_g = urd_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(urd_ext_gsm);
-		t->single_u = urd_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(urd_ext_unicode);
-		return true;
-        }
+/*
+ * Converts len bytes of UTF-8 into buf, which must have room for two
+ * bytes per character.  Returns the number of bytes written, or -1 if
+ * a character can not be encoded.  The number of bytes consumed is
+ * returned in items_read in both cases.
+ */
+static long utf8_to_gsm_own_buf(const struct conversion_table *t,
+				const char *text, long len,
+				long *items_read, unsigned char *buf)
+{
+	const char *in = text;
+	unsigned char *out = buf;
 
-	return false;
+	while (in < text + len) {
+		wchar_t c;
+		unsigned short converted;
+		int nread = l_utf8_get_codepoint(in, text + len - in, &c);
+
+		if (nread < 0)
+			goto error;
+
+		if (c > 0xffff)
+			goto error;
+
+		converted = unicode_lookup(t, c);
+		if (converted == GUND)
+			goto error;
+
+		if (converted & 0x1b00) {
+			*out = 0x1b;
+			++out;
+		}
+
+		*out = converted;
+		++out;
+		in += nread;
+	}
+
+	*items_read = in - text;
+
+	return out - buf;
+
+error:
+	*items_read = in - text;
+
+	return -1;
 }
 
-static bool conversion_table_init(struct conversion_table *t,
-					enum gsm_dialect locking,
-					enum gsm_dialect single)
+/* Length of text up to len bytes or the first '\0', like strnlen */
+static long utf8_length(const char *text, long len)
 {
-	memset(t, 0, sizeof(struct conversion_table));
+	const char *nul;
 
-	return populate_locking_shift(t, locking) &&
-			populate_single_shift(t, single);
+	if (len < 0)
+		return strlen(text);
+
+	nul = memchr(text, '\0', len);
+
+	return nul ? nul - text : len;
+}
+
+static unsigned char *utf8_to_gsm(const struct conversion_table *t,
+					const char *text, long len,
+					long *items_read, long *items_written,
+					unsigned char terminator)
+{
+	unsigned char *res;
+	long read;
+	long written;
+
+	len = utf8_length(text, len);
+
+	/* A character takes two bytes at most, escape included */
+	res = l_malloc(len * 2 + 1);
+	written = utf8_to_gsm_own_buf(t, text, len, &read, res);
+
+	if (items_read)
+		*items_read = read;
+
+	if (written < 0) {
+		l_free(res);
+		return NULL;
+	}
+
+	if (terminator)
+		res[written] = terminator;
+
+	if (items_written)
+		*items_written = written;
+
+	return l_realloc(res, written + (terminator ? 1 : 0));
 }
 
 /*!
@@ -2909,12 +3003,10 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 					enum gsm_dialect locking_lang,
 					enum gsm_dialect single_lang)
 {
-	char *res = NULL;
-	char *out;
-	long i = 0;
-	long res_length;
-
 	struct conversion_table t;
+	char *res;
+	long read = 0;
+	long written;
 
 	if (!conversion_table_init(&t, locking_lang, single_lang))
 		return NULL;
@@ -2923,77 +3015,34 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 		goto error;
 
 	if (len < 0) {
-		i = 0;
-
-		while (text[i] != terminator)
-			i++;
-
-		len = i;
-	}
-
-	for (i = 0, res_length = 0; i < len; i++) {
-		unsigned short c;
-
-		if (text[i] > 0x7f)
-			goto error;
-
-		if (text[i] == 0x1b) {
-			++i;
-			if (i >= len)
-				goto error;
-
-			c = gsm_single_shift_lookup(&t, text[i]);
-
-			/*
-			 * According to the comment in the table from
-			 * 3GPP 23.038, Section 6.2.1.1:
-			 * "In the event that an MS receives a code where
-			 * a symbol is not represented in the above table
-			 * then the MS shall display either the character
-			 * shown in the main GSM 7 bit default  alphabet
-			 * table in subclause 6.2.1., or the character from
-			 * the National Language Locking Shift Table in the
-			 * case where the locking shift mechanism as defined
-			 * in subclause 6.2.1.2.3 is used."
-			 */
-			if (c == GUND)
-				c = gsm_locking_shift_lookup(&t, text[i]);
-		} else
-			c = gsm_locking_shift_lookup(&t, text[i]);
+		len = 0;
 
-		res_length += UTF8_LENGTH(c);
+		while (text[len] != terminator)
+			len++;
 	}
 
-	res = l_malloc(res_length + 1);
-	out = res;
-
-	i = 0;
-	while (out < res + res_length) {
-		unsigned short c;
-
-		if (text[i] == 0x1b) {
-			c = gsm_single_shift_lookup(&t, text[++i]);
-
-			if (c == GUND)
-				c = gsm_locking_shift_lookup(&t, text[i]);
-		} else
-			c = gsm_locking_shift_lookup(&t, text[i]);
+	/* A character takes three bytes at most in UTF-8 */
+	res = l_malloc(len * 3 + 1);
+	written = gsm_to_utf8_own_buf(&t, text, len, &read, res);
 
-		out += l_utf8_from_wchar(c, out);
-
-		++i;
+	if (written < 0) {
+		l_free(res);
+		goto error;
 	}
 
-	*out = '\0';
+	if (items_read)
+		*items_read = read;
 
 	if (items_written)
-		*items_written = out - res;
+		*items_written = written;
+
+	return l_realloc(res, written + 1);
 
 error:
 	if (items_read)
-		*items_read = i;
+		*items_read = read;
 
-	return res;
+	return NULL;
 }
 
 char *convert_gsm_to_utf8(const unsigned char *text, long len,
@@ -3024,81 +3073,12 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 					enum gsm_dialect single_lang)
 {
 	struct conversion_table t;
-	long nchars = 0;
-	const char *in;
-	unsigned char *out;
-	unsigned char *res = NULL;
-	long res_len;
-	long i;
 
 	if (!conversion_table_init(&t, locking_lang, single_lang))
 		return NULL;
 
-	in = text;
-	res_len = 0;
-
-	while ((len < 0 || text + len - in > 0) && *in) {
-		long max = len < 0 ? 4 : text + len - in;
-		wchar_t c;
-		unsigned short converted;
-		int nread = l_utf8_get_codepoint(in, max, &c);
-
-		if (nread < 0)
-			goto err_out;
-
-		if (c > 0xffff)
-			goto err_out;
-
-		converted = unicode_locking_shift_lookup(&t, c);
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			goto err_out;
-
-		if (converted & 0x1b00)
-			res_len += 2;
-		else
-			res_len += 1;
-
-		in += nread;
-		nchars += 1;
-	}
-
-	res = l_malloc(res_len + (terminator ? 1 : 0));
-	in = text;
-	out = res;
-
-	for (i = 0; i < nchars; i++) {
-		wchar_t c;
-		unsigned short converted;
-		int nread = l_utf8_get_codepoint(in, 4, &c);
-
-		converted = unicode_locking_shift_lookup(&t, c);
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
-		if (converted & 0x1b00) {
-			*out = 0x1b;
-			++out;
-		}
-
-		*out = converted;
-		++out;
-		in += nread;
-	}
-
-	if (terminator)
-		*out = terminator;
-
-	if (items_written)
-		*items_written = out - res;
-
-err_out:
-	if (items_read)
-		*items_read = in - text;
-
-	return res;
+	return utf8_to_gsm(&t, text, len, items_read, items_written,
+				terminator);
 }
 
 unsigned char *convert_utf8_to_gsm(const char *text, long len,
@@ -3135,44 +3115,89 @@ unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 					enum gsm_dialect *used_locking,
 					enum gsm_dialect *used_single)
 {
-	enum gsm_dialect locking = GSM_DIALECT_DEFAULT;
-	enum gsm_dialect single = GSM_DIALECT_DEFAULT;
+	enum gsm_dialect locking[3];
+	enum gsm_dialect single[3];
+	struct conversion_table t[3];
 	unsigned char *encoded;
+	long failed_at[3];
+	bool failed[3];
+	int candidates = 0;
+	int remaining;
+	const char *in;
+	int i;
 
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+	locking[candidates] = GSM_DIALECT_DEFAULT;
+	single[candidates++] = GSM_DIALECT_DEFAULT;
 
-	if (hint == GSM_DIALECT_DEFAULT)
-		return NULL;
+	if (hint != GSM_DIALECT_DEFAULT) {
+		locking[candidates] = GSM_DIALECT_DEFAULT;
+		single[candidates++] = hint;
 
-	single = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+		/* Spanish dialect uses the default locking shift table */
+		if (hint != GSM_DIALECT_SPANISH) {
+			locking[candidates] = hint;
+			single[candidates++] = hint;
+		}
+	}
 
-	/* Spanish dialect uses the default locking shift table */
-	if (hint == GSM_DIALECT_SPANISH)
-		return NULL;
+	for (i = 0; i < candidates; i++) {
+		if (!conversion_table_init(&t[i], locking[i], single[i]))
+			break;
 
-	locking = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
+		failed[i] = false;
+	}
+
+	candidates = i;
+	remaining = candidates;
+	len = utf8_length(utf8, len);
+	in = utf8;
+
+	/* Rule the candidates out in a single pass over the text */
+	while (remaining && in < utf8 + len) {
+		wchar_t c;
+		int nread = l_utf8_get_codepoint(in, utf8 + len - in, &c);
+
+		for (i = 0; i < candidates; i++) {
+			if (failed[i])
+				continue;
+
+			if (nread >= 0 && c <= 0xffff &&
+					unicode_lookup(&t[i], c) != GUND)
+				continue;
+
+			failed[i] = true;
+			failed_at[i] = in - utf8;
+			remaining -= 1;
+		}
+
+		if (nread < 0)
+			break;
+
+		in += nread;
+	}
+
+	/* The candidates are ordered by the number of dialects used */
+	for (i = 0; i < candidates; i++)
+		if (!failed[i])
+			break;
+
+	if (i == candidates) {
+		if (candidates && items_read)
+			*items_read = failed_at[candidates - 1];
+
+		return NULL;
+	}
 
+	encoded = utf8_to_gsm(&t[i], utf8, len, items_read, items_written,
+				terminator);
 	if (encoded == NULL)
 		return NULL;
 
-out:
 	if (used_locking != NULL)
-		*used_locking = locking;
+		*used_locking = locking[i];
 
 	if (used_single != NULL)
-		*used_single = single;
+		*used_single = single[i];
 
 	return encoded;
 }
@@ -3674,10 +3699,8 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 					enum gsm_dialect single_lang)
 {
 	struct conversion_table t;
-	const unsigned char *in;
 	unsigned char *out;
-	unsigned char *res = NULL;
-	long res_len;
+	unsigned char *res;
 	long i;
 
 	if (!conversion_table_init(&t, locking_lang, single_lang))
@@ -3686,40 +3709,19 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 	if (len < 1 || len % 2)
 		return NULL;
 
-	in = text;
-	res_len = 0;
-
-	for (i = 0; i < len; i += 2) {
-		uint16_t c = l_get_be16(in + i);
-		uint16_t converted = GUND;
-
-		converted = unicode_locking_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			goto err_out;
-
-		if (converted & 0x1b00)
-			res_len += 2;
-		else
-			res_len += 1;
-	}
-
-	res = l_malloc(res_len + (terminator ? 1 : 0));
-
-	in = text;
+	/* A character takes two bytes at most, escape included */
+	res = l_malloc(len + 1);
 	out = res;
 
 	for (i = 0; i < len; i += 2) {
-		uint16_t c = l_get_be16(in + i);
-		uint16_t converted = GUND;
-
-		converted = unicode_locking_shift_lookup(&t, c);
+		uint16_t c = l_get_be16(text + i);
+		uint16_t converted = unicode_lookup(&t, c);
 
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
+		if (converted == GUND) {
+			l_free(res);
+			res = NULL;
+			goto err_out;
+		}
 
 		if (converted & 0x1b00) {
 			*out = 0x1b;
@@ -3736,6 +3738,8 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 	if (items_written)
 		*items_written = out - res;
 
+	res = l_realloc(res, out - res + (terminator ? 1 : 0));
+
 err_out:
 	if (items_read)
 		*items_read = i;
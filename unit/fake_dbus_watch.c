@@ -0,0 +1,96 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2019-2022 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#include "fake_dbus_watch.h"
+
+struct fake_dbus_watch {
+	guint id;
+	char *name;
+	GDBusWatchFunction func;
+	void *user_data;
+};
+
+static int fake_connection;
+static GSList *fake_watches;
+static guint fake_last_watch_id;
+
+DBusConnection *fake_dbus_watch_connection(void)
+{
+	return (DBusConnection *) &fake_connection;
+}
+
+guint fake_dbus_watch_count(void)
+{
+	return g_slist_length(fake_watches);
+}
+
+void fake_dbus_watch_name_lost(const char *name)
+{
+	GSList *l;
+
+	for (l = fake_watches; l; l = l->next) {
+		struct fake_dbus_watch *watch = l->data;
+
+		if (!g_strcmp0(watch->name, name)) {
+			/* The watch gets removed by the callback */
+			watch->func(fake_dbus_watch_connection(),
+							watch->user_data);
+			return;
+		}
+	}
+	g_assert_not_reached();
+}
+
+guint g_dbus_add_disconnect_watch(DBusConnection *connection, const char *name,
+		GDBusWatchFunction func, void *user_data,
+		GDBusDestroyFunction destroy)
+{
+	struct fake_dbus_watch *watch = g_new0(struct fake_dbus_watch, 1);
+
+	g_assert(connection == fake_dbus_watch_connection());
+	g_assert(!destroy);
+	watch->id = ++fake_last_watch_id;
+	watch->name = g_strdup(name);
+	watch->func = func;
+	watch->user_data = user_data;
+	fake_watches = g_slist_append(fake_watches, watch);
+	return watch->id;
+}
+
+gboolean g_dbus_remove_watch(DBusConnection *connection, guint id)
+{
+	GSList *l;
+
+	for (l = fake_watches; l; l = l->next) {
+		struct fake_dbus_watch *watch = l->data;
+
+		if (watch->id == id) {
+			fake_watches = g_slist_delete_link(fake_watches, l);
+			g_free(watch->name);
+			g_free(watch);
+			return TRUE;
+		}
+	}
+	g_assert_not_reached();
+	return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
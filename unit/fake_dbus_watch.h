@@ -0,0 +1,38 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2019-2022 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef FAKE_DBUS_WATCH_H
+#define FAKE_DBUS_WATCH_H
+
+#include <gdbus.h>
+
+/*
+ * Provides g_dbus_add_disconnect_watch() and g_dbus_remove_watch()
+ * for the connection returned by fake_dbus_watch_connection().
+ */
+
+DBusConnection *fake_dbus_watch_connection(void);
+guint fake_dbus_watch_count(void);
+void fake_dbus_watch_name_lost(const char *name);
+
+#endif /* FAKE_DBUS_WATCH_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -33,6 +33,7 @@
 #define CELL_INFO_DBUS_INTERFACE            "org.nemomobile.ofono.CellInfo"
 #define CELL_INFO_DBUS_CELLS_ADDED_SIGNAL   "CellsAdded"
 #define CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL "CellsRemoved"
+#define CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL "CellsChanged"
 #define CELL_INFO_DBUS_UNSUBSCRIBED_SIGNAL  "Unsubscribed"
 
 #define CELL_DBUS_INTERFACE_VERSION         (1)
@@ -1145,6 +1146,138 @@ static void test_unsubscribe(void)
 	}
 }
 
+/* ==== CellsChanged ==== */
+
+struct test_cells_changed_data {
+	struct ofono_modem modem;
+	struct test_dbus_context context;
+	struct cell_info_dbus *dbus;
+	CellInfoControl *ctl;
+};
+
+static void test_cells_changed_reply2(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+	DBusMessageIter it, array, entry;
+	DBusMessage *signal = test_dbus_take_signal(&test->context,
+				test->modem.path, CELL_INFO_DBUS_INTERFACE,
+				CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL);
+	dbus_bool_t registered = FALSE;
+
+	DBG("");
+	test_check_get_cells_reply(call, "/test/cell_1", "/test/cell_2", NULL);
+	dbus_pending_call_unref(call);
+
+	/* Everything arrives in a single signal */
+	g_assert(signal);
+	g_assert(!test_dbus_find_signal(&test->context, test->modem.path,
+		CELL_INFO_DBUS_INTERFACE, CELL_INFO_DBUS_CELLS_CHANGED_SIGNAL));
+	dbus_message_iter_init(signal, &it);
+	dbus_message_iter_recurse(&it, &array);
+	g_assert(!g_strcmp0(test_dbus_get_object_path(&array),
+							"/test/cell_2"));
+	g_assert(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_INVALID);
+	dbus_message_iter_next(&it);
+	dbus_message_iter_recurse(&it, &array);
+	g_assert(!g_strcmp0(test_dbus_get_object_path(&array),
+							"/test/cell_0"));
+	g_assert(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_INVALID);
+	dbus_message_iter_next(&it);
+	g_assert(dbus_message_iter_get_arg_type(&it) == DBUS_TYPE_ARRAY);
+	dbus_message_iter_recurse(&it, &array);
+	g_assert(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT);
+	dbus_message_iter_recurse(&array, &entry);
+	g_assert(!g_strcmp0(test_dbus_get_object_path(&entry),
+							"/test/cell_1"));
+	g_assert(dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_BOOLEAN);
+	dbus_message_iter_get_basic(&entry, &registered);
+	g_assert(registered);
+	dbus_message_iter_next(&array);
+	g_assert(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_INVALID);
+	dbus_message_unref(signal);
+
+	/* Legacy signals are only sent to GetCells clients */
+	g_assert(!test_dbus_find_signal(&test->context, test->modem.path,
+		CELL_INFO_DBUS_INTERFACE, CELL_INFO_DBUS_CELLS_ADDED_SIGNAL));
+	g_assert(!test_dbus_find_signal(&test->context, test->modem.path,
+		CELL_INFO_DBUS_INTERFACE, CELL_INFO_DBUS_CELLS_REMOVED_SIGNAL));
+
+	test_loop_quit_later(test->context.loop);
+	test_dbus_watch_disconnect_all();
+}
+
+static void test_cells_changed_reply1(DBusPendingCall *call, void *data)
+{
+	struct test_cells_changed_data *test = data;
+	struct ofono_cell_info *info = test->ctl->info;
+	struct ofono_cell cell;
+
+	DBG("");
+	test_check_get_cells_reply(call, "/test/cell_0", "/test/cell_1", NULL);
+	dbus_pending_call_unref(call);
+
+	/* The requested interval wins over the default one */
+	g_assert(fake_cell_info_is_enabled(info));
+	g_assert_cmpint(fake_cell_info_update_interval(info), == ,1000);
+
+	/* Remove, add and change at once */
+	g_assert(fake_cell_info_remove_cell(info, test_cell_init_gsm1(&cell)));
+	fake_cell_info_add_cell(info, test_cell_init_gsm2(&cell));
+	info->cells[0]->info.wcdma.signalStrength++;
+	fake_cell_info_cells_changed(info);
+
+	test_submit_cell_info_call(test->context.client_connection, "GetCells",
+					test_cells_changed_reply2, test);
+}
+
+static void test_cells_changed_start(struct test_dbus_context *context)
+{
+	struct ofono_cell cell;
+	struct ofono_cell_info *info = fake_cell_info_new();
+	struct test_cells_changed_data *test =
+		G_CAST(context, struct test_cells_changed_data, context);
+	DBusMessage *msg = test_new_cell_info_call("Subscribe");
+	const dbus_int32_t ms = 1000;
+	DBusPendingCall* call;
+
+	DBG("");
+	fake_cell_info_add_cell(info, test_cell_init_gsm1(&cell));
+	fake_cell_info_add_cell(info, test_cell_init_wcdma1(&cell));
+	test->ctl = cell_info_control_get(test->modem.path);
+	cell_info_control_set_cell_info(test->ctl, info);
+
+	test->dbus = cell_info_dbus_new(&test->modem, test->ctl);
+	g_assert(test->dbus);
+	ofono_cell_info_unref(info);
+
+	dbus_message_append_args(msg, DBUS_TYPE_INT32, &ms, DBUS_TYPE_INVALID);
+	g_assert(dbus_connection_send_with_reply(context->client_connection,
+					msg, &call, DBUS_TIMEOUT_INFINITE));
+	dbus_pending_call_set_notify(call, test_cells_changed_reply1, test,
+									NULL);
+	dbus_message_unref(msg);
+}
+
+static void test_cells_changed(void)
+{
+	struct test_cells_changed_data test;
+	guint timeout = test_setup_timeout();
+
+	memset(&test, 0, sizeof(test));
+	test.modem.path = TEST_MODEM_PATH;
+	test.context.start = test_cells_changed_start;
+	test_dbus_setup(&test.context);
+
+	g_main_loop_run(test.context.loop);
+
+	cell_info_control_unref(test.ctl);
+	cell_info_dbus_free(test.dbus);
+	test_dbus_shutdown(&test.context);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
 #define TEST_(name) "/cell-info-dbus/" name
 
 int main(int argc, char *argv[])
@@ -1182,6 +1315,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("RegisteredChanged"), test_registered_changed);
 	g_test_add_func(TEST_("PropertyChanged"), test_property_changed);
 	g_test_add_func(TEST_("Unsubscribe"), test_unsubscribe);
+	g_test_add_func(TEST_("CellsChanged"), test_cells_changed);
 
 	return g_test_run();
 }
@@ -15,9 +15,33 @@
  */
 
 #include "ofono.h"
+#include "fake_dbus_watch.h"
+
+#include <gdbus.h>
 
 #include <errno.h>
 
+#define TEST_SENDER ":1.0"
+#define TEST_SENDER_1 ":1.1"
+#define TEST_BENCH_CALLS (100000)
+
+/*==========================================================================*
+ * Stubs
+ *==========================================================================*/
+
+static gboolean test_no_connection;
+
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	return test_no_connection ? NULL : fake_dbus_watch_connection();
+}
+
+/*==========================================================================*
+ * Plugins
+ *==========================================================================*/
+
+static int counting_calls;
+
 static enum ofono_dbus_access dontcare_method_access(const char *sender,
 	enum ofono_dbus_access_intf intf, int method, const char *arg)
 {
@@ -40,6 +64,14 @@ static enum ofono_dbus_access broken_method_access(const char *sender,
 	return (enum ofono_dbus_access)(-1);
 }
 
+static enum ofono_dbus_access counting_method_access(const char *sender,
+	enum ofono_dbus_access_intf intf, int method, const char *arg)
+{
+	counting_calls++;
+	return (method == OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL) ?
+		OFONO_DBUS_ACCESS_DENY : OFONO_DBUS_ACCESS_ALLOW;
+}
+
 struct ofono_dbus_access_plugin access_inval;
 struct ofono_dbus_access_plugin access_dontcare = {
 	.name = "DontCare",
@@ -63,6 +95,12 @@ struct ofono_dbus_access_plugin access_broken = {
 	.method_access = broken_method_access
 };
 
+struct ofono_dbus_access_plugin access_counting = {
+	.name = "Counting",
+	.priority = OFONO_DBUS_ACCESS_PRIORITY_DEFAULT,
+	.method_access = counting_method_access
+};
+
 /*==========================================================================*
  * Tests
  *==========================================================================*/
@@ -187,6 +225,124 @@ static void test_register()
 	ofono_dbus_access_plugin_unregister(&access_dontcare);
 }
 
+static void test_cache()
+{
+	const enum ofono_dbus_access_intf intf =
+		OFONO_DBUS_ACCESS_INTF_VOICECALLMGR;
+	const int dial = OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL;
+	const int transfer = OFONO_DBUS_ACCESS_VOICECALLMGR_TRANSFER;
+	unsigned int hits, misses, hits0, misses0;
+
+	counting_calls = 0;
+	g_assert(!ofono_dbus_access_plugin_register(&access_counting));
+	__ofono_dbus_access_cache_stats(&hits0, &misses0);
+
+	/* The first call for each method is a miss */
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									NULL));
+	g_assert(ofono_dbus_access_method_allowed(TEST_SENDER, intf, transfer,
+									NULL));
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									NULL));
+	g_assert(ofono_dbus_access_method_allowed(TEST_SENDER, intf, transfer,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,2);
+	__ofono_dbus_access_cache_stats(&hits, &misses);
+	g_assert_cmpuint(hits - hits0, == ,2);
+	g_assert_cmpuint(misses - misses0, == ,2);
+
+	/* Each sender has its own entry (and watch) */
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER_1, intf, dial,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,3);
+	g_assert_cmpuint(fake_dbus_watch_count(), == ,2);
+
+	/* Calls with an argument and unknown methods aren't cached */
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									"x"));
+	g_assert(ofono_dbus_access_method_allowed(TEST_SENDER, intf, -1,
+									NULL));
+	g_assert(ofono_dbus_access_method_allowed(NULL, intf, dial + 1,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,6);
+
+	/* The sender is gone */
+	fake_dbus_watch_name_lost(TEST_SENDER);
+	g_assert_cmpuint(fake_dbus_watch_count(), == ,1);
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,7);
+
+	/* Flushing one sender and everything */
+	ofono_dbus_access_flush(TEST_SENDER);
+	ofono_dbus_access_flush("unknown");
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,8);
+	ofono_dbus_access_flush(NULL);
+	g_assert(!fake_dbus_watch_count());
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,9);
+
+	/* No caching without the bus */
+	test_no_connection = TRUE;
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER_1, intf, dial,
+									NULL));
+	g_assert(!ofono_dbus_access_method_allowed(TEST_SENDER_1, intf, dial,
+									NULL));
+	g_assert_cmpint(counting_calls, == ,11);
+	test_no_connection = FALSE;
+
+	/* Unregistering the plugin drops the cache */
+	ofono_dbus_access_plugin_unregister(&access_counting);
+	g_assert(!fake_dbus_watch_count());
+	g_assert(ofono_dbus_access_method_allowed(TEST_SENDER, intf, dial,
+									NULL));
+	ofono_dbus_access_flush(NULL);
+}
+
+static void test_benchmark()
+{
+	const enum ofono_dbus_access_intf intf =
+		OFONO_DBUS_ACCESS_INTF_VOICECALLMGR;
+	const int transfer = OFONO_DBUS_ACCESS_VOICECALLMGR_TRANSFER;
+	unsigned int hits, misses, hits0, misses0;
+	gint64 start, uncached, cached;
+	int i;
+
+	counting_calls = 0;
+	g_assert(!ofono_dbus_access_plugin_register(&access_dontcare));
+	g_assert(!ofono_dbus_access_plugin_register(&access_counting));
+	__ofono_dbus_access_cache_stats(&hits0, &misses0);
+
+	/* The argument bypasses the cache */
+	start = g_get_monotonic_time();
+	for (i = 0; i < TEST_BENCH_CALLS; i++) {
+		ofono_dbus_access_method_allowed(TEST_SENDER, intf, transfer,
+									"");
+	}
+	uncached = g_get_monotonic_time() - start;
+	g_assert_cmpint(counting_calls, == ,TEST_BENCH_CALLS);
+
+	start = g_get_monotonic_time();
+	for (i = 0; i < TEST_BENCH_CALLS; i++) {
+		ofono_dbus_access_method_allowed(TEST_SENDER, intf, transfer,
+									NULL);
+	}
+	cached = g_get_monotonic_time() - start;
+	g_assert_cmpint(counting_calls, == ,TEST_BENCH_CALLS + 1);
+
+	__ofono_dbus_access_cache_stats(&hits, &misses);
+	g_assert_cmpuint(hits - hits0, == ,TEST_BENCH_CALLS - 1);
+	g_assert_cmpuint(misses - misses0, == ,1);
+	DBG("%d calls: %d us uncached, %d us cached", TEST_BENCH_CALLS,
+					(int)uncached, (int)cached);
+
+	ofono_dbus_access_plugin_unregister(&access_counting);
+	ofono_dbus_access_plugin_unregister(&access_dontcare);
+}
+
 #define TEST_(test) "/dbus-access/" test
 
 int main(int argc, char *argv[])
@@ -208,6 +364,8 @@ int main(int argc, char *argv[])
 		g_free(name);
 	}
 	g_test_add_func(TEST_("register"), test_register);
+	g_test_add_func(TEST_("cache"), test_cache);
+	g_test_add_func(TEST_("benchmark"), test_benchmark);
 	return g_test_run();
 }
 
@@ -34,6 +34,11 @@
 #define TEST_PROPERTY_CHANGED_SIGNAL    "PropertyChanged"
 #define TEST_PROPERTY_NAME              "Test"
 #define TEST_PROPERTY_VALUE             "test"
+#define TEST_PROPERTY_NAME_1            "Test1"
+#define TEST_MARKER_SIGNAL              "Marker"
+
+#define TEST_FANOUT_CLIENTS             (200)
+#define TEST_FANOUT_UPDATES             (50)
 
 struct test_data {
 	struct test_dbus_context dbus;
@@ -69,6 +74,7 @@ static const GDBusMethodTable test_dummy_methods[] = {
 static const GDBusSignalTable test_property_change_signal[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL(TEST_MARKER_SIGNAL, NULL) },
 	{ }
 };
 
@@ -241,6 +247,125 @@ static void test_signal(void)
 	}
 }
 
+/* ==== fanout ==== */
+
+struct test_fanout_data {
+	struct test_dbus_context dbus;
+	struct ofono_dbus_clients *clients;
+	int test_count;
+	int test1_count;
+	int marker_count;
+	char *last_value;
+};
+
+static void test_fanout_handle(struct test_dbus_context *dbus,
+							DBusMessage *msg)
+{
+	struct test_fanout_data *test =
+		G_CAST(dbus, struct test_fanout_data, dbus);
+	const char *member = dbus_message_get_member(msg);
+
+	if (!g_strcmp0(member, TEST_MARKER_SIGNAL)) {
+		test->marker_count++;
+		if (test->marker_count == TEST_FANOUT_CLIENTS) {
+			test_loop_quit_later(dbus->loop);
+		}
+	} else {
+		DBusMessageIter it, var;
+		const char *name;
+		const char *value;
+
+		/* Nothing may arrive after the marker */
+		g_assert(!test->marker_count);
+		g_assert_cmpstr(member, == ,TEST_PROPERTY_CHANGED_SIGNAL);
+		dbus_message_iter_init(msg, &it);
+		name = test_dbus_get_string(&it);
+		dbus_message_iter_recurse(&it, &var);
+		value = test_dbus_get_string(&var);
+		if (!g_strcmp0(name, TEST_PROPERTY_NAME)) {
+			test->test_count++;
+			g_free(test->last_value);
+			test->last_value = g_strdup(value);
+		} else {
+			g_assert_cmpstr(name, == ,TEST_PROPERTY_NAME_1);
+			test->test1_count++;
+		}
+	}
+}
+
+static void test_fanout_start(struct test_dbus_context *dbus)
+{
+	struct test_fanout_data *test =
+		G_CAST(dbus, struct test_fanout_data, dbus);
+	const char *value = TEST_PROPERTY_VALUE;
+	DBusMessage *marker;
+	gint64 start;
+	int i;
+
+	test_register_dummy_interface();
+	test->clients = ofono_dbus_clients_new(ofono_dbus_get_connection(),
+								NULL, NULL);
+
+	for (i = 0; i < TEST_FANOUT_CLIENTS; i++) {
+		char *name = g_strdup_printf(":1.%d", i);
+
+		g_assert(ofono_dbus_clients_add(test->clients, name));
+		g_free(name);
+	}
+
+	/* Only the last value of each property is expected to be sent */
+	start = g_get_monotonic_time();
+	for (i = 0; i < TEST_FANOUT_UPDATES; i++) {
+		char *str = g_strdup_printf("%d", i);
+
+		ofono_dbus_clients_signal_property_changed(test->clients,
+				TEST_DBUS_PATH, TEST_DBUS_INTERFACE,
+				TEST_PROPERTY_NAME, DBUS_TYPE_STRING, &str);
+		g_free(str);
+	}
+	ofono_dbus_clients_signal_property_changed(test->clients,
+				TEST_DBUS_PATH, TEST_DBUS_INTERFACE,
+				TEST_PROPERTY_NAME_1, DBUS_TYPE_STRING, &value);
+
+	/* This one flushes the property changes */
+	marker = dbus_message_new_signal(TEST_DBUS_PATH,
+			TEST_DBUS_INTERFACE, TEST_MARKER_SIGNAL);
+	ofono_dbus_clients_signal(test->clients, marker);
+	dbus_message_unref(marker);
+	DBG("%d clients x %d updates: %d us", TEST_FANOUT_CLIENTS,
+		TEST_FANOUT_UPDATES, (int)(g_get_monotonic_time() - start));
+}
+
+static void test_fanout(void)
+{
+	struct test_fanout_data test;
+	guint timeout = test_setup_timeout();
+	char *last = g_strdup_printf("%d", TEST_FANOUT_UPDATES - 1);
+
+	memset(&test, 0, sizeof(test));
+	test_dbus_setup(&test.dbus);
+	test.dbus.start = test_fanout_start;
+	test.dbus.handle_signal = test_fanout_handle;
+
+	g_main_loop_run(test.dbus.loop);
+
+	g_assert_cmpint(test.test_count, == ,TEST_FANOUT_CLIENTS);
+	g_assert_cmpint(test.test1_count, == ,TEST_FANOUT_CLIENTS);
+	g_assert_cmpint(test.marker_count, == ,TEST_FANOUT_CLIENTS);
+	g_assert_cmpstr(test.last_value, == ,last);
+	g_free(test.last_value);
+	g_free(last);
+
+	test_dbus_watch_disconnect_all();
+	g_assert_cmpuint(ofono_dbus_clients_count(test.clients), == ,0);
+	ofono_dbus_clients_free(test.clients);
+
+	test_dbus_shutdown(&test.dbus);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
 #define TEST_(name) "/dbus-clients/" name
 
 int main(int argc, char *argv[])
@@ -267,6 +392,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("null"), test_null);
 	g_test_add_func(TEST_("basic"), test_basic);
 	g_test_add_func(TEST_("signal"), test_signal);
+	g_test_add_func(TEST_("fanout"), test_fanout);
 
 	return g_test_run();
 }
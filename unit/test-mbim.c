@@ -23,7 +23,10 @@
 #include <config.h>
 #endif
 
+#include <unistd.h>
+#include <errno.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
 #include <linux/types.h>
 #include <assert.h>
 
@@ -718,6 +721,408 @@ static void parse_ip_configuration_query(const void *data)
 	mbim_message_unref(msg);
 }
 
+#define STRESS_SEGMENT_SIZE	128
+#define STRESS_INDICATIONS	400
+#define STRESS_CID		11
+
+struct stress_data {
+	uint8_t *stream;		/* What the fake function sends */
+	size_t stream_len;
+	size_t stream_pos;
+	uint32_t *expected;		/* Indications in completion order */
+	unsigned int n_expected;
+	unsigned int n_received;
+	bool ready;
+};
+
+static void stress_body(unsigned int seq, uint8_t *body, size_t *out_len)
+{
+	size_t info_len = 1 + (seq * 37) % 700;
+	size_t i;
+
+	memcpy(body, mbim_uuid_basic_connect, 16);
+	l_put_le32(STRESS_CID, body + 16);
+	l_put_le32(info_len, body + 20);
+
+	for (i = 0; i < info_len; i++)
+		body[24 + i] = seq * 7 + i;
+
+	*out_len = 24 + info_len;
+}
+
+static void stress_append(struct stress_data *data, uint32_t type,
+				uint32_t tid, uint32_t n_frags,
+				uint32_t cur_frag, const void *payload,
+				size_t len)
+{
+	uint8_t *p;
+
+	data->stream = l_realloc(data->stream, data->stream_len + 20 + len);
+	p = data->stream + data->stream_len;
+
+	l_put_le32(type, p);
+	l_put_le32(20 + len, p + 4);
+	l_put_le32(tid, p + 8);
+	l_put_le32(n_frags, p + 12);
+	l_put_le32(cur_frag, p + 16);
+	memcpy(p + 20, payload, len);
+
+	data->stream_len += 20 + len;
+}
+
+/*
+ * Two indications at a time, with their fragments interleaved so that
+ * reassembly has to keep them apart by tid
+ */
+static void stress_build(struct stress_data *data)
+{
+	static const size_t chunk = STRESS_SEGMENT_SIZE - 20;
+	uint8_t open_done[16];
+	unsigned int seq;
+
+	l_put_le32(MBIM_OPEN_DONE, open_done);
+	l_put_le32(sizeof(open_done), open_done + 4);
+	l_put_le32(1, open_done + 8);
+	l_put_le32(0, open_done + 12);
+
+	data->stream = l_memdup(open_done, sizeof(open_done));
+	data->stream_len = sizeof(open_done);
+	data->expected = l_new(uint32_t, STRESS_INDICATIONS);
+
+	for (seq = 0; seq < STRESS_INDICATIONS; seq += 2) {
+		uint8_t body[2][1024];
+		size_t len[2];
+		uint32_t n_frags[2];
+		uint32_t frag;
+		unsigned int i;
+
+		for (i = 0; i < 2; i++) {
+			stress_body(seq + i, body[i], &len[i]);
+			n_frags[i] = (len[i] + chunk - 1) / chunk;
+		}
+
+		for (frag = 0; frag < n_frags[0] || frag < n_frags[1]; frag++) {
+			for (i = 0; i < 2; i++) {
+				size_t offset = frag * chunk;
+				size_t frag_len = len[i] - offset;
+
+				if (frag >= n_frags[i])
+					continue;
+
+				if (frag_len > chunk)
+					frag_len = chunk;
+
+				stress_append(data, MBIM_INDICATE_STATUS_MSG,
+						seq + i + 1, n_frags[i], frag,
+						body[i] + offset, frag_len);
+
+				if (frag + 1 == n_frags[i])
+					data->expected[data->n_expected++] =
+								seq + i;
+			}
+		}
+	}
+}
+
+static bool stress_write(struct l_io *io, void *user_data)
+{
+	struct stress_data *data = user_data;
+	size_t len = data->stream_len - data->stream_pos;
+	ssize_t written;
+
+	/*
+	 * Odd sized writes, so reads end up split at any point, including
+	 * the Status field of OPEN_DONE
+	 */
+	if (len > 1 + data->stream_pos % 311)
+		len = 1 + data->stream_pos % 311;
+
+	written = write(l_io_get_fd(io), data->stream + data->stream_pos, len);
+	if (written > 0)
+		data->stream_pos += written;
+
+	return data->stream_pos < data->stream_len;
+}
+
+static void stress_ready(void *user_data)
+{
+	struct stress_data *data = user_data;
+
+	data->ready = true;
+}
+
+static void stress_notify(struct mbim_message *message, void *user_data)
+{
+	struct stress_data *data = user_data;
+	uint8_t expected[1024];
+	size_t expected_len;
+	struct iovec *iov;
+	size_t n_iov;
+	size_t pos = 0;
+	size_t i;
+
+	assert(data->n_received < data->n_expected);
+	stress_body(data->expected[data->n_received], expected, &expected_len);
+
+	iov = _mbim_message_get_body(message, &n_iov, NULL);
+
+	for (i = 0; i < n_iov; i++) {
+		assert(pos + iov[i].iov_len <= expected_len);
+		assert(!memcmp(iov[i].iov_base, expected + pos,
+							iov[i].iov_len));
+		pos += iov[i].iov_len;
+	}
+
+	assert(pos == expected_len);
+	data->n_received += 1;
+}
+
+static void fragmented_indications(const void *test_data)
+{
+	struct stress_data data;
+	struct mbim_device *device;
+	struct l_io *io;
+	unsigned int loops = 0;
+	int fds[2];
+
+	memset(&data, 0, sizeof(data));
+	stress_build(&data);
+
+	assert(l_main_init());
+	assert(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+	device = mbim_device_new(fds[0], STRESS_SEGMENT_SIZE);
+	assert(device);
+
+	mbim_device_set_ready_handler(device, stress_ready, &data, NULL);
+	mbim_device_register(device, 0, mbim_uuid_basic_connect, STRESS_CID,
+				stress_notify, &data, NULL);
+
+	/* The fake function, the MBIM_OPEN_MSG it gets is never read */
+	io = l_io_new(fds[1]);
+	l_io_set_write_handler(io, stress_write, &data, NULL);
+
+	while (data.n_received < data.n_expected) {
+		assert(loops++ < 100000);
+		l_main_iterate(100);
+	}
+
+	assert(data.ready);
+	assert(data.stream_pos == data.stream_len);
+
+	l_io_destroy(io);
+	mbim_device_unref(device);
+	close(fds[0]);
+	close(fds[1]);
+
+	l_main_exit();
+
+	l_free(data.stream);
+	l_free(data.expected);
+}
+
+#define LATENCY_COMMANDS	4
+
+struct latency_test {
+	uint32_t max_outstanding;
+	unsigned int delay;		/* ms the fake function takes per command */
+};
+
+struct latency_data {
+	const struct latency_test *test;
+	struct mbim_device *device;
+	struct l_io *io;
+	uint8_t buf[4096];
+	size_t buf_len;
+	unsigned int in_flight;
+	unsigned int max_in_flight;
+	uint64_t start;
+	uint64_t elapsed;
+	bool done;
+};
+
+struct latency_reply {
+	struct latency_data *data;
+	uint8_t msg[48];
+};
+
+static void latency_reply_timeout(struct l_timeout *timeout, void *user_data)
+{
+	struct latency_reply *reply = user_data;
+	struct latency_data *data = reply->data;
+
+	assert(write(l_io_get_fd(data->io), reply->msg, sizeof(reply->msg)) ==
+						sizeof(reply->msg));
+	data->in_flight -= 1;
+
+	l_timeout_remove(timeout);
+}
+
+static void latency_command(struct latency_data *data, const uint8_t *msg)
+{
+	struct latency_reply *reply = l_new(struct latency_reply, 1);
+
+	/* Echo the tid, service and cid back with an empty success reply */
+	reply->data = data;
+	l_put_le32(MBIM_COMMAND_DONE, reply->msg);
+	l_put_le32(sizeof(reply->msg), reply->msg + 4);
+	memcpy(reply->msg + 8, msg + 8, 4);
+	l_put_le32(1, reply->msg + 12);
+	l_put_le32(0, reply->msg + 16);
+	memcpy(reply->msg + 20, msg + 20, 20);
+	l_put_le32(0, reply->msg + 40);
+	l_put_le32(0, reply->msg + 44);
+
+	data->in_flight += 1;
+	if (data->in_flight > data->max_in_flight)
+		data->max_in_flight = data->in_flight;
+
+	l_timeout_create_ms(data->test->delay, latency_reply_timeout,
+					reply, l_free);
+}
+
+static bool latency_read(struct l_io *io, void *user_data)
+{
+	struct latency_data *data = user_data;
+	ssize_t len;
+	uint32_t msg_len;
+
+	len = read(l_io_get_fd(io), data->buf + data->buf_len,
+					sizeof(data->buf) - data->buf_len);
+	if (len <= 0)
+		return len < 0 && errno == EAGAIN;
+
+	data->buf_len += len;
+
+	while (data->buf_len >= 12) {
+		msg_len = l_get_le32(data->buf + 4);
+		assert(msg_len >= 12 && msg_len <= sizeof(data->buf));
+
+		if (data->buf_len < msg_len)
+			break;
+
+		switch (l_get_le32(data->buf)) {
+		case MBIM_OPEN_MSG:
+		{
+			uint8_t open_done[16];
+
+			l_put_le32(MBIM_OPEN_DONE, open_done);
+			l_put_le32(sizeof(open_done), open_done + 4);
+			memcpy(open_done + 8, data->buf + 8, 4);
+			l_put_le32(0, open_done + 12);
+			assert(write(l_io_get_fd(io), open_done,
+					sizeof(open_done)) == sizeof(open_done));
+			break;
+		}
+		case MBIM_COMMAND_MSG:
+			latency_command(data, data->buf);
+			break;
+		}
+
+		memmove(data->buf, data->buf + msg_len, data->buf_len - msg_len);
+		data->buf_len -= msg_len;
+	}
+
+	return true;
+}
+
+static void latency_batch_done(struct mbim_message **replies,
+					unsigned int n_replies, void *user_data)
+{
+	struct latency_data *data = user_data;
+	unsigned int i;
+
+	assert(!data->done);
+	assert(n_replies == LATENCY_COMMANDS);
+
+	/* Replies come back in submission order */
+	for (i = 0; i < n_replies; i++) {
+		assert(mbim_message_get_error(replies[i]) == 0);
+		assert(mbim_message_get_cid(replies[i]) == i + 1);
+	}
+
+	data->elapsed = l_time_diff(data->start, l_time_now());
+	data->done = true;
+}
+
+static void latency_ready(void *user_data)
+{
+	struct latency_data *data = user_data;
+	struct mbim_message *messages[LATENCY_COMMANDS];
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_COMMANDS; i++) {
+		messages[i] = mbim_message_new(mbim_uuid_basic_connect, i + 1,
+						MBIM_COMMAND_TYPE_QUERY);
+		assert(messages[i]);
+		mbim_message_set_arguments(messages[i], "");
+	}
+
+	data->start = l_time_now();
+	assert(mbim_device_send_batch(data->device, 0, messages,
+					LATENCY_COMMANDS, latency_batch_done,
+					data, NULL));
+}
+
+static void batch_latency(const void *test_data)
+{
+	const struct latency_test *test = test_data;
+	struct latency_data data;
+	unsigned int loops = 0;
+	uint64_t serial = LATENCY_COMMANDS * test->delay * 1000ULL;
+	unsigned int window;
+	int fds[2];
+
+	memset(&data, 0, sizeof(data));
+	data.test = test;
+
+	assert(l_main_init());
+	assert(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+	data.device = mbim_device_new(fds[0], 512);
+	assert(data.device);
+
+	mbim_device_set_max_outstanding(data.device, test->max_outstanding);
+	mbim_device_set_ready_handler(data.device, latency_ready, &data, NULL);
+
+	/* The fake function, answers each command after test->delay ms */
+	data.io = l_io_new(fds[1]);
+	l_io_set_read_handler(data.io, latency_read, &data, NULL);
+
+	while (!data.done) {
+		assert(loops++ < 100000);
+		l_main_iterate(100);
+	}
+
+	window = test->max_outstanding < LATENCY_COMMANDS ?
+					test->max_outstanding : LATENCY_COMMANDS;
+	assert(data.max_in_flight == window);
+
+	/* Wall clock time depends on the machine, only trace it */
+	l_util_debug(do_debug, "[LATENCY] ",
+			"%u commands, window %u: %llu us, %llu us serially",
+			LATENCY_COMMANDS, window,
+			(unsigned long long) data.elapsed,
+			(unsigned long long) serial);
+
+	l_io_destroy(data.io);
+	mbim_device_unref(data.device);
+	close(fds[0]);
+	close(fds[1]);
+
+	l_main_exit();
+}
+
+static const struct latency_test latency_serial = {
+	.max_outstanding = 1,
+	.delay = 20,
+};
+
+static const struct latency_test latency_window = {
+	.max_outstanding = LATENCY_COMMANDS,
+	.delay = 20,
+};
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -762,5 +1167,13 @@ int main(int argc, char *argv[])
 				parse_ip_configuration_query,
 				&message_data_ip_configuration_query);
 
+	l_test_add("Fragmented Indications (device)",
+				fragmented_indications, NULL);
+
+	l_test_add("Batch Latency [Serial] (device)",
+				batch_latency, &latency_serial);
+	l_test_add("Batch Latency [Window] (device)",
+				batch_latency, &latency_window);
+
 	return l_test_run();
 }
@@ -37,6 +37,9 @@
 
 #include "gatmux.h"
 #include "gsm0710.h"
+#include "gatio.h"
+#include "gathdlc.h"
+#include "gatutil.h"
 
 static int do_connect(const char *address, unsigned short port)
 {
@@ -556,6 +559,129 @@ static void test_extract_advanced(void)
 	g_assert(total == sizeof(advanced_input2) - 1);
 }
 
+static const struct iovec writev_data[] = {
+	{ .iov_base = "abc", .iov_len = 3 },
+	{ .iov_base = "defg", .iov_len = 4 },
+};
+
+static gboolean buf_contains(const char *buf, gsize len, const char *str)
+{
+	gsize n = strlen(str);
+	gsize i;
+
+	for (i = 0; i + n <= len; i++)
+		if (!memcmp(buf + i, str, n))
+			return TRUE;
+
+	return FALSE;
+}
+
+static void test_writev_fd(void)
+{
+	GIOChannel *channel;
+	GAtIO *io;
+	char buf[16];
+	guint calls;
+	gsize bytes;
+	int fds[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	channel = g_io_channel_unix_new(fds[0]);
+	io = g_at_io_new(channel);
+	g_assert(io);
+
+	/* Both buffers go out in one syscall */
+	g_assert(g_at_io_writev(io, writev_data, 2) == 7);
+	g_assert(g_at_io_get_write_stats(io, &calls, &bytes));
+	g_assert(calls == 1);
+	g_assert(bytes == 7);
+
+	g_assert(read(fds[1], buf, sizeof(buf)) == 7);
+	g_assert(!memcmp(buf, "abcdefg", 7));
+
+	g_at_io_unref(io);
+	g_io_channel_unref(channel);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void test_writev_dlc(void)
+{
+	GIOChannel *channel;
+	GIOChannel *dlc;
+	GAtMux *m;
+	GAtIO *io;
+	char buf[256];
+	guint calls;
+	gsize bytes;
+	ssize_t len;
+	int fds[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	channel = g_io_channel_unix_new(fds[0]);
+	g_assert(g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK));
+
+	m = g_at_mux_new_gsm0710_basic(channel, 31);
+	g_io_channel_unref(channel);
+	g_assert(g_at_mux_start(m));
+
+	dlc = g_at_mux_create_channel(m);
+	g_assert(dlc);
+	io = g_at_io_new(dlc);
+	g_assert(io);
+
+	/* A DLC has no fd, each buffer is framed and written separately */
+	g_assert(g_at_io_writev(io, writev_data, 2) == 7);
+	g_assert(g_at_io_get_write_stats(io, &calls, &bytes));
+	g_assert(calls == 2);
+	g_assert(bytes == 7);
+
+	len = read(fds[1], buf, sizeof(buf));
+	g_assert(len > 0);
+	g_assert(buf_contains(buf, len, "abc"));
+	g_assert(buf_contains(buf, len, "defg"));
+
+	g_at_io_unref(io);
+	g_io_channel_unref(dlc);
+	g_at_mux_shutdown(m);
+	g_at_mux_unref(m);
+	close(fds[1]);
+}
+
+static void test_hdlc_coalesce(void)
+{
+	static const unsigned char frame[16] = { 0x12, 0x34, 0x56 };
+	GIOChannel *channel;
+	GAtHDLC *hdlc;
+	char buf[256];
+	guint calls;
+	gsize bytes;
+	int fds[2];
+	int i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	channel = g_io_channel_unix_new(fds[0]);
+	hdlc = g_at_hdlc_new(channel);
+	g_assert(hdlc);
+
+	/* Frames queued in one main loop iteration share a write */
+	for (i = 0; i < 3; i++)
+		g_assert(g_at_hdlc_send(hdlc, frame, sizeof(frame)));
+
+	while (g_main_context_iteration(NULL, FALSE));
+
+	g_assert(g_at_io_get_write_stats(g_at_hdlc_get_io(hdlc),
+							&calls, &bytes));
+	g_assert(calls == 1);
+	g_assert(bytes > 3 * sizeof(frame));
+	g_assert(read(fds[1], buf, sizeof(buf)) == (ssize_t) bytes);
+
+	g_at_hdlc_unref(hdlc);
+	g_io_channel_unref(channel);
+	close(fds[0]);
+	close(fds[1]);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -565,6 +691,9 @@ int main(int argc, char **argv)
 	g_test_add_func("/testmux/extract_basic", test_extract_basic);
 	g_test_add_func("/testmux/extract_advanced", test_extract_advanced);
 	g_test_add_func("/testmux/basic", test_basic);
+	g_test_add_func("/testmux/writev_fd", test_writev_fd);
+	g_test_add_func("/testmux/writev_dlc", test_writev_dlc);
+	g_test_add_func("/testmux/hdlc_coalesce", test_hdlc_coalesce);
 
 	return g_test_run();
 }
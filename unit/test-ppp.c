@@ -0,0 +1,379 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <netpacket/packet.h>
+#include <linux/if_tun.h>
+
+#include <glib.h>
+
+#include "gatio.h"
+#include "gatppp.h"
+#include "gatutil.h"
+
+/*
+ * Runs a DUN style server and a client GAtPPP back to back over a
+ * socketpair, with IPCP and IPV6CP negotiated in parallel.  Needs root
+ * for the tun interfaces, like unit/test-mux needs a network socket.
+ */
+
+#define SERVER_IP	"192.168.250.1"
+#define CLIENT_IP	"192.168.250.2"
+#define SERVER_ID	"fe80::1"
+#define CLIENT_ID	"fe80::2"
+
+#define PACKET_SIZE	512
+#define PACKET_COUNT	2000
+#define BATCH_SIZE	50
+
+static GMainLoop *mainloop;
+static char client_if[IFNAMSIZ];
+static gboolean client_ipv4;
+static gboolean client_ipv6;
+static gboolean server_up;
+static guint64 rx_target;
+static gboolean timed_out;
+static gboolean shutting_down;
+
+static void ppp_debug(const char *str, void *data)
+{
+	g_print("%s: %s\n", (const char *) data, str);
+}
+
+static void quit_if_connected(void)
+{
+	if (client_ipv4 && client_ipv6 && server_up)
+		g_main_loop_quit(mainloop);
+}
+
+static void client_connect(const char *iface, const char *local,
+				const char *peer, const char *dns1,
+				const char *dns2, gpointer user_data)
+{
+	g_assert_cmpstr(local, ==, CLIENT_IP);
+	g_assert_cmpstr(peer, ==, SERVER_IP);
+
+	g_strlcpy(client_if, iface, sizeof(client_if));
+	client_ipv4 = TRUE;
+	quit_if_connected();
+}
+
+static void client_ipv6_connect(const char *local, const char *peer,
+							gpointer user_data)
+{
+	g_assert(local != NULL);
+
+	g_assert_cmpstr(local, ==, CLIENT_ID);
+	g_assert_cmpstr(peer, ==, SERVER_ID);
+
+	client_ipv6 = TRUE;
+	quit_if_connected();
+}
+
+static void server_connect(const char *iface, const char *local,
+				const char *peer, const char *dns1,
+				const char *dns2, gpointer user_data)
+{
+	server_up = TRUE;
+	quit_if_connected();
+}
+
+static void ppp_disconnect(GAtPPPDisconnectReason reason, gpointer user_data)
+{
+	if (!shutting_down)
+		g_error("%s disconnected: %d", (const char *) user_data,
+								reason);
+}
+
+static GAtIO *create_io(int fd)
+{
+	GIOChannel *channel;
+	GAtIO *io;
+
+	channel = g_io_channel_unix_new(fd);
+	g_assert(channel != NULL);
+
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_assert(g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK));
+
+	io = g_at_io_new(channel);
+	g_io_channel_unref(channel);
+
+	return io;
+}
+
+static int create_tun(char *ifname)
+{
+	struct ifreq ifr;
+	int fd;
+
+	fd = open("/dev/net/tun", O_RDWR);
+	if (fd < 0)
+		return -1;
+
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	strcpy(ifr.ifr_name, "ppptest%d");
+
+	if (ioctl(fd, TUNSETIFF, (void *) &ifr) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	g_strlcpy(ifname, ifr.ifr_name, IFNAMSIZ);
+
+	return fd;
+}
+
+static int set_up(const char *ifname)
+{
+	struct ifreq ifr;
+	int sk, err;
+
+	sk = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sk < 0)
+		return -1;
+
+	memset(&ifr, 0, sizeof(ifr));
+	g_strlcpy(ifr.ifr_name, ifname, IFNAMSIZ);
+
+	err = ioctl(sk, SIOCGIFFLAGS, &ifr);
+	if (err == 0) {
+		ifr.ifr_flags |= IFF_UP;
+		err = ioctl(sk, SIOCSIFFLAGS, &ifr);
+	}
+
+	close(sk);
+
+	return err;
+}
+
+static guint64 rx_packets(const char *ifname)
+{
+	char *path;
+	char *contents = NULL;
+	guint64 count = 0;
+
+	path = g_strdup_printf("/sys/class/net/%s/statistics/rx_packets",
+									ifname);
+
+	if (g_file_get_contents(path, &contents, NULL, NULL))
+		count = g_ascii_strtoull(contents, NULL, 10);
+
+	g_free(contents);
+	g_free(path);
+
+	return count;
+}
+
+/* Build an IPv4 or IPv6 UDP packet from the server to the client */
+static void build_packet(unsigned char *buf, gsize size, gboolean ipv6,
+							unsigned int seq)
+{
+	memset(buf, 0, size);
+
+	if (ipv6) {
+		buf[0] = 0x60;
+		buf[4] = (size - 40) >> 8;
+		buf[5] = (size - 40) & 0xff;
+		buf[6] = IPPROTO_UDP;
+		buf[7] = 64;
+		inet_pton(AF_INET6, SERVER_ID, buf + 8);
+		inet_pton(AF_INET6, CLIENT_ID, buf + 24);
+	} else {
+		buf[0] = 0x45;
+		buf[2] = size >> 8;
+		buf[3] = size & 0xff;
+		buf[8] = 64;
+		buf[9] = IPPROTO_UDP;
+		inet_pton(AF_INET, SERVER_IP, buf + 12);
+		inet_pton(AF_INET, CLIENT_IP, buf + 16);
+	}
+
+	buf[size - 1] = seq & 0xff;
+}
+
+static gboolean check_rx(gpointer user_data)
+{
+	if (rx_packets(client_if) < rx_target)
+		return TRUE;
+
+	g_main_loop_quit(mainloop);
+
+	return FALSE;
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	timed_out = TRUE;
+	g_main_loop_quit(mainloop);
+
+	return FALSE;
+}
+
+/*
+ * Alternate IPv4 and IPv6 packets through the server's tun interface,
+ * which PPP carries to the client and writes to the client's tun
+ * interface.  Packets are sent in batches smaller than the tun queue so
+ * none are dropped before the server reads them.  The batch size is not
+ * a multiple of the packets GAtPPP reads per wakeup, so the server runs
+ * its tun queue dry, which hangs here if that read blocks.
+ */
+static void test_mixed_throughput(void)
+{
+	char server_if[IFNAMSIZ];
+	struct sockaddr_ll sll;
+	unsigned char packet[PACKET_SIZE];
+	GAtIO *server_io;
+	GAtIO *client_io;
+	GAtPPP *server;
+	GAtPPP *client;
+	GTimer *timer;
+	guint64 rx_start;
+	guint timeout;
+	int sv[2];
+	int tun_fd;
+	int sk;
+	int i;
+
+	tun_fd = create_tun(server_if);
+	if (tun_fd < 0) {
+		g_test_skip("Unable to create tun interface");
+		return;
+	}
+
+	sk = socket(AF_PACKET, SOCK_DGRAM, 0);
+	if (sk < 0) {
+		close(tun_fd);
+		g_test_skip("Unable to create packet socket");
+		return;
+	}
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+
+	server_io = create_io(sv[0]);
+	client_io = create_io(sv[1]);
+
+	server = g_at_ppp_server_new_full(SERVER_IP, tun_fd);
+	g_assert(server != NULL);
+
+	if (g_test_verbose())
+		g_at_ppp_set_debug(server, ppp_debug, "Server");
+
+	g_at_ppp_set_server_info(server, CLIENT_IP, SERVER_IP, SERVER_IP);
+	g_assert(g_at_ppp_enable_ipv6(server, SERVER_ID, CLIENT_ID));
+	g_at_ppp_set_connect_function(server, server_connect, NULL);
+	g_at_ppp_set_disconnect_function(server, ppp_disconnect, "Server");
+	g_assert(g_at_ppp_listen(server, server_io));
+
+	client = g_at_ppp_new();
+	g_assert(client != NULL);
+
+	if (g_test_verbose())
+		g_at_ppp_set_debug(client, ppp_debug, "Client");
+
+	g_at_ppp_set_auth_method(client, G_AT_PPP_AUTH_METHOD_NONE);
+	g_assert(g_at_ppp_enable_ipv6(client, NULL, NULL));
+	g_at_ppp_set_connect_function(client, client_connect, NULL);
+	g_at_ppp_set_ipv6_connect_function(client, client_ipv6_connect,
+									NULL);
+	g_at_ppp_set_disconnect_function(client, ppp_disconnect, "Client");
+	g_assert(g_at_ppp_open(client, client_io));
+
+	timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+	g_main_loop_run(mainloop);
+	g_assert(!timed_out);
+
+	g_assert(set_up(server_if) == 0);
+	g_assert(set_up(client_if) == 0);
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_ifindex = if_nametoindex(server_if);
+	g_assert(sll.sll_ifindex > 0);
+
+	rx_start = rx_packets(client_if);
+	rx_target = rx_start;
+	timer = g_timer_new();
+
+	for (i = 0; i < PACKET_COUNT; i++) {
+		gboolean ipv6 = i & 1;
+
+		build_packet(packet, sizeof(packet), ipv6, i);
+		sll.sll_protocol = htons(ipv6 ? ETHERTYPE_IPV6 : ETHERTYPE_IP);
+
+		g_assert(sendto(sk, packet, sizeof(packet), 0,
+				(struct sockaddr *) &sll,
+				sizeof(sll)) == sizeof(packet));
+
+		if ((i + 1) % BATCH_SIZE && i + 1 < PACKET_COUNT)
+			continue;
+
+		/* The kernel may add a few packets of its own */
+		rx_target = rx_start + i + 1;
+
+		g_timeout_add(1, check_rx, NULL);
+		g_main_loop_run(mainloop);
+		g_assert(!timed_out);
+	}
+
+	g_timer_stop(timer);
+
+	if (g_test_verbose())
+		g_print("%d mixed IPv4/IPv6 packets of %d bytes in %.3fs\n",
+				PACKET_COUNT, PACKET_SIZE,
+				g_timer_elapsed(timer, NULL));
+
+	g_timer_destroy(timer);
+	g_source_remove(timeout);
+
+	shutting_down = TRUE;
+	g_at_ppp_unref(client);
+	g_at_ppp_unref(server);
+
+	g_at_io_unref(client_io);
+	g_at_io_unref(server_io);
+
+	close(sk);
+	g_main_loop_unref(mainloop);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testppp/mixed_throughput", test_mixed_throughput);
+
+	return g_test_run();
+}
@@ -0,0 +1,379 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include <ell/ell.h>
+
+#include "drivers/qmimodem/qmi.h"
+
+/* CTL Get Version Info response, the transaction id is at offset 7 */
+static const unsigned char version_info_reply[] = {
+	0x01, 0x20, 0x00, 0x80, 0x00, 0x00,	/* QMUX, control service */
+	0x01, 0x00,				/* Response, transaction */
+	0x21, 0x00, 0x15, 0x00,			/* Get Version Info */
+	0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x0b, 0x00, 0x02,			/* Service list */
+	0x00, 0x01, 0x00, 0x04, 0x00,		/* CTL 1.4, no sync */
+	0x01, 0x01, 0x00, 0x0a, 0x00,		/* WDS 1.10 */
+};
+
+#define REPLY_TID_OFFSET 7
+#define QMI_MUX_HDR_LEN 6
+
+struct test_data {
+	struct qmi_device *device;
+	int fd;
+	uint8_t tid;
+	bool discovered;
+	struct qmi_service *service;
+};
+
+static void discover_cb(void *user_data)
+{
+	struct test_data *data = user_data;
+
+	data->discovered = true;
+}
+
+/* Wait for a control request and return its transaction id */
+static uint8_t test_data_read_request(struct test_data *data)
+{
+	unsigned char buf[64];
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		l_main_iterate(100);
+
+		len = read(data->fd, buf, sizeof(buf));
+		if (len > 0)
+			break;
+
+		assert(errno == EAGAIN);
+	}
+
+	assert(len > REPLY_TID_OFFSET);
+	assert(buf[0] == 0x01 && buf[4] == 0x00);
+
+	return buf[REPLY_TID_OFFSET];
+}
+
+static void test_data_init(struct test_data *data)
+{
+	int fds[2];
+
+	assert(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+	data->device = qmi_device_new_qmux_fd(fds[0]);
+	assert(data->device);
+
+	data->fd = fds[1];
+	data->discovered = false;
+	data->service = NULL;
+
+	assert(!qmi_device_discover(data->device, discover_cb, data, NULL));
+
+	/* Wait for the Get Version Info request */
+	data->tid = test_data_read_request(data);
+}
+
+static void test_data_free(struct test_data *data)
+{
+	qmi_device_free(data->device);
+	close(data->fd);
+}
+
+static void test_data_write(struct test_data *data, const void *buf,
+								size_t len)
+{
+	assert(write(data->fd, buf, len) == (ssize_t) len);
+}
+
+static void test_data_wait(struct test_data *data)
+{
+	int i;
+
+	for (i = 0; i < 10 && !data->discovered; i++)
+		l_main_iterate(100);
+
+	assert(data->discovered);
+	assert(qmi_device_has_service(data->device, QMI_SERVICE_WDS));
+}
+
+/* A control response nobody waits for, it is read and dropped */
+static size_t build_unrelated_reply(unsigned char *buf, uint8_t tid,
+							uint16_t payload)
+{
+	uint16_t len = 6 + payload;
+
+	buf[0] = 0x01;
+	l_put_le16(QMI_MUX_HDR_LEN - 1 + len, buf + 1);
+	buf[3] = 0x80;
+	buf[4] = 0x00;
+	buf[5] = 0x00;
+	buf[6] = 0x01;
+	buf[7] = tid;
+	l_put_le16(0x0021, buf + 8);
+	l_put_le16(payload, buf + 10);
+	memset(buf + 12, 0, payload);
+
+	return QMI_MUX_HDR_LEN + len;
+}
+
+/*
+ * Split the reply at every offset, with the first part read by the
+ * device before the rest arrives.
+ */
+static void test_qmux_split(const void *test_data)
+{
+	unsigned char reply[sizeof(version_info_reply)];
+	size_t split;
+
+	assert(l_main_init());
+
+	for (split = 1; split < sizeof(reply); split++) {
+		struct test_data data;
+
+		test_data_init(&data);
+
+		memcpy(reply, version_info_reply, sizeof(reply));
+		reply[REPLY_TID_OFFSET] = data.tid;
+
+		test_data_write(&data, reply, split);
+		l_main_iterate(0);
+		assert(!data.discovered);
+
+		test_data_write(&data, reply + split, sizeof(reply) - split);
+		test_data_wait(&data);
+
+		test_data_free(&data);
+	}
+
+	l_main_exit();
+}
+
+/*
+ * Several frames arriving in one read, followed by the start of the reply
+ * which has to be kept for the next read.
+ */
+static void test_qmux_coalesced(const void *test_data)
+{
+	unsigned char buf[256];
+	size_t len = 0;
+	size_t partial;
+	struct test_data data;
+
+	assert(l_main_init());
+
+	test_data_init(&data);
+
+	len += build_unrelated_reply(buf + len, data.tid + 1, 0);
+	len += build_unrelated_reply(buf + len, data.tid + 2, 16);
+
+	memcpy(buf + len, version_info_reply, sizeof(version_info_reply));
+	buf[len + REPLY_TID_OFFSET] = data.tid;
+	partial = len + 10;
+	len += sizeof(version_info_reply);
+
+	test_data_write(&data, buf, partial);
+	l_main_iterate(0);
+	assert(!data.discovered);
+
+	test_data_write(&data, buf + partial, len - partial);
+	test_data_wait(&data);
+
+	test_data_free(&data);
+
+	l_main_exit();
+}
+
+/* A frame larger than the initial receive buffer, followed by the reply */
+static void test_qmux_large_frame(const void *test_data)
+{
+	unsigned char buf[8192];
+	size_t len = 0;
+	struct test_data data;
+
+	assert(l_main_init());
+
+	test_data_init(&data);
+
+	len += build_unrelated_reply(buf + len, data.tid + 1, 6000);
+
+	memcpy(buf + len, version_info_reply, sizeof(version_info_reply));
+	buf[len + REPLY_TID_OFFSET] = data.tid;
+	len += sizeof(version_info_reply);
+
+	test_data_write(&data, buf, len);
+	test_data_wait(&data);
+
+	test_data_free(&data);
+
+	l_main_exit();
+}
+
+/* CTL Get Client Id response, WDS client 5 */
+static const unsigned char client_id_reply[] = {
+	0x01, 0x17, 0x00, 0x80, 0x00, 0x00,	/* QMUX, control service */
+	0x01, 0x00,				/* Response, transaction */
+	0x22, 0x00, 0x0c, 0x00,			/* Get Client Id */
+	0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x02, 0x00, 0x01, 0x05,
+};
+
+/* WDS indication 0x0001 for client 5, without TLVs */
+static const unsigned char wds_indication[] = {
+	0x01, 0x0c, 0x00, 0x80, 0x01, 0x05,	/* QMUX, WDS client 5 */
+	0x04, 0x00, 0x00,			/* Indication */
+	0x01, 0x00, 0x00, 0x00,
+};
+
+struct unregister_data {
+	struct qmi_service *service;
+	uint16_t self_id;
+	uint16_t same_id;		/* Same message, later in the queue */
+	uint16_t other_id;		/* Different message */
+	unsigned int self_calls;
+	unsigned int same_calls;
+	unsigned int destroyed;
+};
+
+static void create_cb(struct qmi_service *service, void *user_data)
+{
+	struct test_data *data = user_data;
+
+	data->service = qmi_service_ref(service);
+}
+
+static void unregister_self_cb(struct qmi_result *result, void *user_data)
+{
+	struct unregister_data *ud = user_data;
+
+	ud->self_calls++;
+
+	assert(qmi_service_unregister(ud->service, ud->self_id));
+	assert(qmi_service_unregister(ud->service, ud->same_id));
+	assert(qmi_service_unregister(ud->service, ud->other_id));
+
+	/* Already gone, even though not freed yet */
+	assert(!qmi_service_unregister(ud->service, ud->self_id));
+
+	/* Only the notify of the other message can be freed right away */
+	assert(ud->destroyed == 1);
+}
+
+static void same_cb(struct qmi_result *result, void *user_data)
+{
+	struct unregister_data *ud = user_data;
+
+	ud->same_calls++;
+}
+
+static void unregister_destroy(void *user_data)
+{
+	struct unregister_data *ud = user_data;
+
+	ud->destroyed++;
+}
+
+/* Indication handlers unregistering themselves and others */
+static void test_unregister_in_notify(const void *test_data)
+{
+	unsigned char reply[sizeof(version_info_reply)];
+	unsigned char id_reply[sizeof(client_id_reply)];
+	struct unregister_data ud;
+	struct test_data data;
+	int i;
+
+	assert(l_main_init());
+
+	test_data_init(&data);
+
+	memcpy(reply, version_info_reply, sizeof(reply));
+	reply[REPLY_TID_OFFSET] = data.tid;
+	test_data_write(&data, reply, sizeof(reply));
+	test_data_wait(&data);
+
+	assert(qmi_service_create(data.device, QMI_SERVICE_WDS, create_cb,
+								&data, NULL));
+
+	memcpy(id_reply, client_id_reply, sizeof(id_reply));
+	id_reply[REPLY_TID_OFFSET] = test_data_read_request(&data);
+	test_data_write(&data, id_reply, sizeof(id_reply));
+
+	for (i = 0; i < 10 && !data.service; i++)
+		l_main_iterate(100);
+
+	assert(data.service);
+
+	memset(&ud, 0, sizeof(ud));
+	ud.service = data.service;
+	ud.self_id = qmi_service_register(data.service, 0x0001,
+						unregister_self_cb, &ud,
+						unregister_destroy);
+	ud.same_id = qmi_service_register(data.service, 0x0001, same_cb,
+						&ud, unregister_destroy);
+	ud.other_id = qmi_service_register(data.service, 0x0002, same_cb,
+						&ud, unregister_destroy);
+
+	test_data_write(&data, wds_indication, sizeof(wds_indication));
+
+	for (i = 0; i < 10 && !ud.self_calls; i++)
+		l_main_iterate(100);
+
+	assert(ud.self_calls == 1);
+	assert(ud.same_calls == 0);
+	assert(ud.destroyed == 3);
+
+	/* Nothing is left registered for the next indication */
+	test_data_write(&data, wds_indication, sizeof(wds_indication));
+	l_main_iterate(100);
+
+	assert(ud.self_calls == 1);
+	assert(ud.same_calls == 0);
+
+	qmi_service_unref(data.service);
+	test_data_free(&data);
+
+	l_main_exit();
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("QMUX reply split at every offset", test_qmux_split, NULL);
+	l_test_add("QMUX frames coalesced in one read",
+					test_qmux_coalesced, NULL);
+	l_test_add("QMUX frame larger than the receive buffer",
+					test_qmux_large_frame, NULL);
+	l_test_add("Unregister from an indication handler",
+					test_unregister_in_notify, NULL);
+
+	return l_test_run();
+}
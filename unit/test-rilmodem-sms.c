@@ -329,6 +329,68 @@ static const struct sms_data testdata_submit_invalid_1 = {
 	.error_type = OFONO_ERROR_TYPE_FAILURE,
 };
 
+/*
+ * SEND_SMS with 8 bit user data, long enough for the TPDU string to
+ * outgrow the initial parcel buffer.  With 100 bytes of user data the
+ * parcel fits in twice the initial size, with 140 bytes it needs more
+ * than that.  The PDUs and expected parcels are filled in by
+ * build_submit_long() before the tests run.
+ */
+static const unsigned char submit_long_tpdu_hdr[] = {
+	0x01, 0x00, 0x09, 0x81, 0x36, 0x54, 0x39, 0x80, 0xf5, 0x00, 0x04
+};
+
+#define SUBMIT_LONG_UD_1	100
+#define SUBMIT_LONG_UD_2	140
+
+#define SUBMIT_LONG_TPDU_LEN(ud) (sizeof(submit_long_tpdu_hdr) + 1 + (ud))
+#define SUBMIT_LONG_PDU_LEN(ud) (1 + SUBMIT_LONG_TPDU_LEN(ud))
+#define SUBMIT_LONG_PARCEL_LEN(ud) \
+	(24 + (((SUBMIT_LONG_TPDU_LEN(ud) * 2 + 1) * 2 + 3) & ~3))
+
+static unsigned char req_send_sms_pdu_long_1[
+					SUBMIT_LONG_PDU_LEN(SUBMIT_LONG_UD_1)];
+static guchar req_send_sms_parcel_long_1[
+					SUBMIT_LONG_PARCEL_LEN(SUBMIT_LONG_UD_1)];
+static unsigned char req_send_sms_pdu_long_2[
+					SUBMIT_LONG_PDU_LEN(SUBMIT_LONG_UD_2)];
+static guchar req_send_sms_parcel_long_2[
+					SUBMIT_LONG_PARCEL_LEN(SUBMIT_LONG_UD_2)];
+
+static const struct sms_data testdata_submit_long_1 = {
+	.start_func = trigger_submit,
+	.pdu = req_send_sms_pdu_long_1,
+	.pdu_len = sizeof(req_send_sms_pdu_long_1),
+	.tpdu_len = sizeof(req_send_sms_pdu_long_1) - 1,
+	.mms = 0,
+	.rtd = {
+		.req_data = req_send_sms_parcel_long_1,
+		.req_size = sizeof(req_send_sms_parcel_long_1),
+		.rsp_data = rsp_send_sms_valid_1,
+		.rsp_size = sizeof(rsp_send_sms_valid_1),
+		.rsp_error = RIL_E_SUCCESS,
+	},
+	.mr = 1,
+	.error_type = OFONO_ERROR_TYPE_NO_ERROR,
+};
+
+static const struct sms_data testdata_submit_long_2 = {
+	.start_func = trigger_submit,
+	.pdu = req_send_sms_pdu_long_2,
+	.pdu_len = sizeof(req_send_sms_pdu_long_2),
+	.tpdu_len = sizeof(req_send_sms_pdu_long_2) - 1,
+	.mms = 0,
+	.rtd = {
+		.req_data = req_send_sms_parcel_long_2,
+		.req_size = sizeof(req_send_sms_parcel_long_2),
+		.rsp_data = rsp_send_sms_valid_1,
+		.rsp_size = sizeof(rsp_send_sms_valid_1),
+		.rsp_error = RIL_E_SUCCESS,
+	},
+	.mr = 1,
+	.error_type = OFONO_ERROR_TYPE_NO_ERROR,
+};
+
 /*
  * The following hexadecimal data represents a serialized Binder parcel
  * instance containing a valid RIL_UNSOL_RESPONSE_NEW_SMS message
@@ -492,6 +554,48 @@ static void server_connect_cb(gpointer data)
 
 #if BYTE_ORDER == LITTLE_ENDIAN
 
+static void build_submit_long(unsigned char *pdu, guchar *parcel,
+								int ud_len)
+{
+	int tpdu_len = SUBMIT_LONG_TPDU_LEN(ud_len);
+	int parcel_len = SUBMIT_LONG_PARCEL_LEN(ud_len);
+	unsigned char *ud;
+	guchar *str;
+	char hex[3];
+	int i;
+
+	/* Default SMSC, header, user data length and the user data */
+	pdu[0] = 0x00;
+	memcpy(pdu + 1, submit_long_tpdu_hdr, sizeof(submit_long_tpdu_hdr));
+	ud = pdu + 1 + sizeof(submit_long_tpdu_hdr);
+	*ud++ = ud_len;
+
+	for (i = 0; i < ud_len; i++)
+		ud[i] = i * 7;
+
+	memset(parcel, 0, parcel_len);
+
+	/* Length in network order, RIL_REQUEST_SEND_SMS and serial */
+	parcel[2] = (parcel_len - 4) >> 8;
+	parcel[3] = (parcel_len - 4) & 0xff;
+	parcel[4] = 0x19;
+
+	/* Two strings, the SMSC address is NULL */
+	parcel[12] = 0x02;
+	memset(parcel + 16, 0xff, 4);
+
+	/* The TPDU as UTF-16 hex, NUL terminated and padded */
+	parcel[20] = (tpdu_len * 2) & 0xff;
+	parcel[21] = (tpdu_len * 2) >> 8;
+	str = parcel + 24;
+
+	for (i = 0; i < tpdu_len; i++) {
+		sprintf(hex, "%02X", pdu[1 + i]);
+		str[i * 4] = hex[0];
+		str[i * 4 + 2] = hex[1];
+	}
+}
+
 /*
  * This unit test:
  *  - does some test data setup
@@ -565,6 +669,16 @@ int main(int argc, char **argv)
 	g_test_add_data_func("/testrilmodemsms/submit/invalid/1",
 					&testdata_submit_invalid_1,
 					test_sms_func);
+	build_submit_long(req_send_sms_pdu_long_1,
+				req_send_sms_parcel_long_1, SUBMIT_LONG_UD_1);
+	g_test_add_data_func("/testrilmodemsms/submit/long/1",
+					&testdata_submit_long_1,
+					test_sms_func);
+	build_submit_long(req_send_sms_pdu_long_2,
+				req_send_sms_parcel_long_2, SUBMIT_LONG_UD_2);
+	g_test_add_data_func("/testrilmodemsms/submit/long/2",
+					&testdata_submit_long_2,
+					test_sms_func);
 	g_test_add_data_func("/testrilmodemsms/new_sms/valid/1",
 					&testdata_new_sms_valid_1,
 					test_sms_func);
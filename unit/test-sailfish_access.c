@@ -14,6 +14,7 @@
  */
 
 #include "ofono.h"
+#include "fake_dbus_watch.h"
 
 #include <dbusaccess_peer.h>
 #include <dbusaccess_policy.h>
@@ -22,9 +23,12 @@
 #include <gutil_idlepool.h>
 #include <gutil_log.h>
 
+#include <gdbus.h>
+
 #include <errno.h>
 
 static GUtilIdlePool* peer_pool;
+static int peer_lookups;
 
 extern struct ofono_plugin_desc __ofono_builtin_sailfish_access;
 extern const char *sailfish_access_config_file;
@@ -41,12 +45,15 @@ extern const char *sailfish_access_config_file;
 #define PRIVILEGED_GID (996)
 #define SAILFISH_RADIO_GID (997)
 
+#define BENCH_CALLS (100000)
+
 /*==========================================================================*
  * Stubs
  *==========================================================================*/
 
 DAPeer *da_peer_get(DA_BUS bus, const char *name)
 {
+	peer_lookups++;
 	if (name && g_strcmp0(name, INVALID_SENDER)) {
 		gsize len = strlen(name);
 		DAPeer *peer = g_malloc0(sizeof(DAPeer) + len + 1);
@@ -72,6 +79,13 @@ void da_peer_flush(DA_BUS bus, const char *name)
 	gutil_idle_pool_drain(peer_pool);
 }
 
+/* Verdicts are cached until the sender leaves the bus */
+
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	return fake_dbus_watch_connection();
+}
+
 /*
  * The build environment doesn't necessarily have these users and groups.
  * And yet, sailfish access plugin depends on those.
@@ -147,6 +161,56 @@ static void test_default()
 	sailfish_access_config_file = default_config_file;
 }
 
+static void test_cache()
+{
+	const char *default_config_file = sailfish_access_config_file;
+	unsigned int hits, misses, hits0, misses0;
+	gint64 start;
+	int i;
+
+	sailfish_access_config_file = "/no such file";
+	g_assert(__ofono_builtin_sailfish_access.init() == 0);
+	__ofono_dbus_access_cache_stats(&hits0, &misses0);
+	peer_lookups = 0;
+
+	/* The policy is only evaluated once per sender and method */
+	start = g_get_monotonic_time();
+	for (i = 0; i < BENCH_CALLS; i++) {
+		g_assert(ofono_dbus_access_method_allowed(PRIVILEGED_SENDER,
+				OFONO_DBUS_ACCESS_INTF_VOICECALLMGR,
+				OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL, NULL));
+	}
+	DBG("%d calls: %d us", BENCH_CALLS,
+				(int)(g_get_monotonic_time() - start));
+	g_assert_cmpint(peer_lookups, == ,1);
+	__ofono_dbus_access_cache_stats(&hits, &misses);
+	g_assert_cmpuint(hits - hits0, == ,BENCH_CALLS - 1);
+	g_assert_cmpuint(misses - misses0, == ,1);
+
+	/* Denials are cached too */
+	g_assert(!ofono_dbus_access_method_allowed(NON_PRIVILEGED_SENDER,
+				OFONO_DBUS_ACCESS_INTF_VOICECALLMGR,
+				OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL, NULL));
+	g_assert(!ofono_dbus_access_method_allowed(NON_PRIVILEGED_SENDER,
+				OFONO_DBUS_ACCESS_INTF_VOICECALLMGR,
+				OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL, NULL));
+	g_assert_cmpint(peer_lookups, == ,2);
+
+	/* NameOwnerChanged invalidates the sender's verdicts */
+	fake_dbus_watch_name_lost(PRIVILEGED_SENDER);
+	g_assert(ofono_dbus_access_method_allowed(PRIVILEGED_SENDER,
+				OFONO_DBUS_ACCESS_INTF_VOICECALLMGR,
+				OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL, NULL));
+	g_assert_cmpint(peer_lookups, == ,3);
+
+	/* Unloading the policy drops everything */
+	__ofono_builtin_sailfish_access.exit();
+	g_assert(!fake_dbus_watch_count());
+
+	/* Restore the defaults */
+	sailfish_access_config_file = default_config_file;
+}
+
 struct test_config_data {
 	gboolean allowed;
 	const char *sender;
@@ -281,6 +345,7 @@ int main(int argc, char *argv[])
 
 	g_test_add_func(TEST_("register"), test_register);
 	g_test_add_func(TEST_("default"), test_default);
+	g_test_add_func(TEST_("cache"), test_cache);
 	for (i = 0; i < G_N_ELEMENTS(config_tests); i++) {
 		char* name = g_strdup_printf(TEST_("config/%d"), i + 1);
 		const struct test_config_data *test = config_tests + i;
@@ -407,6 +407,179 @@ static void test_eons(void)
 	sim_eons_free(eons_info);
 }
 
+struct eons_test_opl {
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	guint16 low;
+	guint16 high;
+	guint8 id;
+};
+
+/*
+ * The OPL matching rules of 3GPP TS 31.102, applied record by record.
+ * Returns the index of the matching record or -1.
+ */
+static int eons_test_match(const struct eons_test_opl *opl, int num_opl,
+				const char *mcc, const char *mnc,
+				gboolean have_lac, guint16 lac)
+{
+	int i, j;
+
+	for (i = 0; i < num_opl; i++) {
+		for (j = 0; j < OFONO_MAX_MCC_LENGTH; j++)
+			if (mcc[j] != opl[i].mcc[j] &&
+					!(opl[i].mcc[j] == 'b' && mcc[j]))
+				break;
+		if (j < OFONO_MAX_MCC_LENGTH)
+			continue;
+
+		for (j = 0; j < OFONO_MAX_MNC_LENGTH; j++)
+			if (mnc[j] != opl[i].mnc[j] &&
+					!(opl[i].mnc[j] == 'b' && mnc[j]))
+				break;
+		if (j < OFONO_MAX_MNC_LENGTH)
+			continue;
+
+		if (opl[i].low == 0 && opl[i].high == 0xfffe)
+			return i;
+
+		if (have_lac && lac >= opl[i].low && lac <= opl[i].high)
+			return i;
+	}
+
+	return -1;
+}
+
+static gboolean eons_test_is_wildcard(const struct eons_test_opl *opl)
+{
+	return memchr(opl->mcc, 'b', OFONO_MAX_MCC_LENGTH) != NULL ||
+		memchr(opl->mnc, 'b', OFONO_MAX_MNC_LENGTH) != NULL;
+}
+
+static void eons_test_check(const struct eons_test_opl *opl, int match,
+				const struct sim_eons_operator_info *op_info,
+				const char *names, int *wildcard_hits,
+				int *exact_hits)
+{
+	/* 0 is not a valid record id, it hides any later match */
+	if (match < 0 || opl[match].id == 0) {
+		g_assert(op_info == NULL);
+		return;
+	}
+
+	g_assert(op_info);
+	g_assert(op_info->longname[0] == names[opl[match].id - 1]);
+
+	if (eons_test_is_wildcard(&opl[match]))
+		*wildcard_hits += 1;
+	else
+		*exact_hits += 1;
+}
+
+static void test_eons_opl_lookup(void)
+{
+	/* Lookups use digits 0 and 1, records add the 'b' wildcard */
+	static const char digits[] = "01";
+	static const guint8 nibbles[] = { 0x0, 0x1, 0xd, 0xf };
+	static const guint16 lacs[] = { 0, 1, 2, 3, 0x100, 0xfffe, 0xffff };
+	static const char names[] = "ABCDEFGHIJKLMNOPQRST";
+	const int pnn_max = sizeof(names) - 1;
+	struct eons_test_opl opl[256];
+	int wildcard_hits = 0;
+	int exact_hits = 0;
+	int round;
+	int i;
+
+	for (round = 0; round < 200; round++) {
+		struct sim_eons *eons = sim_eons_new(pnn_max);
+		int num_records = g_test_rand_int_range(1, 256);
+		int num_opl = 0;
+
+		for (i = 1; i <= pnn_max; i++) {
+			guint8 pnn[] = { 0x43, 0x02, 0x00, names[i - 1] };
+
+			sim_eons_add_pnn_record(eons, i, pnn, sizeof(pnn));
+		}
+
+		for (i = 0; i < num_records; i++) {
+			guint8 record[8];
+			guint16 low, high;
+
+			record[0] = nibbles[g_test_rand_int_range(0, 3)] |
+				nibbles[g_test_rand_int_range(0, 3)] << 4;
+			record[1] = nibbles[g_test_rand_int_range(0, 3)] |
+				nibbles[g_test_rand_int_range(0, 4)] << 4;
+			record[2] = nibbles[g_test_rand_int_range(0, 3)] |
+				nibbles[g_test_rand_int_range(0, 3)] << 4;
+
+			if (g_test_rand_int_range(0, 8) == 0) {
+				low = 0;
+				high = 0xfffe;
+			} else {
+				low = lacs[g_test_rand_int_range(0, 7)];
+				high = lacs[g_test_rand_int_range(0, 7)];
+			}
+
+			record[3] = low >> 8;
+			record[4] = low & 0xff;
+			record[5] = high >> 8;
+			record[6] = high & 0xff;
+			record[7] = g_test_rand_int_range(0, pnn_max + 2);
+
+			sim_eons_add_opl_record(eons, record, sizeof(record));
+
+			/* Records beyond the PNN file are ignored */
+			if (record[7] > pnn_max)
+				continue;
+
+			sim_parse_mcc_mnc(record, opl[num_opl].mcc,
+						opl[num_opl].mnc);
+			opl[num_opl].low = low;
+			opl[num_opl].high = high;
+			opl[num_opl].id = record[7];
+			num_opl += 1;
+		}
+
+		sim_eons_optimize(eons);
+
+		for (i = 0; i < 64; i++) {
+			const struct sim_eons_operator_info *op_info;
+			char mcc[OFONO_MAX_MCC_LENGTH + 1] = "";
+			char mnc[OFONO_MAX_MNC_LENGTH + 1] = "";
+			guint16 lac = lacs[g_test_rand_int_range(0, 7)];
+			int match;
+			int j;
+
+			for (j = 0; j < OFONO_MAX_MCC_LENGTH; j++)
+				mcc[j] = digits[g_test_rand_int_range(0, 2)];
+
+			for (j = 0; j < OFONO_MAX_MNC_LENGTH; j++)
+				mnc[j] = digits[g_test_rand_int_range(0, 2)];
+
+			if (g_test_rand_int_range(0, 2))
+				mnc[2] = '\0';
+
+			match = eons_test_match(opl, num_opl, mcc, mnc,
+							FALSE, 0);
+			op_info = sim_eons_lookup(eons, mcc, mnc);
+			eons_test_check(opl, match, op_info, names,
+						&wildcard_hits, &exact_hits);
+
+			match = eons_test_match(opl, num_opl, mcc, mnc,
+							TRUE, lac);
+			op_info = sim_eons_lookup_with_lac(eons, mcc, mnc, lac);
+			eons_test_check(opl, match, op_info, names,
+						&wildcard_hits, &exact_hits);
+		}
+
+		sim_eons_free(eons);
+	}
+
+	/* Both the wildcard scan and the exact PLMN index were exercised */
+	g_assert(wildcard_hits > 0);
+	g_assert(exact_hits > 0);
+}
+
 static void test_ef_db(void)
 {
 	struct sim_ef_info *info;
@@ -761,6 +934,7 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/ber tlv encode 3G Status response",
 			test_ber_tlv_builder_3g_status);
 	g_test_add_func("/testsimutil/EONS Handling", test_eons);
+	g_test_add_func("/testsimutil/EONS OPL lookup", test_eons_opl_lookup);
 	g_test_add_func("/testsimutil/Elementary File DB", test_ef_db);
 	g_test_add_func("/testsimutil/3G Status response", test_3g_status_data);
 	g_test_add_func("/testsimutil/Application entries decoding",
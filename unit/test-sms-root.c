@@ -31,6 +31,7 @@
 #include <glib.h>
 
 #include "util.h"
+#include "storage.h"
 #include "smsutil.h"
 
 static const bool VERBOSE = false;
@@ -116,12 +117,78 @@ static void test_serialize_assembly(void)
 	sms_assembly_free(assembly);
 }
 
+static void store_old_fragment(const char *imsi, const char *hex, int tpdu_len)
+{
+	unsigned char buf[177];
+	long pdu_len;
+	struct sms sms;
+	DECLARE_SMS_ADDR_STR(straddr);
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+
+	decode_hex_own_buf(hex, -1, &pdu_len, 0, buf + 1);
+	buf[0] = tpdu_len;
+
+	g_assert(sms_decode(buf + 1, pdu_len, FALSE, tpdu_len, &sms));
+	g_assert(sms_extract_concatenation(&sms, &ref, &max, &seq));
+	g_assert(sms_address_to_hex_string(&sms.deliver.oaddr, straddr));
+
+	g_assert(write_file(buf, pdu_len + 1,
+				STORAGEDIR "/%s/sms_assembly/%s-%i-%i/%03i",
+				imsi, straddr, ref, max, seq) == pdu_len + 1);
+}
+
+static void test_migrate_assembly(void)
+{
+	unsigned char pdu[176];
+	long pdu_len;
+	struct sms sms;
+	struct sms_assembly *assembly;
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	GSList *l;
+
+	store_old_fragment("5678", assembly_pdu1, assembly_pdu_len1);
+	store_old_fragment("5678", assembly_pdu2, assembly_pdu_len2);
+
+	assembly = sms_assembly_new("5678");
+	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	sms_assembly_free(assembly);
+
+	/* The old layout is gone, fragments now come from the journal */
+	g_assert(!g_file_test(STORAGEDIR "/5678/sms_assembly",
+				G_FILE_TEST_EXISTS));
+
+	assembly = sms_assembly_new("5678");
+	g_assert(g_slist_length(assembly->assembly_list) == 1);
+
+	decode_hex_own_buf(assembly_pdu3, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len3, &sms);
+
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
+					&sms.deliver.oaddr, ref, max, seq);
+
+	g_assert(g_slist_length(l) == 3);
+	g_slist_free_full(l, g_free);
+
+	sms_assembly_free(assembly);
+
+	assembly = sms_assembly_new("5678");
+	g_assert(assembly->assembly_list == NULL);
+	sms_assembly_free(assembly);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/testsms/Test SMS Assembly Serialize",
 			test_serialize_assembly);
+	g_test_add_func("/testsms/Test SMS Assembly Migration",
+			test_migrate_assembly);
 
 	return g_test_run();
 }
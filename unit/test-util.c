@@ -1000,6 +1000,71 @@ static void test_unicode_to_gsm(void)
 	}
 }
 
+struct best_lang_test {
+	const char *utf8;
+	enum gsm_dialect hint;
+	enum gsm_dialect locking;
+	enum gsm_dialect single;
+	const unsigned char *gsm;
+	long gsm_len;
+};
+
+static const unsigned char best_lang_hello[] = { 0x48, 0x65, 0x6c, 0x6c, 0x6f };
+static const unsigned char best_lang_g_breve[] = { 0x61, 0x1b, 0x67 };
+static const unsigned char best_lang_ka[] = { 0x15 };
+static const unsigned char best_lang_a_acute[] = { 0x1b, 0x61 };
+
+static const struct best_lang_test best_lang_tests[] = {
+	{ "Hello", GSM_DIALECT_TURKISH, GSM_DIALECT_DEFAULT,
+		GSM_DIALECT_DEFAULT, best_lang_hello,
+		sizeof(best_lang_hello) },
+	{ "a\xc4\x9f", GSM_DIALECT_TURKISH, GSM_DIALECT_DEFAULT,
+		GSM_DIALECT_TURKISH, best_lang_g_breve,
+		sizeof(best_lang_g_breve) },
+	{ "\xe0\xa4\x95", GSM_DIALECT_HINDI, GSM_DIALECT_HINDI,
+		GSM_DIALECT_HINDI, best_lang_ka, sizeof(best_lang_ka) },
+	{ "\xc3\xa1", GSM_DIALECT_SPANISH, GSM_DIALECT_DEFAULT,
+		GSM_DIALECT_SPANISH, best_lang_a_acute,
+		sizeof(best_lang_a_acute) },
+	{ "\xc3\xa1", GSM_DIALECT_DEFAULT, 0, 0, NULL, 0 },
+	{ "a\xc4\x9f", GSM_DIALECT_SPANISH, 0, 0, NULL, 1 },
+};
+
+static void test_best_lang(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(best_lang_tests); i++) {
+		const struct best_lang_test *test = &best_lang_tests[i];
+		enum gsm_dialect locking;
+		enum gsm_dialect single;
+		unsigned char *res;
+		long nwritten;
+		long nread;
+
+		res = convert_utf8_to_gsm_best_lang(test->utf8, -1, &nread,
+							&nwritten, 0,
+							test->hint,
+							&locking, &single);
+
+		if (test->gsm == NULL) {
+			/* gsm_len is the offset of the first bad character */
+			g_assert(res == NULL);
+			g_assert(nread == test->gsm_len);
+			continue;
+		}
+
+		g_assert(res);
+		g_assert(nread == (long) strlen(test->utf8));
+		g_assert(nwritten == test->gsm_len);
+		g_assert(!memcmp(res, test->gsm, nwritten));
+		g_assert(locking == test->locking);
+		g_assert(single == test->single);
+
+		l_free(res);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -1016,6 +1081,8 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/SIM conversions", test_sim);
 	g_test_add_func("/testutil/Valid Unicode to GSM Conversion",
 			test_unicode_to_gsm);
+	g_test_add_func("/testutil/Best Language Conversion",
+			test_best_lang);
 
 	return g_test_run();
 }